@@ -2,23 +2,42 @@
  * @file Estufa_Final.c
  * @brief Controlador de Estufa Automatizada com RP2040 (Raspberry Pi Pico)
  * * Funcionalidades:
- * - Leitura de sensores (LDR, NTC, Umidade) com filtro de média móvel.
- * - Controle de atuadores (Bomba, Ventilador, LED de Crescimento).
- * - Lógica de fotoperíodo (meta diária de luz considerando Sol + LED).
- * - Comunicação UART bidirecional (Recebimento de comandos e Telemetria).
- * - Arquitetura não-bloqueante usando interrupções e temporizadores.
+ * - Leitura de sensores (LDR, NTC, Umidade) com motor de filtros configurável por canal.
+ * - Aquisição por ADC em round-robin contínuo com DMA (buffer ping-pong).
+ * - Controle de atuadores (Bomba, Ventilador, LED de Crescimento) por PWM com malhas PI e histerese.
+ * - Lógica de fotoperíodo: dose diária de luz (Sol + LED) integrada a cada amostra,
+ *   com virada de dia pelo RTC (sincronizado via SET,TIME).
+ * - Comunicação bidirecional pela UART (TX via DMA) ou pela USB nativa (CDC), com o mesmo protocolo.
+ * - Arquitetura orientada a eventos: ISRs postam eventos e os núcleos dormem em WFE.
+ * - Núcleo 0: amostragem e controle. Núcleo 1: comandos e telemetria (opcional).
+ * - Instrumentação de trechos críticos (ciclos por SysTick + histograma log2).
+ * - Log circular em flash para descarregar o histórico após queda do host.
+ * - Conversão para °C e % em ponto fixo (tabelas geradas, sem float no M0+).
  */
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "pico/stdlib.h"
 #include "hardware/adc.h"
+#include "hardware/dma.h"
 #include "hardware/uart.h"
 #include "pico/time.h"
 #include "hardware/sync.h" 
 #include "hardware/irq.h"
 #include "hardware/watchdog.h"
+#include "pico/multicore.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/flash.h"
+#include "hardware/pwm.h"
+#include "hardware/rtc.h"
+#include "pico/flash.h"
+#include "pico/unique_id.h"
+#include "pico/bootrom.h"
+#include "tusb.h"         // TinyUSB (configuração em tusb_config.h)
+#include "tabelas_conversao.h" // Gerado por tools/gera_tabelas.py
 
 // --- Definição de Hardware ---
 const uint FAN_PIN = 6;           // Controle do Ventilador
@@ -28,240 +47,2645 @@ const uint PIN_ADC_0_LDR = 26;    // ADC0: Sensor de Luz
 const uint PIN_ADC_1_NTC = 27;    // ADC1: Sensor de Temperatura
 const uint PIN_ADC_2_UMIDADE = 28;// ADC2: Sensor de Umidade de Solo
 
+// --- Divisão entre Núcleos ---
+// 1 = núcleo 1 cuida da UART (RX, comandos, enquadramento e TX); o núcleo 0 fica
+// só com o timer de amostragem, o DMA do ADC e os atuadores.
+// 0 = tudo no núcleo 0, como um super loop único.
+#define DUAL_CORE_IO 1
+
 // --- Configuração da UART ---
 #define UART_ID uart0
 #define BAUD_RATE 9600
 #define UART_TX_PIN 0
 #define UART_RX_PIN 1
 
+// --- Transporte USB (CDC) ---
+// 1 = o firmware também expõe uma porta CDC na USB nativa com o mesmo protocolo
+// enquadrado (sem conversor externo nem limite de baud). O enlace ativo é a USB
+// enquanto o host mantém DTR (porta aberta); senão, a UART. 0 = só UART.
+#define TRANSPORTE_USB 1
+#define USB_VID 0x2E8A        // Raspberry Pi
+#define USB_PID 0x000A        // Mesmo PID do stdio USB do SDK (CDC)
+#define USB_BAUD_BOOTSEL 1200 // Abrir a CDC a 1200 baud reinicia no bootloader (como o stdio USB)
+
 // --- Parâmetros do Filtro de Média Móvel ---
 // Utiliza deslocamento de bits para divisão rápida (2^5 = 32 amostras)
 #define AVG_SHIFT_BITS 5
-#define AVG_SAMPLES (1 << AVG_SHIFT_BITS)
 #define TIMER_ISR_INTERVAL_MS 100 // Frequência de amostragem
 
-// Buffers circulares para armazenar histórico de leituras
-static uint16_t ldr_buffer[AVG_SAMPLES], ntc_buffer[AVG_SAMPLES], umidade_buffer[AVG_SAMPLES];
-static int avg_idx = 0; // Índice atual do buffer circular
-static uint32_t ldr_sum = 0, ntc_sum = 0, umidade_sum = 0; // Somas acumuladas para cálculo eficiente
+// --- Aquisição ADC (Round-Robin + DMA Ping-Pong) ---
+// O ADC converte continuamente ADC0 -> ADC1 -> ADC2 e um canal DMA preenche blocos
+// alternados. Ao fim de cada bloco um canal de controle, encadeado, reescreve o
+// endereço de escrita com o da outra metade e redispara o de dados: a troca não
+// depende da CPU e uma ISR atrasada só perde um bloco, sem escrever fora do buffer.
+// A CPU apenas reduz (soma) o bloco já concluído.
+#define ADC_MODO_DMA 1                 // 0 = leitura bloqueante com adc_read() no timer
+#define ADC_NUM_CANAIS 3
+#define ADC_TAXA_POR_CANAL_HZ 2000     // Sobreamostragem por canal (6 kSa/s no total)
+#define ADC_BLOCO_SHIFT 4              // 2^4 = 16 conversões por canal (1 bloco a cada 8ms = 125 Hz)
+#define ADC_BLOCO_POR_CANAL (1 << ADC_BLOCO_SHIFT)
+#define ADC_BLOCO_AMOSTRAS (ADC_NUM_CANAIS * ADC_BLOCO_POR_CANAL) // Múltiplo de 3: mantém alinhamento dos canais
+#define ADC_CLOCK_HZ 48000000.0f       // Clock do ADC (USB PLL)
+
+#define CANAL_LDR 0 // Índices dos canais (ordem do round-robin do ADC)
+#define CANAL_NTC 1
+#define CANAL_UMIDADE 2
+
+#if ADC_MODO_DMA
+static uint16_t adc_blocos[2][ADC_BLOCO_AMOSTRAS]; // Ping-pong preenchido pelo DMA
+// Endereços lidos em anel pelo canal de controle (alinhados ao tamanho do anel)
+static volatile void *adc_enderecos[2] __attribute__((aligned(2 * sizeof(void *)))) = { adc_blocos[0], adc_blocos[1] };
+static uint dma_adc_ch;          // Canal de dados (FIFO do ADC -> bloco)
+static uint dma_adc_controle_ch; // Canal de controle (próximo endereço -> WRITE_ADDR do de dados)
+static volatile uint32_t adc_acc_soma[ADC_NUM_CANAIS]; // Soma das conversões desde a última coleta
+static volatile uint32_t adc_acc_blocos = 0;           // Blocos reduzidos desde a última coleta
+static uint16_t adc_ultima_media[ADC_NUM_CANAIS];      // Reutilizada se nenhum bloco fechou no período
+#endif
 
 // --- Variáveis Globais (Voláteis pois são alteradas em ISR) ---
+volatile uint16_t g_adc_ultimo[ADC_NUM_CANAIS]; // Amostra mais recente sem média móvel (LDR, NTC, Umidade)
 volatile uint16_t g_ldr_filtrado = 0;
 volatile uint16_t g_ntc_filtrado = 0;
 volatile uint16_t g_umidade_filtrada = 0;
 
-// Setpoints de Controle (Valores padrão, alteráveis via UART)
-volatile uint16_t g_umidade_setpoint_raw = 3000;
-volatile uint16_t g_temp_setpoint_raw = 1600;
+// Valores filtrados em unidades físicas (centésimos), atualizados junto com a média
+volatile int16_t g_temp_cc = TEMP_CC_INVALIDA;
+volatile uint16_t g_umidade_cp = 0;
+
+// Setpoints de Controle em centésimos (Valores padrão, alteráveis via UART)
+volatile uint16_t g_umidade_setpoint_cp = 753; // 7,53 % (ADC ~3000)
+volatile int16_t g_temp_setpoint_cc = 3535;    // 35,35 °C (ADC ~1600)
 volatile uint16_t g_ldr_limiar_raw = 2000; 
 volatile bool g_fotoperiodo_ativo = false; 
 
 // Controle de Fotoperíodo (Cota Diária de Luz)
 volatile uint32_t g_meta_luz_segundos = 14 * 3600; // Ex: 14 horas de luz
-volatile uint32_t g_segundos_de_luz_hoje = 0;
+volatile uint32_t g_segundos_de_luz_hoje = 0; // Segundos equivalentes de luz plena no dia
 static uint32_t g_contador_1s = 0; // Auxiliar para contar segundos dentro do timer de 100ms
+static volatile uint64_t g_segundo_us = 0; // time_us_64() do tick que fechou o último segundo
+
+// Identificação da estufa nos quadros (derivada do ID único da flash, fixa por placa)
+uint32_t g_id_dispositivo = 0;
+
+// Ciclo de trabalho aplicado a cada atuador, em ‰ (escrito só por tarefa_controle)
+typedef enum { ATUADOR_VENTILADOR, ATUADOR_BOMBA, ATUADOR_LED, ATUADOR_TOTAL } atuador_id_t;
+volatile uint16_t g_duty_permil[ATUADOR_TOTAL];
+
+// Caixa de mensagem sem trava: quem processa comandos pede, o timer (núcleo 0) aplica.
+// Evita corrida de leitura-modificação-escrita com o incremento do contador de luz.
+volatile bool g_pedido_reset_luz = false;
+
+// --- Conversão para Unidades Físicas (Ponto Fixo) ---
+// Interpolação linear entre pontos de tabelas_conversao.h: uma multiplicação
+// inteira por amostra, em vez de log/exp em float emulado.
+#define TEMP_SETPOINT_MIN_CC (-1000)
+#define TEMP_SETPOINT_MAX_CC 8000
+#define UMIDADE_MAX_CP 10000
+
+/**
+ * @brief Interpola uma tabela de conversão no valor do ADC (0-4095).
+ * Devolve TEMP_CC_INVALIDA se o trecho encosta num ponto inválido.
+ */
+static int32_t conv_interpola(const int16_t *tab, uint16_t adc) {
+    uint32_t i = adc >> CONV_PASSO_BITS;
+    int32_t frac = adc & ((1u << CONV_PASSO_BITS) - 1);
+    int32_t a = tab[i];
+    if (frac == 0) return a;
+    int32_t b = tab[i + 1];
+    if (a == TEMP_CC_INVALIDA || b == TEMP_CC_INVALIDA) return TEMP_CC_INVALIDA;
+    return a + (((b - a) * frac) >> CONV_PASSO_BITS);
+}
+
+/**
+ * @brief Temperatura do NTC em centésimos de °C (TEMP_CC_INVALIDA fora de -10 a 80 °C).
+ */
+int16_t temp_cc_de_adc(uint16_t adc) {
+    return (int16_t)conv_interpola(g_tab_temp_cc, adc > 4095 ? 4095 : adc);
+}
+
+/**
+ * @brief Umidade do sensor capacitivo em centésimos de % (0-10000).
+ */
+uint16_t umidade_cp_de_adc(uint16_t adc) {
+    return (uint16_t)conv_interpola(g_tab_umidade_cp, adc > 4095 ? 4095 : adc); // Tabela sem pontos inválidos
+}
+
+// --- Eventos (ISRs postam, loops consomem) ---
+// Um byte por evento: escrita atômica mesmo entre núcleos, sem trava.
+// Após postar, __sev() acorda qualquer núcleo parado em __wfe().
+typedef enum {
+    EVT_CONTROLE,         // Nova amostra filtrada ou setpoint alterado (reavaliar atuadores)
+    EVT_SEGUNDO_CONTROLE, // Tick de 1 s para o núcleo de controle (watchdog)
+    EVT_COMANDO,          // Linha/quadro publicado na fila de RX
+    EVT_LOTE,             // Lote de alta taxa completo
+    EVT_SEGUNDO_IO,       // Tick de 1 s para o núcleo de E/S (telemetria padrão)
+    EVT_TX_VAZIA,         // Fila de TX esvaziou (troca de baud pendente, backlog)
+    EVT_SEGUNDO_LOG,      // Tick de 1 s para o log em flash (núcleo 0)
+    EVT_SEGUNDO_CONFIG,   // Tick de 1 s para a configuração persistente (núcleo 0)
+    EVT_TOTAL
+} evento_t;
+
+static volatile bool g_eventos[EVT_TOTAL];
+
+static inline void evento_posta(evento_t e) {
+    g_eventos[e] = true;
+    __sev();
+}
+
+/**
+ * @brief Consome o evento se estiver pendente.
+ * Limpa antes do trabalho: um novo post durante o tratamento não se perde.
+ */
+static inline bool evento_consome(evento_t e) {
+    if (!g_eventos[e]) return false;
+    g_eventos[e] = false;
+    return true;
+}
+
+// --- Instrumentação (Ciclos de CPU e Histogramas) ---
+// Cada trecho crítico mede a própria duração com o SysTick do núcleo em que roda
+// (contador decrescente de 24 bits no clock do sistema: ~134ms antes de dar a volta).
+// Cada seção tem um único escritor; a leitura para o GET,STATS é só diagnóstico.
+#define PERF_BALDES 24 // Balde 0 = valor 0; balde k = [2^(k-1), 2^k)
+
+typedef enum {
+    SECAO_TIMER,        // timer_callback (ciclos)
+    SECAO_UART_RX,      // on_uart_rx (ciclos)
+    SECAO_COMANDO,      // processa_comando (ciclos)
+    SECAO_TELEMETRIA,   // Montagem + enfileiramento da telemetria (ciclos)
+    SECAO_ADC_DMA,      // on_adc_dma (ciclos)
+    SECAO_JITTER_TIMER, // |período real - 100ms| do timer de amostragem (us)
+    SECAO_TOTAL
+} perf_secao_id_t;
+
+#define PERF_UNIDADE_CICLOS 0
+#define PERF_UNIDADE_US 1
 
-// --- Buffer de Comunicação UART ---
+typedef struct {
+    uint32_t contagem;
+    uint32_t min, max;
+    uint64_t soma;
+    uint16_t hist[PERF_BALDES]; // Satura em 0xFFFF
+} perf_secao_t;
+
+static volatile perf_secao_t g_perf[SECAO_TOTAL];
+
+/**
+ * @brief Liga o SysTick do núcleo chamador em contagem livre (chamar em cada núcleo).
+ */
+void perf_init_nucleo() {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; // Habilita, fonte = clock do processador, sem interrupção
+}
+
+static inline uint32_t perf_inicio() {
+    return systick_hw->cvr;
+}
+
+void perf_registra(perf_secao_id_t id, uint32_t valor) {
+    volatile perf_secao_t *p = &g_perf[id];
+    if (p->contagem == 0 || valor < p->min) p->min = valor;
+    if (valor > p->max) p->max = valor;
+    p->soma += valor;
+    p->contagem++;
+    uint32_t balde = (valor == 0) ? 0 : 32u - (uint32_t)__builtin_clz(valor);
+    if (balde >= PERF_BALDES) balde = PERF_BALDES - 1;
+    if (p->hist[balde] != 0xFFFF) p->hist[balde]++;
+}
+
+static inline void perf_fim(perf_secao_id_t id, uint32_t inicio) {
+    perf_registra(id, (inicio - systick_hw->cvr) & 0x00FFFFFF); // Contador decrescente
+}
+
+// --- Fila de Comandos (SPSC sem travas) ---
+// Produtor único: o enlace ativo (on_uart_rx na UART ou usb_rx no loop de E/S).
+// Consumidor único: loop principal.
+// Cada posição guarda uma linha completa; o produtor só escreve na posição da cabeça
+// e o loop só libera a posição da cauda, então nenhum lado precisa de trava.
+// Além das linhas ASCII, aceita quadros binários no formato 0x00 [COBS] 0x00.
 #define RX_BUFFER_SIZE 100
-volatile char g_rx_buffer[RX_BUFFER_SIZE];
-volatile int g_rx_idx = 0;
-volatile bool g_comando_pronto = false; // Flag para indicar que um comando completo chegou
+#define RX_FILA_LINHAS 8  // Potência de 2 (índices livres de overflow com máscara)
+
+typedef struct {
+    uint8_t len;                 // Bytes válidos em dados
+    bool binario;                // true = quadro COBS, false = linha ASCII ('\0' no fim)
+    char dados[RX_BUFFER_SIZE];
+} rx_linha_t;
+
+// Enlace que carrega o protocolo agora: só ele produz na fila de RX e drena a de TX
+typedef enum { ENLACE_UART, ENLACE_USB } enlace_t;
+static volatile enlace_t g_enlace = ENLACE_UART;
+
+static rx_linha_t g_rx_fila[RX_FILA_LINHAS];
+static volatile uint32_t g_rx_cabeca = 0; // Escrito apenas pelo produtor
+static volatile uint32_t g_rx_cauda = 0;  // Escrito apenas pelo loop principal
+static int g_rx_idx = 0;                  // Posição na linha em montagem (apenas produtor)
+static bool g_rx_descartando = false;     // Linha atual chegou com a fila cheia
+static bool g_rx_binario = false;         // Montando um quadro binário (após 0x00)
+volatile uint32_t g_rx_linhas_perdidas = 0;
+volatile uint32_t g_rx_comandos_rejeitados = 0; // Comandos ASCII recusados (sem ACK, só contados)
 
 /**
- * @brief Interrupção de RX da UART
- * Processa byte a byte. Detecta fim de comando por '\n' ou '\r'.
- * Garante que o loop principal não trave esperando dados.
+ * @brief Publica a linha em montagem (ou contabiliza o descarte) e reinicia o índice.
  */
-void on_uart_rx() {
-    while (uart_is_readable(UART_ID)) {
-        char c = uart_getc(UART_ID);
-        // Verifica terminadores de linha para finalizar o comando
-        if (c == '\n' || c == '\r') {
-            if (g_rx_idx > 0) { 
-                g_rx_buffer[g_rx_idx] = '\0'; // Finaliza string C
-                g_comando_pronto = true;      // Sinaliza para o main processar
-                g_rx_idx = 0;                 // Reseta índice para próximo comando
-            }
-        } else if (g_rx_idx < (RX_BUFFER_SIZE - 1)) { 
-            g_rx_buffer[g_rx_idx++] = c;      // Armazena caractere se houver espaço
-        }
+static void rx_publica(rx_linha_t *linha) {
+    if (g_rx_descartando) {
+        g_rx_linhas_perdidas++;           // Linha inteira descartada (fila cheia)
+        g_rx_descartando = false;
+    } else if (g_rx_idx > 0) {
+        linha->dados[g_rx_idx] = '\0';    // Finaliza string C
+        linha->len = (uint8_t)g_rx_idx;
+        linha->binario = g_rx_binario;
+        __dmb();                          // Conteúdo visível antes de publicar
+        g_rx_cabeca++;                    // Publica para o main processar
+        evento_posta(EVT_COMANDO);
     }
+    g_rx_idx = 0;                         // Reseta índice para próximo comando
 }
 
 /**
- * @brief Callback do Temporizador (100ms)
- * Responsável por:
- * 1. Leitura dos ADCs
- * 2. Atualização da Média Móvel (Filtro Digital)
- * 3. Contabilização do tempo de exposição à luz
+ * @brief Monta as linhas byte a byte (comum aos dois enlaces).
+ * Detecta fim de comando por '\n' ou '\r' (ASCII) ou pelo 0x00 que fecha um quadro binário.
+ * A linha é montada direto na posição livre da fila e publicada ao avançar a cabeça.
  */
-bool timer_callback(repeating_timer_t *t) {
-    // Leitura crua dos sensores
-    adc_select_input(0); uint16_t ldr_raw = adc_read();
-    adc_select_input(1); uint16_t ntc_raw = adc_read();
-    adc_select_input(2); uint16_t umidade_raw = adc_read();
-
-    // Atualização da soma móvel (subtrai o mais antigo, soma o novo)
-    ldr_sum = ldr_sum - ldr_buffer[avg_idx] + ldr_raw;
-    ntc_sum = ntc_sum - ntc_buffer[avg_idx] + ntc_raw;
-    umidade_sum = umidade_sum - umidade_buffer[avg_idx] + umidade_raw;
-
-    // Atualiza buffer circular
-    ldr_buffer[avg_idx] = ldr_raw;
-    ntc_buffer[avg_idx] = ntc_raw;
-    umidade_buffer[avg_idx] = umidade_raw;
-
-    // Calcula média (divisão por bit shift para eficiência)
-    g_ldr_filtrado = (uint16_t)(ldr_sum >> AVG_SHIFT_BITS);
-    g_ntc_filtrado = (uint16_t)(ntc_sum >> AVG_SHIFT_BITS);
-    g_umidade_filtrada = (uint16_t)(umidade_sum >> AVG_SHIFT_BITS);
-
-    avg_idx = (avg_idx + 1) % AVG_SAMPLES;
-    
-    // Lógica de Contagem de Luz (Sol + LED)
-    // O timer roda a cada 100ms -> 10 ticks = 1 segundo
-    g_contador_1s++;
-    if (g_contador_1s >= 10) { 
-        g_contador_1s = 0;
-        
-        bool led_ligado = (gpio_get(LED_PIN) == 1);
-        bool tem_sol = (g_ldr_filtrado <= g_ldr_limiar_raw); // Lógica inversa do LDR (Menor valor = Mais luz)
+static void rx_recebe(char c) {
+    rx_linha_t *linha = &g_rx_fila[g_rx_cabeca & (RX_FILA_LINHAS - 1)];
+    bool cheia = (g_rx_cabeca - g_rx_cauda) >= RX_FILA_LINHAS;
 
-        // Se houver luz artificial ou natural, incrementa contador diário
-        if (led_ligado || tem_sol) {
-            g_segundos_de_luz_hoje++;
+    if (c == 0x00) {
+        if (g_rx_binario && (g_rx_idx > 0 || g_rx_descartando)) {
+            rx_publica(linha);            // 0x00 final: quadro completo
+            g_rx_binario = false;
+        } else {
+            g_rx_binario = true;          // 0x00 inicial: descarta texto parcial
+            g_rx_idx = 0;
         }
+    } else if (!g_rx_binario && (c == '\n' || c == '\r')) {
+        // Verifica terminadores de linha para finalizar o comando
+        rx_publica(linha);
+    } else if (cheia || g_rx_descartando) {
+        g_rx_descartando = true;          // Não sobrescreve linha ainda não lida
+    } else if (g_rx_idx < (RX_BUFFER_SIZE - 1)) {
+        linha->dados[g_rx_idx++] = c;     // Armazena caractere se houver espaço
+    } else if (g_rx_binario) {
+        g_rx_descartando = true;          // Quadro truncado falharia no CRC
     }
-    return true; // Mantém o timer repetindo
 }
 
 /**
- * @brief Interpretador de Comandos
- * Formato esperado: "COMANDO,TIPO,VALOR"
+ * @brief Interrupção de RX da UART (habilitada só com a UART como enlace ativo)
+ * Esvazia o FIFO sem travar o loop principal esperando dados.
  */
-void processa_comando() {
-    g_comando_pronto = false; 
-    char* valor_str;
-    
-    // Parseia string recebida e atualiza variáveis de controle
-    if (strstr((const char*)g_rx_buffer, "SET,HUMID,") != NULL) {
-        valor_str = strrchr((const char*)g_rx_buffer, ',');
-        if (valor_str) g_umidade_setpoint_raw = (uint16_t)atoi(valor_str + 1);
+void on_uart_rx() {
+    uint32_t t0 = perf_inicio();
+    while (uart_is_readable(UART_ID)) {
+        rx_recebe(uart_getc(UART_ID));
+    }
+    perf_fim(SECAO_UART_RX, t0);
+}
+
+/**
+ * @brief Retorna a linha mais antiga da fila, ou NULL se vazia.
+ * A posição continua reservada até fila_rx_libera().
+ */
+const rx_linha_t* fila_rx_frente() {
+    if (g_rx_cauda == g_rx_cabeca) return NULL;
+    __dmb(); // Lê o conteúdo só depois de observar a cabeça
+    return &g_rx_fila[g_rx_cauda & (RX_FILA_LINHAS - 1)];
+}
+
+/**
+ * @brief Devolve a posição da linha já processada para a ISR.
+ */
+void fila_rx_libera() {
+    __dmb(); // Termina de ler a linha antes de liberá-la
+    g_rx_cauda++;
+}
+
+// --- Fila de Transmissão (DMA para a UART ou FIFO do CDC) ---
+// Quadros são copiados para um buffer circular e o DMA os entrega à UART
+// (ou, com a USB ativa, usb_tx_drena os copia para a FIFO do CDC).
+// O loop nunca espera a transmissão: se não houver espaço, o quadro é descartado.
+#define TX_FILA_BYTES 1024             // Potência de 2
+#define TX_LIMIAR_PRESSAO (TX_FILA_BYTES * 3 / 4) // Ocupação que sinaliza contrapressão
+static uint8_t g_tx_fila[TX_FILA_BYTES];
+static volatile uint32_t g_tx_cabeca = 0; // Avançado por quem enfileira
+static volatile uint32_t g_tx_cauda = 0;  // Avançado pela ISR do DMA
+static volatile uint32_t g_tx_em_voo = 0; // Bytes da transferência DMA em andamento
+static uint dma_tx_ch;
+
+// Contadores da fila de transmissão (consultáveis pelo firmware)
+typedef struct {
+    uint32_t quadros_enfileirados;
+    uint32_t quadros_descartados;  // Fila sem espaço para o quadro inteiro
+    uint32_t bytes_enfileirados;
+    uint32_t eventos_pressao;      // Enfileiramentos acima de TX_LIMIAR_PRESSAO
+    uint32_t pico_ocupacao;        // Maior ocupação observada (bytes)
+} tx_stats_t;
+volatile tx_stats_t g_tx_stats;
+
+/**
+ * @brief Dispara o DMA com o trecho contíguo pendente (chamar com IRQs mascaradas).
+ */
+static void tx_inicia_dma() {
+    if (g_enlace != ENLACE_UART || g_tx_em_voo != 0 || g_tx_cauda == g_tx_cabeca) return;
+    uint32_t inicio = g_tx_cauda & (TX_FILA_BYTES - 1);
+    uint32_t pendente = g_tx_cabeca - g_tx_cauda;
+    uint32_t ate_fim = TX_FILA_BYTES - inicio; // Não atravessa o fim do buffer
+    g_tx_em_voo = (pendente < ate_fim) ? pendente : ate_fim;
+    dma_channel_transfer_from_buffer_now(dma_tx_ch, &g_tx_fila[inicio], g_tx_em_voo);
+}
+
+/**
+ * @brief Interrupção de fim de transferência do DMA de TX
+ * Libera os bytes enviados e encadeia o próximo trecho da fila.
+ */
+void on_tx_dma() {
+    dma_channel_acknowledge_irq1(dma_tx_ch);
+    g_tx_cauda += g_tx_em_voo;
+    g_tx_em_voo = 0;
+    tx_inicia_dma();
+    if (g_tx_cauda == g_tx_cabeca) evento_posta(EVT_TX_VAZIA);
+}
+
+/**
+ * @brief Configura o canal DMA que alimenta o FIFO de TX da UART.
+ */
+void tx_dma_init() {
+    dma_tx_ch = (uint)dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(dma_tx_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(UART_ID, true));
+    dma_channel_configure(dma_tx_ch, &c, &uart_get_hw(UART_ID)->dr, g_tx_fila, 0, false);
+    dma_channel_set_irq1_enabled(dma_tx_ch, true);
+
+    irq_set_exclusive_handler(DMA_IRQ_1, on_tx_dma);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+/**
+ * @brief Espaço livre na fila de TX (bytes).
+ */
+uint32_t tx_fila_livre() {
+    return TX_FILA_BYTES - (g_tx_cabeca - g_tx_cauda);
+}
+
+/**
+ * @brief Enfileira um quadro completo para transmissão e retorna imediatamente.
+ * @return false se o quadro foi descartado por falta de espaço.
+ */
+bool tx_enfileira(const uint8_t *dados, uint32_t len) {
+    if (len > tx_fila_livre()) {
+        g_tx_stats.quadros_descartados++;
+        return false;
     }
-    else if (strstr((const char*)g_rx_buffer, "SET,TEMP,") != NULL) {
-        valor_str = strrchr((const char*)g_rx_buffer, ',');
-        if (valor_str) g_temp_setpoint_raw = (uint16_t)atoi(valor_str + 1);
+    // Copia com wrap; apenas este lado escreve na região livre
+    uint32_t cabeca = g_tx_cabeca;
+    for (uint32_t i = 0; i < len; i++) {
+        g_tx_fila[(cabeca + i) & (TX_FILA_BYTES - 1)] = dados[i];
     }
-    else if (strstr((const char*)g_rx_buffer, "SET,LDR,") != NULL) {
-        valor_str = strrchr((const char*)g_rx_buffer, ',');
-        if (valor_str) g_ldr_limiar_raw = (uint16_t)atoi(valor_str + 1);
+
+    uint32_t irq = save_and_disable_interrupts();
+    g_tx_cabeca = cabeca + len;
+    tx_inicia_dma();
+    restore_interrupts(irq);
+
+    uint32_t ocupacao = g_tx_cabeca - g_tx_cauda;
+    g_tx_stats.quadros_enfileirados++;
+    g_tx_stats.bytes_enfileirados += len;
+    if (ocupacao > g_tx_stats.pico_ocupacao) g_tx_stats.pico_ocupacao = ocupacao;
+    if (ocupacao > TX_LIMIAR_PRESSAO) g_tx_stats.eventos_pressao++;
+    return true;
+}
+
+#if TRANSPORTE_USB
+// --- Enlace USB (CDC) ---
+// A pilha TinyUSB roda no núcleo de E/S: tud_task() no loop (a IRQ da USB só acorda
+// o WFE) e os callbacks abaixo são chamados de dentro dela. O host escolhe o enlace:
+// abrir a porta CDC (DTR) passa o protocolo para a USB; fechá-la devolve à UART.
+#define USB_EP_NOTIF 0x81
+#define USB_EP_SAIDA 0x02
+#define USB_EP_ENTRADA 0x82
+#define USB_TAM_CONFIG (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+enum { USB_ITF_CDC = 0, USB_ITF_CDC_DADOS, USB_ITF_TOTAL };
+enum { USB_STR_IDIOMA = 0, USB_STR_FABRICANTE, USB_STR_PRODUTO, USB_STR_SERIAL, USB_STR_CDC };
+
+static const tusb_desc_device_t g_usb_desc_dispositivo = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    .bDeviceClass = TUSB_CLASS_MISC,       // CDC com IAD
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = USB_STR_FABRICANTE,
+    .iProduct = USB_STR_PRODUTO,
+    .iSerialNumber = USB_STR_SERIAL,
+    .bNumConfigurations = 1
+};
+
+static const uint8_t g_usb_desc_config[] = {
+    TUD_CONFIG_DESCRIPTOR(1, USB_ITF_TOTAL, 0, USB_TAM_CONFIG, 0, 100),
+    TUD_CDC_DESCRIPTOR(USB_ITF_CDC, USB_STR_CDC, USB_EP_NOTIF, 8, USB_EP_SAIDA, USB_EP_ENTRADA, CFG_TUD_CDC_EP_BUFSIZE),
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&g_usb_desc_dispositivo;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t indice) {
+    (void)indice;
+    return g_usb_desc_config;
+}
+
+/**
+ * @brief Descritores de string em UTF-16. O número de série é o ID do dispositivo
+ * em hexadecimal, o mesmo que a telemetria leva: o host associa porta e estufa
+ * antes do primeiro quadro.
+ */
+const uint16_t *tud_descriptor_string_cb(uint8_t indice, uint16_t idioma) {
+    static uint16_t desc[24];
+    char serial[9];
+    const char *str;
+    (void)idioma;
+
+    switch (indice) {
+    case USB_STR_IDIOMA:
+        desc[1] = 0x0409; // Inglês (EUA)
+        desc[0] = (uint16_t)((TUSB_DESC_STRING << 8) | 4);
+        return desc;
+    case USB_STR_FABRICANTE: str = "Raspberry Pi"; break;
+    case USB_STR_PRODUTO: str = "Estufa Inteligente"; break;
+    case USB_STR_SERIAL:
+        for (int i = 0; i < 8; i++) serial[i] = "0123456789ABCDEF"[(g_id_dispositivo >> (28 - 4 * i)) & 0xF];
+        serial[8] = '\0';
+        str = serial;
+        break;
+    case USB_STR_CDC: str = "Estufa CDC"; break;
+    default: return NULL;
     }
-    else if (strstr((const char*)g_rx_buffer, "SET,FOTO,") != NULL) {
-        valor_str = strrchr((const char*)g_rx_buffer, ',');
-        if (valor_str) g_fotoperiodo_ativo = ((uint16_t)atoi(valor_str + 1) == 1);
+
+    uint8_t n = 0;
+    while (str[n] && n < 23) { desc[1 + n] = (uint8_t)str[n]; n++; }
+    desc[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * n + 2));
+    return desc;
+}
+
+/**
+ * @brief Troca o enlace ativo. Roda no núcleo de E/S (dentro de tud_task), onde
+ * também está a IRQ da UART, então mascará-la basta para trocar o produtor da fila de RX.
+ */
+static void enlace_seleciona(enlace_t e) {
+    if (e == g_enlace) return;
+    uart_set_irq_enables(UART_ID, false, false);
+    g_enlace = e;
+    g_rx_idx = 0;                 // Linha parcial do enlace anterior é descartada
+    g_rx_descartando = false;
+    g_rx_binario = false;
+    if (e == ENLACE_UART) {
+        uart_set_irq_enables(UART_ID, true, false);
+        uint32_t irq = save_and_disable_interrupts();
+        tx_inicia_dma();          // O que ficou na fila sai pela UART
+        restore_interrupts(irq);
     }
-    else if (strstr((const char*)g_rx_buffer, "SET,META_LUZ,") != NULL) {
-        valor_str = strrchr((const char*)g_rx_buffer, ',');
-        if (valor_str) g_meta_luz_segundos = (uint32_t)atol(valor_str + 1);
+}
+
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
+    (void)itf; (void)rts;
+    enlace_seleciona(dtr ? ENLACE_USB : ENLACE_UART);
+}
+
+void tud_umount_cb(void) {
+    enlace_seleciona(ENLACE_UART);
+}
+
+void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *codificacao) {
+    (void)itf;
+    if (codificacao->bit_rate == USB_BAUD_BOOTSEL) reset_usb_boot(0, 0); // picotool / IDE sem BOOTSEL
+}
+
+/**
+ * @brief Lê a FIFO de RX do CDC para a fila de comandos.
+ * Com a fila cheia deixa os bytes na FIFO: a USB segura o host (NAK) em vez de perder linhas.
+ */
+static void usb_rx() {
+    uint8_t buf[CFG_TUD_CDC_EP_BUFSIZE];
+    if (g_enlace != ENLACE_USB) return;
+    while ((g_rx_cabeca - g_rx_cauda) < RX_FILA_LINHAS) {
+        uint32_t n = tud_cdc_read(buf, sizeof(buf));
+        if (n == 0) break;
+        for (uint32_t i = 0; i < n; i++) rx_recebe((char)buf[i]);
     }
-    else if (strstr((const char*)g_rx_buffer, "RESET,TIMER_LUZ") != NULL) {
-        g_segundos_de_luz_hoje = 0;
+}
+
+/**
+ * @brief Copia a fila de TX para a FIFO do CDC e agenda o envio.
+ * Um trecho ainda no DMA da UART (troca de enlace no meio) termina antes.
+ */
+static void usb_tx_drena() {
+    if (g_enlace != ENLACE_USB || g_tx_em_voo != 0) return;
+    uint32_t enviados = 0;
+    while (g_tx_cauda != g_tx_cabeca) {
+        uint32_t inicio = g_tx_cauda & (TX_FILA_BYTES - 1);
+        uint32_t pendente = g_tx_cabeca - g_tx_cauda;
+        uint32_t ate_fim = TX_FILA_BYTES - inicio; // Não atravessa o fim do buffer
+        uint32_t n = tud_cdc_write(&g_tx_fila[inicio], (pendente < ate_fim) ? pendente : ate_fim);
+        if (n == 0) break; // FIFO do CDC cheia: segue quando o host ler
+        g_tx_cauda += n;
+        enviados += n;
     }
-    // Limpa buffer para evitar lixo de memória
-    memset((void*)g_rx_buffer, 0, RX_BUFFER_SIZE);
+    if (enviados == 0) return;
+    tud_cdc_write_flush();
+    if (g_tx_cauda == g_tx_cabeca) evento_posta(EVT_TX_VAZIA);
 }
 
-// --- MAIN ---
-int main() {
-    // 1. Inicialização de Periféricos
-    stdio_init_all(); 
-    adc_init();
-    adc_gpio_init(PIN_ADC_0_LDR); adc_gpio_init(PIN_ADC_1_NTC); adc_gpio_init(PIN_ADC_2_UMIDADE);
-    
-    // Configuração dos GPIOs de atuadores
-    gpio_init(FAN_PIN); gpio_set_dir(FAN_PIN, GPIO_OUT); gpio_put(FAN_PIN, 0); 
-    gpio_init(PUMP_PIN); gpio_set_dir(PUMP_PIN, GPIO_OUT); gpio_put(PUMP_PIN, 0);
-    gpio_init(LED_PIN); gpio_set_dir(LED_PIN, GPIO_OUT); gpio_put(LED_PIN, 0); 
+/**
+ * @brief Há trabalho da USB para o loop de E/S (eventos da pilha, RX ou TX pendentes).
+ */
+static bool usb_pendente() {
+    if (tud_task_event_ready()) return true;
+    if (g_enlace != ENLACE_USB) return false;
+    bool rx = tud_cdc_available() > 0 && (g_rx_cabeca - g_rx_cauda) < RX_FILA_LINHAS;
+    bool tx = g_tx_cauda != g_tx_cabeca && g_tx_em_voo == 0 && tud_cdc_write_available() > 0;
+    return rx || tx;
+}
+#endif
 
-    // 2. Configuração da UART e Interrupções
-    uart_init(UART_ID, BAUD_RATE);
-    gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
-    gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
-    
-    // Habilita interrupção de RX para não travar a CPU esperando dados
-    irq_set_exclusive_handler(UART0_IRQ, on_uart_rx);
-    irq_set_enabled(UART0_IRQ, true);
-    uart_set_irq_enables(UART_ID, true, false);
-    
-    // Watchdog de 2 segundos para reinício automático em caso de travamento
-    watchdog_enable(2000, 1);
+// --- Protocolo Binário (COBS + CRC16) ---
+// Carga útil: [versão][tipo][seq u16][dados...][CRC16 u16], tudo Big Endian.
+// A carga é codificada em COBS (sem bytes 0x00) e cada quadro termina em 0x00,
+// então o host ressincroniza no próximo delimitador sem varrer o fluxo.
+#define PROTO_VERSAO 1
+#define PROTO_TIPO_TELEMETRIA 0x01 // Estado filtrado (1 s)
+#define PROTO_TIPO_LOTE 0x02       // N amostras de alta taxa
+#define PROTO_TIPO_ACK 0x03        // Confirmação de comando binário
+#define PROTO_CABECALHO 4          // versão + tipo + seq
+#define PROTO_MAX_DADOS 240
+#define PROTO_MAX_CARGA (PROTO_CABECALHO + PROTO_MAX_DADOS + 2)
+#define PROTO_MAX_QUADRO (PROTO_MAX_CARGA + PROTO_MAX_CARGA / 254 + 2) // Overhead COBS + delimitador
 
-    // Inicialização de variáveis e buffers
-    uint8_t packet[13];
-    memset(ldr_buffer, 0, sizeof(ldr_buffer));
-    memset(ntc_buffer, 0, sizeof(ntc_buffer));
-    memset(umidade_buffer, 0, sizeof(umidade_buffer));
+static uint16_t g_proto_seq = 0; // Incrementa a cada quadro gerado (lacunas = perdas)
 
-    // Inicializa timer recorrente (100ms) para leitura de sensores
-    repeating_timer_t timer;
-    add_repeating_timer_ms(-TIMER_ISR_INTERVAL_MS, timer_callback, NULL, &timer);
+// CRC-16/CCITT-FALSE (polinômio 0x1021, valor inicial 0xFFFF)
+static const uint16_t crc16_tabela[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
 
-    uint32_t ultimo_envio = 0;
+uint16_t crc16(const uint8_t *dados, uint32_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 8) ^ crc16_tabela[((crc >> 8) ^ dados[i]) & 0xFF]);
+    }
+    return crc;
+}
 
-    // --- Loop Principal (Super Loop) ---
-    while (1) {
-        // 1. Processamento de Comandos (Prioridade)
-        if (g_comando_pronto) processa_comando();
-        
-        // 2. Lógica de Controle (Atuadores)
-        // Baseado nos valores filtrados atualizados pelo Timer
-        if (g_umidade_filtrada > g_umidade_setpoint_raw) gpio_put(PUMP_PIN, 1); else gpio_put(PUMP_PIN, 0);
-        if (g_ntc_filtrado < g_temp_setpoint_raw) gpio_put(FAN_PIN, 1); else gpio_put(FAN_PIN, 0);
-
-        // Lógica Complementar de Luz:
-        // Se o fotoperíodo está ativo e a meta diária não foi atingida:
-        // Liga o LED apenas se a luz natural for insuficiente.
-        if (g_fotoperiodo_ativo && (g_segundos_de_luz_hoje < g_meta_luz_segundos)) {
-            if (g_ldr_filtrado > g_ldr_limiar_raw) gpio_put(LED_PIN, 1); 
-            else gpio_put(LED_PIN, 0); 
+/**
+ * @brief Codifica em COBS (Consistent Overhead Byte Stuffing).
+ * @return Tamanho codificado (sem o delimitador final).
+ */
+uint32_t cobs_codifica(const uint8_t *entrada, uint32_t len, uint8_t *saida) {
+    uint32_t pos_codigo = 0, k = 1;
+    uint8_t codigo = 1;
+    for (uint32_t i = 0; i < len; i++) {
+        if (entrada[i] == 0) {
+            saida[pos_codigo] = codigo;
+            pos_codigo = k++;
+            codigo = 1;
         } else {
-            gpio_put(LED_PIN, 0); // Desliga se meta atingida ou fotoperíodo desativado
+            saida[k++] = entrada[i];
+            if (++codigo == 0xFF) { // Bloco máximo de 254 bytes sem zero
+                saida[pos_codigo] = codigo;
+                pos_codigo = k++;
+                codigo = 1;
+            }
         }
+    }
+    saida[pos_codigo] = codigo;
+    return k;
+}
+
+/**
+ * @brief Decodifica COBS (sem o delimitador).
+ * @return Tamanho decodificado, ou -1 se malformado ou maior que max.
+ */
+int cobs_decodifica(const uint8_t *entrada, uint32_t len, uint8_t *saida, uint32_t max) {
+    uint32_t i = 0, k = 0;
+    while (i < len) {
+        uint8_t codigo = entrada[i++];
+        if (codigo == 0 || i + codigo - 1 > len || k + codigo > max) return -1;
+        for (uint8_t j = 1; j < codigo; j++) saida[k++] = entrada[i++];
+        if (codigo < 0xFF && i < len) saida[k++] = 0x00;
+    }
+    return (int)k;
+}
+
+/**
+ * @brief Monta a carga (versão, tipo, seq, CRC), codifica em COBS e enfileira.
+ * @return false se o quadro foi descartado pela fila de TX.
+ */
+bool proto_envia(uint8_t tipo, const uint8_t *dados, uint32_t len) {
+    uint8_t carga[PROTO_MAX_CARGA];
+    uint8_t quadro[PROTO_MAX_QUADRO];
+    if (len > PROTO_MAX_DADOS) return false;
+
+    uint16_t seq = g_proto_seq++;
+    carga[0] = PROTO_VERSAO;
+    carga[1] = tipo;
+    carga[2] = (seq >> 8) & 0xFF;
+    carga[3] = seq & 0xFF;
+    memcpy(&carga[PROTO_CABECALHO], dados, len);
+    uint32_t n = PROTO_CABECALHO + len;
+    uint16_t crc = crc16(carga, n);
+    carga[n++] = (crc >> 8) & 0xFF;
+    carga[n++] = crc & 0xFF;
+
+    uint32_t k = cobs_codifica(carga, n, quadro);
+    quadro[k++] = 0x00; // Delimitador de quadro
+    return tx_enfileira(quadro, k);
+}
 
-        // 3. Telemetria (Envio Não-Bloqueante)
-        // Envia estado atual a cada 1 segundo sem usar sleep() longo
-        uint32_t agora = to_ms_since_boot(get_absolute_time());
-        if (agora - ultimo_envio >= 1000) {
-            ultimo_envio = agora;
-
-            // Montagem do pacote de dados (Big Endian)
-            // Divide uint16_t/uint32_t em bytes individuais para transporte serial
-            packet[0] = (g_ldr_filtrado >> 8) & 0xFF;
-            packet[1] = g_ldr_filtrado & 0xFF;
-            packet[2] = (g_ntc_filtrado >> 8) & 0xFF;
-            packet[3] = g_ntc_filtrado & 0xFF;
-            packet[4] = (g_umidade_filtrada >> 8) & 0xFF;
-            packet[5] = g_umidade_filtrada & 0xFF;
-            packet[6] = gpio_get(LED_PIN) ? 1 : 0;
-            // Tempo de luz (32 bits = 4 bytes)
-            packet[7] = (g_segundos_de_luz_hoje >> 24) & 0xFF;
-            packet[8] = (g_segundos_de_luz_hoje >> 16) & 0xFF;
-            packet[9] = (g_segundos_de_luz_hoje >> 8) & 0xFF;
-            packet[10] = g_segundos_de_luz_hoje & 0xFF;
-
-            // Checksum simples (soma de verificação) para integridade
-            uint8_t soma = 0;
-            for(int i=0; i<11; i++) soma += packet[i];
-            packet[11] = soma;
-            packet[12] = 0xAA; // Byte finalizador de pacote
-
-            uart_write_blocking(UART_ID, packet, 13);
-            
-            // "Chuta" o watchdog indicando que o sistema está vivo
-            watchdog_update();
+#if ADC_MODO_DMA
+/**
+ * @brief Interrupção de fim de bloco do DMA do ADC
+ * O canal de controle já redirecionou o DMA para a outra metade: a ISR só soma,
+ * por canal, o bloco que não está sendo escrito.
+ */
+void on_adc_dma() {
+    uint32_t t0 = perf_inicio();
+    if (dma_channel_get_irq0_status(dma_adc_ch)) {
+        dma_channel_acknowledge_irq0(dma_adc_ch);
+        uintptr_t escrita = (uintptr_t)dma_channel_hw_addr(dma_adc_ch)->write_addr;
+        int b = (escrita - (uintptr_t)adc_blocos[1] < sizeof(adc_blocos[1])) ? 0 : 1;
+
+        // Amostras intercaladas: [LDR, NTC, UMIDADE, LDR, NTC, UMIDADE, ...]
+        const uint16_t *bloco = adc_blocos[b];
+        uint32_t s0 = 0, s1 = 0, s2 = 0;
+        for (int i = 0; i < ADC_BLOCO_AMOSTRAS; i += ADC_NUM_CANAIS) {
+            s0 += bloco[i];
+            s1 += bloco[i + 1];
+            s2 += bloco[i + 2];
         }
-        
-        // Pequeno delay para aliviar a CPU, mas mantendo responsividade
-        sleep_ms(1); 
+        adc_acc_soma[0] += s0;
+        adc_acc_soma[1] += s1;
+        adc_acc_soma[2] += s2;
+        adc_acc_blocos++;
+
+        g_adc_ultimo[0] = (uint16_t)(s0 >> ADC_BLOCO_SHIFT);
+        g_adc_ultimo[1] = (uint16_t)(s1 >> ADC_BLOCO_SHIFT);
+        g_adc_ultimo[2] = (uint16_t)(s2 >> ADC_BLOCO_SHIFT);
+    }
+    perf_fim(SECAO_ADC_DMA, t0);
+}
+
+/**
+ * @brief Dispara a aquisição a partir do bloco 0 (o canal de controle arma o de dados).
+ */
+void adc_dma_arma() {
+    adc_select_input(0); // Round-robin começa sempre pelo LDR
+    adc_fifo_drain();
+    dma_channel_set_read_addr(dma_adc_controle_ch, adc_enderecos, true);
+    adc_run(true);
+}
+
+/**
+ * @brief Para o ADC e os canais DMA dele (antes de uma operação na flash).
+ * O flash_safe_execute deixa as IRQs do núcleo 0 desligadas por dezenas de ms e
+ * ninguém reduziria os blocos: parado, o DMA não sobrescreve nada. Rearme com adc_dma_arma().
+ */
+void adc_dma_pausa() {
+    adc_run(false);
+    dma_channel_set_irq0_enabled(dma_adc_ch, false); // O abort pode gerar um fim de bloco espúrio (RP2040-E13)
+    dma_channel_abort(dma_adc_controle_ch);          // Primeiro o controle, que redispararia o de dados
+    dma_channel_abort(dma_adc_ch);
+    dma_channel_acknowledge_irq0(dma_adc_ch);
+    dma_channel_set_irq0_enabled(dma_adc_ch, true);
+}
+
+/**
+ * @brief Configura o ADC em round-robin livre, o canal DMA de dados e o de controle.
+ */
+void adc_dma_init() {
+    adc_set_round_robin(0x07);    // ADC0, ADC1, ADC2
+    adc_fifo_setup(true, true, 1, false, false); // FIFO + DREQ a cada amostra, 12 bits sem deslocamento
+    adc_set_clkdiv(ADC_CLOCK_HZ / (ADC_TAXA_POR_CANAL_HZ * ADC_NUM_CANAIS) - 1.0f);
+
+    dma_adc_ch = (uint)dma_claim_unused_channel(true);
+    dma_adc_controle_ch = (uint)dma_claim_unused_channel(true);
+
+    dma_channel_config c = dma_channel_get_default_config(dma_adc_ch);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, DREQ_ADC);
+    channel_config_set_chain_to(&c, dma_adc_controle_ch); // Fim do bloco -> controle aponta a outra metade
+    dma_channel_configure(dma_adc_ch, &c, adc_blocos[0], &adc_hw->fifo, ADC_BLOCO_AMOSTRAS, false);
+    dma_channel_set_irq0_enabled(dma_adc_ch, true);
+
+    // Controle: um endereço por disparo, lido em anel (os dois ponteiros), escrito no gatilho do de dados
+    dma_channel_config k = dma_channel_get_default_config(dma_adc_controle_ch);
+    channel_config_set_transfer_data_size(&k, DMA_SIZE_32);
+    channel_config_set_read_increment(&k, true);
+    channel_config_set_write_increment(&k, false);
+    channel_config_set_ring(&k, false, __builtin_ctz(sizeof(adc_enderecos)));
+    dma_channel_configure(dma_adc_controle_ch, &k, &dma_channel_hw_addr(dma_adc_ch)->al2_write_addr_trig,
+                          adc_enderecos, 1, false);
+
+    irq_set_exclusive_handler(DMA_IRQ_0, on_adc_dma);
+    irq_set_enabled(DMA_IRQ_0, true);
+    adc_dma_arma();
+}
+
+/**
+ * @brief Coleta a média das conversões acumuladas desde a chamada anterior.
+ * A seção crítica é curta: apenas copia e zera os acumuladores.
+ */
+void adc_dma_coleta(uint16_t *bruto) {
+    uint32_t irq = save_and_disable_interrupts();
+    uint32_t s0 = adc_acc_soma[0], s1 = adc_acc_soma[1], s2 = adc_acc_soma[2];
+    uint32_t blocos = adc_acc_blocos;
+    adc_acc_soma[0] = adc_acc_soma[1] = adc_acc_soma[2] = 0;
+    adc_acc_blocos = 0;
+    restore_interrupts(irq);
+
+    if (blocos > 0) {
+        uint32_t n = blocos << ADC_BLOCO_SHIFT;
+        adc_ultima_media[0] = (uint16_t)(s0 / n);
+        adc_ultima_media[1] = (uint16_t)(s1 / n);
+        adc_ultima_media[2] = (uint16_t)(s2 / n);
+    }
+    for (int c = 0; c < ADC_NUM_CANAIS; c++) bruto[c] = adc_ultima_media[c];
+}
+#endif
+
+// --- Motor de Filtros (Multicanal, Configurado em Compilação) ---
+// Cada canal escolhe seu núcleo em g_filtro_config. O estado fica em estrutura de
+// vetores (cada posição guarda os N canais lado a lado) e filtro_processa()
+// percorre todos os canais numa única passada por amostra. Para adicionar um
+// sensor ou trocar o filtro basta mexer na tabela, não no timer.
+// Junto com a saída, cada canal mantém a variância móvel da entrada em torno dela
+// (EMA de mesma constante de tempo): é o nível de ruído que o detector de anomalias usa.
+typedef enum {
+    FILTRO_MEDIA_MOVEL, // Média das últimas 2^param amostras (soma móvel)
+    FILTRO_EMA,         // Média exponencial: y += (x - y) / 2^param
+    FILTRO_MEDIANA5,    // Mediana das últimas 5 amostras (rejeita picos isolados)
+    FILTRO_PASSA_BAIXA, // IIR de 2ª ordem: duas EMAs de 2^param em cascata (sem overshoot)
+} filtro_tipo_t;
+
+typedef struct {
+    filtro_tipo_t tipo;
+    uint8_t param;      // Expoente da janela / constante de tempo (1 a FILTRO_JANELA_MAX_BITS)
+    bool rejeita_picos; // Aplica a mediana de 5 antes do núcleo
+} filtro_config_t;
+
+#define FILTRO_JANELA_MAX_BITS 5
+#define FILTRO_JANELA_MAX (1 << FILTRO_JANELA_MAX_BITS)
+#define FILTRO_MEDIANA_N 5
+#define FILTRO_FRAC_BITS 8 // Bits fracionários do estado das EMAs
+#define FILTRO_DESVIO_MAX 1023 // Satura o desvio: o quadrado em ponto fixo cabe em 32 bits
+
+#if AVG_SHIFT_BITS > FILTRO_JANELA_MAX_BITS
+#error "AVG_SHIFT_BITS maior que a janela máxima do motor de filtros"
+#endif
+
+static const filtro_config_t g_filtro_config[ADC_NUM_CANAIS] = {
+    [CANAL_LDR]     = {FILTRO_MEDIA_MOVEL, AVG_SHIFT_BITS, false},
+    [CANAL_NTC]     = {FILTRO_MEDIA_MOVEL, AVG_SHIFT_BITS, false},
+    [CANAL_UMIDADE] = {FILTRO_MEDIA_MOVEL, AVG_SHIFT_BITS, false},
+};
+
+static struct {
+    uint16_t janela[FILTRO_JANELA_MAX][ADC_NUM_CANAIS];    // Média móvel
+    uint16_t historico[FILTRO_MEDIANA_N][ADC_NUM_CANAIS];  // Entrada da mediana
+    uint32_t soma[ADC_NUM_CANAIS];                         // Soma móvel por canal
+    int32_t ema[2][ADC_NUM_CANAIS];                        // Estágios das EMAs (ponto fixo)
+    int32_t var[ADC_NUM_CANAIS];                           // Variância móvel (contagens², ponto fixo)
+    uint32_t idx_janela, idx_mediana;
+    bool iniciado;
+} g_filtro;
+
+/**
+ * @brief Zera o estado; a primeira amostra preenche os filtros (sem rampa a partir de 0).
+ */
+void filtro_init() {
+    memset(&g_filtro, 0, sizeof(g_filtro));
+}
+
+static void filtro_semeia(const uint16_t *entrada) {
+    for (int c = 0; c < ADC_NUM_CANAIS; c++) {
+        for (int i = 0; i < FILTRO_JANELA_MAX; i++) g_filtro.janela[i][c] = entrada[c];
+        for (int i = 0; i < FILTRO_MEDIANA_N; i++) g_filtro.historico[i][c] = entrada[c];
+        g_filtro.soma[c] = (uint32_t)entrada[c] << g_filtro_config[c].param;
+        g_filtro.ema[0][c] = g_filtro.ema[1][c] = (int32_t)entrada[c] << FILTRO_FRAC_BITS;
+    }
+    g_filtro.iniciado = true;
+}
+
+/**
+ * @brief Mediana das últimas FILTRO_MEDIANA_N amostras de um canal (ordenação por inserção).
+ */
+static uint16_t filtro_mediana(int canal) {
+    uint16_t v[FILTRO_MEDIANA_N];
+    for (int i = 0; i < FILTRO_MEDIANA_N; i++) {
+        uint16_t x = g_filtro.historico[i][canal];
+        int j = i;
+        for (; j > 0 && v[j - 1] > x; j--) v[j] = v[j - 1];
+        v[j] = x;
+    }
+    return v[FILTRO_MEDIANA_N / 2];
+}
+
+static inline uint16_t filtro_ema_saida(int32_t estado) {
+    return (uint16_t)((estado + (1 << (FILTRO_FRAC_BITS - 1))) >> FILTRO_FRAC_BITS);
+}
+
+/**
+ * @brief Filtra uma amostra de todos os canais.
+ * @param entrada Leitura crua por canal (ADC_NUM_CANAIS valores)
+ * @param saida Valor filtrado por canal
+ */
+void filtro_processa(const uint16_t *entrada, uint16_t *saida) {
+    if (!g_filtro.iniciado) filtro_semeia(entrada);
+    uint32_t slot_mediana = g_filtro.idx_mediana;
+
+    for (int c = 0; c < ADC_NUM_CANAIS; c++) {
+        const filtro_config_t *cfg = &g_filtro_config[c];
+        uint16_t x = entrada[c];
+        g_filtro.historico[slot_mediana][c] = x;
+        if (cfg->rejeita_picos || cfg->tipo == FILTRO_MEDIANA5) x = filtro_mediana(c);
+
+        switch (cfg->tipo) {
+        case FILTRO_MEDIA_MOVEL: {
+            // Janelas de 2^param dividem FILTRO_JANELA_MAX: o índice comum serve a todas
+            uint32_t slot = g_filtro.idx_janela & ((1u << cfg->param) - 1);
+            g_filtro.soma[c] = g_filtro.soma[c] - g_filtro.janela[slot][c] + x;
+            g_filtro.janela[slot][c] = x;
+            saida[c] = (uint16_t)(g_filtro.soma[c] >> cfg->param);
+            break;
+        }
+        case FILTRO_EMA:
+        case FILTRO_PASSA_BAIXA: {
+            int32_t *e = g_filtro.ema[0];
+            e[c] += (((int32_t)x << FILTRO_FRAC_BITS) - e[c]) >> cfg->param;
+            if (cfg->tipo == FILTRO_PASSA_BAIXA) {
+                int32_t *e2 = g_filtro.ema[1];
+                e2[c] += (e[c] - e2[c]) >> cfg->param;
+                e = e2;
+            }
+            saida[c] = filtro_ema_saida(e[c]);
+            break;
+        }
+        case FILTRO_MEDIANA5:
+            saida[c] = x;
+            break;
+        }
+
+        int32_t desvio = (int32_t)x - saida[c];
+        if (desvio > FILTRO_DESVIO_MAX) desvio = FILTRO_DESVIO_MAX;
+        if (desvio < -FILTRO_DESVIO_MAX) desvio = -FILTRO_DESVIO_MAX;
+        g_filtro.var[c] += ((desvio * desvio << FILTRO_FRAC_BITS) - g_filtro.var[c]) >> cfg->param;
     }
-}
\ No newline at end of file
+    g_filtro.idx_janela = (g_filtro.idx_janela + 1) & (FILTRO_JANELA_MAX - 1);
+    g_filtro.idx_mediana = (slot_mediana + 1) % FILTRO_MEDIANA_N;
+}
+
+/**
+ * @brief Variância móvel da entrada de um canal em torno da saída filtrada.
+ * @return Contagens² do ADC com FILTRO_FRAC_BITS bits fracionários
+ */
+uint32_t filtro_variancia(int canal) {
+    return (uint32_t)g_filtro.var[canal];
+}
+
+// --- Relógio (RTC) e Dose Diária de Luz ---
+// O host acerta o RTC com SET,TIME (hora local em segundos desde 1970) e o
+// firmware vira o dia sozinho, mesmo sem host. A dose é integrada a cada amostra
+// pelo tempo real entre ticks: intensidade (‰ de luz plena) x duração.
+// O LDR também enxerga o LED, então vale o maior dos dois em vez da soma.
+#define LDR_PLENO_SOL_RAW 300 // Leitura do LDR considerada luz plena (menor = mais luz)
+#define LED_PESO_PERMIL 1000  // Intensidade do LED a 100 % de duty, relativa à luz plena
+#define DIA_SEM_RTC_S 86400   // Sem SET,TIME desde o boot: vira o dia a cada 24 h de uptime
+
+volatile bool g_relogio_valido = false; // RTC acertado desde o boot
+static int8_t g_dia_atual = -1;         // Dia do mês visto na última verificação
+static uint32_t g_dose_resto_us = 0;    // Fração de segundo ainda não contabilizada
+static uint32_t g_dia_uptime_s = 0;     // Segundos desde a última virada (ou restauração da flash)
+
+/**
+ * @brief Acerta o RTC a partir da hora local em segundos desde 1970.
+ */
+bool relogio_define(uint32_t epoch_local) {
+    time_t t = (time_t)epoch_local;
+    struct tm tm;
+    if (gmtime_r(&t, &tm) == NULL) return false;
+    datetime_t dt = {
+        .year = (int16_t)(tm.tm_year + 1900), .month = (int8_t)(tm.tm_mon + 1), .day = (int8_t)tm.tm_mday,
+        .dotw = (int8_t)tm.tm_wday, .hour = (int8_t)tm.tm_hour, .min = (int8_t)tm.tm_min, .sec = (int8_t)tm.tm_sec,
+    };
+    if (!rtc_set_datetime(&dt)) return false;
+    g_relogio_valido = true;
+    return true;
+}
+
+/**
+ * @brief Intensidade da luz no instante, em ‰ de luz plena (Sol pelo LDR ou LED pelo duty).
+ */
+static uint32_t luz_intensidade_permil() {
+    uint16_t ldr = g_ldr_filtrado, limiar = g_ldr_limiar_raw;
+    uint32_t sol;
+    if (ldr >= limiar) sol = 0; // Lógica inversa do LDR (Menor valor = Mais luz)
+    else if (ldr <= LDR_PLENO_SOL_RAW || limiar <= LDR_PLENO_SOL_RAW) sol = 1000;
+    else sol = (uint32_t)(limiar - ldr) * 1000 / (limiar - LDR_PLENO_SOL_RAW);
+    uint32_t led = (uint32_t)g_duty_permil[ATUADOR_LED] * LED_PESO_PERMIL / 1000;
+    return sol > led ? sol : led;
+}
+
+/**
+ * @brief Soma a dose de um tick ao contador do dia (resolução de 1 us).
+ */
+static void luz_integra(uint32_t dt_us) {
+    if (dt_us > 1000000) dt_us = 1000000; // Timer atrasado: não estoura a conta em 32 bits
+    g_dose_resto_us += luz_intensidade_permil() * dt_us / 1000;
+    while (g_dose_resto_us >= 1000000) {
+        g_dose_resto_us -= 1000000;
+        g_segundos_de_luz_hoje++;
+    }
+}
+
+/**
+ * @brief Começa um dia novo de dose.
+ */
+static void luz_vira_dia() {
+    g_segundos_de_luz_hoje = 0;
+    g_dose_resto_us = 0;
+    g_dia_uptime_s = 0;
+}
+
+/**
+ * @brief Zera a dose quando o RTC muda de dia (chamada a cada segundo, pelo timer).
+ * Sem RTC válido (estufa sem host desde o boot) o dia vira a cada DIA_SEM_RTC_S de uptime.
+ */
+static void relogio_verifica_dia() {
+    g_dia_uptime_s++;
+    datetime_t dt;
+    if (!g_relogio_valido || !rtc_get_datetime(&dt)) {
+        if (g_dia_uptime_s >= DIA_SEM_RTC_S) luz_vira_dia();
+        return;
+    }
+    if (g_dia_atual >= 0 && dt.day != g_dia_atual) luz_vira_dia();
+    g_dia_atual = dt.day;
+}
+
+/**
+ * @brief Callback do Temporizador (100ms)
+ * Responsável por:
+ * 1. Leitura dos ADCs (média dos blocos DMA ou leitura direta)
+ * 2. Filtragem digital (motor de filtros, um núcleo por canal)
+ * 3. Integração da dose de luz e virada de dia pelo RTC
+ */
+bool timer_callback(repeating_timer_t *t) {
+    uint32_t t0 = perf_inicio();
+
+    // Jitter: desvio do período real em relação ao nominal
+    static uint64_t ultima_chamada_us = 0;
+    uint64_t agora_us = time_us_64();
+    uint32_t dt_us = TIMER_ISR_INTERVAL_MS * 1000;
+    if (ultima_chamada_us != 0) {
+        dt_us = (uint32_t)(agora_us - ultima_chamada_us);
+        int64_t desvio = (int64_t)dt_us - TIMER_ISR_INTERVAL_MS * 1000;
+        perf_registra(SECAO_JITTER_TIMER, (uint32_t)(desvio < 0 ? -desvio : desvio));
+    }
+    ultima_chamada_us = agora_us;
+
+    // Leitura crua dos sensores
+    uint16_t bruto[ADC_NUM_CANAIS], filtrado[ADC_NUM_CANAIS];
+#if ADC_MODO_DMA
+    adc_dma_coleta(bruto); // Sobreamostrado, sem esperar conversão
+#else
+    for (uint c = 0; c < ADC_NUM_CANAIS; c++) {
+        adc_select_input(c);
+        bruto[c] = adc_read();
+        g_adc_ultimo[c] = bruto[c];
+    }
+#endif
+
+    filtro_processa(bruto, filtrado);
+    g_ldr_filtrado = filtrado[CANAL_LDR];
+    g_ntc_filtrado = filtrado[CANAL_NTC];
+    g_umidade_filtrada = filtrado[CANAL_UMIDADE];
+    g_temp_cc = temp_cc_de_adc(g_ntc_filtrado);
+    g_umidade_cp = umidade_cp_de_adc(g_umidade_filtrada);
+
+    evento_posta(EVT_CONTROLE);
+    
+    // Dose de Luz (Sol + LED), ponderada pela intensidade
+    if (g_pedido_reset_luz) {
+        luz_vira_dia();
+        g_pedido_reset_luz = false;
+    }
+    luz_integra(dt_us);
+
+    // O timer roda a cada 100ms -> 10 ticks = 1 segundo
+    g_contador_1s++;
+    if (g_contador_1s >= 10) { 
+        g_contador_1s = 0;
+        g_segundo_us = agora_us; // Carimbo do estado filtrado que a telemetria de 1 s envia
+        relogio_verifica_dia();
+
+        // Base de tempo de 1 s para telemetria e watchdog (sem polling de relógio)
+        evento_posta(EVT_SEGUNDO_IO);
+        evento_posta(EVT_SEGUNDO_CONTROLE);
+        evento_posta(EVT_SEGUNDO_LOG);
+        evento_posta(EVT_SEGUNDO_CONFIG);
+    }
+    perf_fim(SECAO_TIMER, t0);
+    return true; // Mantém o timer repetindo
+}
+
+// --- Telemetria de Alta Taxa (Lotes de Amostras) ---
+// Um timer dedicado captura a amostra mais recente (sem média móvel, para não
+// esconder transientes) numa fila SPSC; o loop agrupa N amostras por quadro.
+// Dados do quadro PROTO_TIPO_LOTE: [N][LED][Luz u32][Duty ‰ u16 x 3][ID u32][t0 µs u64][período µs u32]
+// [N x (LDR u16, Temp cC i16, Umid u16, Umid c% u16)]
+// t0 é o time_us_64() da primeira amostra; a amostra i foi colhida em t0 + i x período.
+#define TELEM_HZ_MIN 10
+#define TELEM_HZ_MAX 100
+#define TELEM_LOTE_PADRAO 10
+#define TELEM_LOTE_MAX 26
+#define TELEM_CABECALHO_LOTE 28
+#define TELEM_BYTES_AMOSTRA 8 // 28 + 26 x 8 = 236 bytes (≤ PROTO_MAX_DADOS)
+#define TELEM_FILA_AMOSTRAS 128 // Potência de 2
+
+// Modo compacto (SET,TELEM_DELTA,1): quadros PROTO_TIPO_DELTA no lugar dos lotes.
+// [N][flags][ID u32][t0 µs u64][período µs varint][Luz varint se flags.0][Duty ‰ varint x 3 se flags.1]
+// [N x (LDR, Temp cC, Umid, Umid c%) em varint zigzag da diferença para a amostra anterior]
+// A primeira amostra é a diferença para zero (quadro decodificável sozinho). Luz e duty
+// só vão quando mudam e, para quem perdeu quadros, a cada TELEM_DELTA_CHAVE quadros.
+#define PROTO_TIPO_DELTA 0x07
+#define TELEM_DELTA_FLAG_LUZ 0x01
+#define TELEM_DELTA_FLAG_DUTY 0x02
+#define TELEM_DELTA_CHAVE 16
+#define TELEM_LOTE_MAX_DELTA 48       // Sinal parado: ~4 bytes por amostra
+#define TELEM_DELTA_CABECALHO_MAX 28  // 1 + 1 + 4 + 8 + período (3) + varint u32 (5) + 3 x varint ≤ 1000 (2)
+#define TELEM_DELTA_AMOSTRA_MAX 10    // Pior caso: 2 + 3 + 2 + 3 bytes (saltos de fundo de escala)
+// Todo quadro compacto leva ao menos uma amostra; senão o laço de envio não avançaria a fila
+_Static_assert(TELEM_DELTA_CABECALHO_MAX + TELEM_DELTA_AMOSTRA_MAX <= PROTO_MAX_DADOS, "cabeçalho compacto não cabe com uma amostra");
+
+typedef struct {
+    uint64_t t_us; // time_us_64() da captura
+    uint16_t ldr, ntc, umidade;
+} amostra_t;
+
+static amostra_t g_telem_fila[TELEM_FILA_AMOSTRAS];
+static volatile uint32_t g_telem_cabeca = 0; // Escrito apenas pelo timer de telemetria
+static volatile uint32_t g_telem_cauda = 0;  // Escrito apenas pelo loop principal
+static repeating_timer_t g_telem_timer;
+static bool g_telem_timer_ativo = false;
+volatile uint32_t g_telem_hz = 0;            // 0 = modo padrão (1 pacote filtrado por segundo)
+static uint32_t g_telem_periodo_us = 0;      // Período nominal do timer de telemetria
+volatile uint32_t g_telem_lote = TELEM_LOTE_PADRAO;
+volatile uint32_t g_telem_amostras_perdidas = 0;
+volatile bool g_telem_delta = false;         // Lotes no formato compacto (PROTO_TIPO_DELTA)
+
+// Últimos valores de cabeçalho enviados no modo compacto
+static uint32_t g_delta_luz_enviada;
+static uint16_t g_delta_duty_enviado[ATUADOR_TOTAL];
+static uint32_t g_delta_quadros = 0; // Múltiplo de TELEM_DELTA_CHAVE = cabeçalho completo
+
+// Baud rate solicitado via comando; aplicado quando a fila de TX esvaziar
+volatile uint32_t g_baud_pendente = 0;
+
+/**
+ * @brief Callback do timer de telemetria (10-100 Hz)
+ * Apenas copia a última amostra para a fila; o quadro é montado fora da ISR.
+ */
+bool telem_timer_callback(repeating_timer_t *t) {
+    if (g_telem_cabeca - g_telem_cauda >= TELEM_FILA_AMOSTRAS) {
+        g_telem_amostras_perdidas++;
+        return true;
+    }
+    amostra_t *a = &g_telem_fila[g_telem_cabeca & (TELEM_FILA_AMOSTRAS - 1)];
+    a->t_us = time_us_64();
+    a->ldr = g_adc_ultimo[CANAL_LDR];
+    a->ntc = g_adc_ultimo[CANAL_NTC];
+    a->umidade = g_adc_ultimo[CANAL_UMIDADE];
+    __dmb();
+    g_telem_cabeca++;
+    if (g_telem_cabeca - g_telem_cauda >= g_telem_lote) evento_posta(EVT_LOTE);
+    return true;
+}
+
+/**
+ * @brief Liga/desliga o modo de alta taxa.
+ * @param hz Taxa de amostragem (0 = volta ao pacote de 1 s; senão 10-100 Hz)
+ * @param lote Amostras por quadro (1-TELEM_LOTE_MAX, ou 1-TELEM_LOTE_MAX_DELTA no modo compacto)
+ */
+void telemetria_configura(uint32_t hz, uint32_t lote) {
+    if (g_telem_timer_ativo) {
+        cancel_repeating_timer(&g_telem_timer);
+        g_telem_timer_ativo = false;
+    }
+    g_telem_cauda = g_telem_cabeca; // Descarta amostras do modo anterior
+    g_delta_quadros = 0;            // Primeiro quadro compacto leva o cabeçalho completo
+
+    uint32_t maximo = g_telem_delta ? TELEM_LOTE_MAX_DELTA : TELEM_LOTE_MAX;
+    if (lote < 1) lote = 1;
+    if (lote > maximo) lote = maximo;
+    g_telem_lote = lote;
+
+    if (hz == 0) {
+        g_telem_hz = 0;
+        return;
+    }
+    if (hz < TELEM_HZ_MIN) hz = TELEM_HZ_MIN;
+    if (hz > TELEM_HZ_MAX) hz = TELEM_HZ_MAX;
+    g_telem_hz = hz;
+    g_telem_periodo_us = 1000000 / hz;
+    g_telem_timer_ativo = add_repeating_timer_us(-(int64_t)g_telem_periodo_us, telem_timer_callback, NULL, &g_telem_timer);
+}
+
+/**
+ * @brief Quantas das n primeiras amostras da fila seguem o período sem buracos.
+ * Uma lacuna (fila cheia ou timer atrasado) fecha o quadro antes dela: cada quadro
+ * fica descrito só por t0 e pelo período, e o host vê a perda pelo t0 do próximo.
+ */
+static uint32_t telemetria_amostras_continuas(uint32_t n) {
+    const amostra_t *f = g_telem_fila;
+    uint64_t t0 = f[g_telem_cauda & (TELEM_FILA_AMOSTRAS - 1)].t_us;
+    uint32_t i = 1;
+    while (i < n) {
+        uint64_t t = f[(g_telem_cauda + i) & (TELEM_FILA_AMOSTRAS - 1)].t_us;
+        int64_t erro = (int64_t)(t - t0) - (int64_t)i * g_telem_periodo_us;
+        if (erro > (int64_t)g_telem_periodo_us / 2 || erro < -(int64_t)g_telem_periodo_us / 2) break;
+        i++;
+    }
+    return i;
+}
+
+static void escreve_u32(uint8_t *p, uint32_t v) {
+    p[0] = (v >> 24) & 0xFF; p[1] = (v >> 16) & 0xFF; p[2] = (v >> 8) & 0xFF; p[3] = v & 0xFF;
+}
+
+/**
+ * @brief Escreve v em p (big endian, 8 bytes).
+ */
+static void escreve_u64(uint8_t *p, uint64_t v) {
+    for (int b = 0; b < 8; b++) p[b] = (uint8_t)(v >> (56 - 8 * b));
+}
+
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); // 0, -1, 1, -2... -> 0, 1, 2, 3...
+}
+
+/**
+ * @brief Escreve v em varint (7 bits por byte, bit 7 = continua). Retorna os bytes escritos.
+ */
+static uint32_t varint_escreve(uint8_t *p, uint32_t v) {
+    uint32_t k = 0;
+    while (v >= 0x80) {
+        p[k++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[k++] = (uint8_t)v;
+    return k;
+}
+
+/**
+ * @brief Modo compacto: um quadro PROTO_TIPO_DELTA por lote completo.
+ * O quadro fecha antes de N amostras se a próxima, no pior caso, não couber.
+ */
+static void telemetria_envia_delta() {
+    uint8_t dados[PROTO_MAX_DADOS];
+    uint32_t n = g_telem_lote;
+
+    while (g_telem_hz != 0 && (g_telem_cabeca - g_telem_cauda) >= n) {
+        __dmb(); // Lê as amostras só depois de observar a cabeça
+        bool chave = (g_delta_quadros++ % TELEM_DELTA_CHAVE) == 0;
+        uint32_t luz = g_segundos_de_luz_hoje;
+        uint8_t flags = 0;
+        uint32_t k = 2;
+        dados[k++] = (g_id_dispositivo >> 24) & 0xFF;
+        dados[k++] = (g_id_dispositivo >> 16) & 0xFF;
+        dados[k++] = (g_id_dispositivo >> 8) & 0xFF;
+        dados[k++] = g_id_dispositivo & 0xFF;
+        escreve_u64(&dados[k], g_telem_fila[g_telem_cauda & (TELEM_FILA_AMOSTRAS - 1)].t_us);
+        k += 8;
+        k += varint_escreve(&dados[k], g_telem_periodo_us);
+        if (chave || luz != g_delta_luz_enviada) {
+            flags |= TELEM_DELTA_FLAG_LUZ;
+            k += varint_escreve(&dados[k], luz);
+            g_delta_luz_enviada = luz;
+        }
+        bool duty_mudou = chave;
+        for (int a = 0; a < ATUADOR_TOTAL; a++) duty_mudou |= g_duty_permil[a] != g_delta_duty_enviado[a];
+        if (duty_mudou) {
+            flags |= TELEM_DELTA_FLAG_DUTY;
+            for (int a = 0; a < ATUADOR_TOTAL; a++) {
+                g_delta_duty_enviado[a] = g_duty_permil[a];
+                k += varint_escreve(&dados[k], g_delta_duty_enviado[a]);
+            }
+        }
+
+        int32_t ant[4] = {0, 0, 0, 0}; // LDR, Temp cC, Umid, Umid c%
+        uint32_t m = telemetria_amostras_continuas(n);
+        uint32_t i = 0;
+        while (i < m && k + TELEM_DELTA_AMOSTRA_MAX <= sizeof(dados)) {
+            const amostra_t *a = &g_telem_fila[(g_telem_cauda + i) & (TELEM_FILA_AMOSTRAS - 1)];
+            int32_t v[4] = { a->ldr, temp_cc_de_adc(a->ntc), a->umidade, umidade_cp_de_adc(a->umidade) };
+            for (int c = 0; c < 4; c++) {
+                k += varint_escreve(&dados[k], zigzag(v[c] - ant[c]));
+                ant[c] = v[c];
+            }
+            i++;
+        }
+        dados[0] = (uint8_t)i;
+        dados[1] = flags;
+        __dmb();
+        g_telem_cauda += i; // Libera as amostras para o timer
+
+        proto_envia(PROTO_TIPO_DELTA, dados, k);
+    }
+}
+
+/**
+ * @brief Monta e enfileira um quadro para cada lote completo de amostras.
+ */
+void telemetria_envia_lotes() {
+    uint8_t dados[TELEM_CABECALHO_LOTE + TELEM_BYTES_AMOSTRA * TELEM_LOTE_MAX];
+    uint32_t n = g_telem_lote;
+
+    if (g_telem_delta) {
+        telemetria_envia_delta();
+        return;
+    }
+
+    while (g_telem_hz != 0 && (g_telem_cabeca - g_telem_cauda) >= n) {
+        __dmb(); // Lê as amostras só depois de observar a cabeça
+        uint32_t luz = g_segundos_de_luz_hoje;
+        uint32_t m = telemetria_amostras_continuas(n);
+        int k = 0;
+        dados[k++] = (uint8_t)m;
+        dados[k++] = g_duty_permil[ATUADOR_LED] > 0 ? 1 : 0;
+        dados[k++] = (luz >> 24) & 0xFF;
+        dados[k++] = (luz >> 16) & 0xFF;
+        dados[k++] = (luz >> 8) & 0xFF;
+        dados[k++] = luz & 0xFF;
+        for (int a = 0; a < ATUADOR_TOTAL; a++) {
+            dados[k++] = g_duty_permil[a] >> 8;
+            dados[k++] = g_duty_permil[a] & 0xFF;
+        }
+        dados[k++] = (g_id_dispositivo >> 24) & 0xFF;
+        dados[k++] = (g_id_dispositivo >> 16) & 0xFF;
+        dados[k++] = (g_id_dispositivo >> 8) & 0xFF;
+        dados[k++] = g_id_dispositivo & 0xFF;
+        escreve_u64(&dados[k], g_telem_fila[g_telem_cauda & (TELEM_FILA_AMOSTRAS - 1)].t_us);
+        k += 8;
+        dados[k++] = (g_telem_periodo_us >> 24) & 0xFF;
+        dados[k++] = (g_telem_periodo_us >> 16) & 0xFF;
+        dados[k++] = (g_telem_periodo_us >> 8) & 0xFF;
+        dados[k++] = g_telem_periodo_us & 0xFF;
+        for (uint32_t i = 0; i < m; i++) {
+            const amostra_t *a = &g_telem_fila[(g_telem_cauda + i) & (TELEM_FILA_AMOSTRAS - 1)];
+            uint16_t temp = (uint16_t)temp_cc_de_adc(a->ntc);
+            uint16_t umid = umidade_cp_de_adc(a->umidade);
+            dados[k++] = a->ldr >> 8;     dados[k++] = a->ldr & 0xFF;
+            dados[k++] = temp >> 8;       dados[k++] = temp & 0xFF;
+            dados[k++] = a->umidade >> 8; dados[k++] = a->umidade & 0xFF;
+            dados[k++] = umid >> 8;       dados[k++] = umid & 0xFF;
+        }
+        __dmb();
+        g_telem_cauda += m; // Libera as amostras para o timer
+
+        proto_envia(PROTO_TIPO_LOTE, dados, (uint32_t)k); // Um cabeçalho e um CRC por lote
+    }
+}
+
+// --- Taxa Adaptativa (SET,ADAPT,1) ---
+// Sinais parados: o pacote de 1 s vira um batimento a cada ADAPT_BATIMENTO_S. Uma variação
+// filtrada acima do limiar em 1 s ou um duty mudando liga a rajada de alta taxa (ADAPT_HZ),
+// que dura ADAPT_RAJADA_S depois do último gatilho; depois volta ao pacote de 1 s e, após
+// ADAPT_CALMA_S sem gatilho, ao batimento. O timer de controle (100 ms) não muda: filtros,
+// malhas PI e dose de luz continuam no mesmo passo. SET,TELEM com hz > 0 tem precedência.
+#define ADAPT_BATIMENTO_S 10
+#define ADAPT_RAJADA_S 20
+#define ADAPT_CALMA_S 60
+#define ADAPT_HZ 50
+#define ADAPT_LOTE 25
+#define ADAPT_LIMIAR_TEMP_CC 10  // 0,1 °C em 1 s
+#define ADAPT_LIMIAR_UMID_CP 50  // 0,5 % em 1 s
+#define ADAPT_LIMIAR_LDR 40      // Contagens em 1 s (nuvem, lâmpada)
+#define ADAPT_LIMIAR_DUTY 100    // ‰ em 1 s (bomba ou ventilador partindo)
+
+// Modo informado no pacote de 1 s
+typedef enum { TAXA_FIXA, TAXA_BATIMENTO, TAXA_NORMAL, TAXA_RAJADA } taxa_modo_t;
+
+volatile bool g_adapt_ativo = false;
+static bool g_telem_manual = false;        // Host pediu alta taxa: o modo adaptativo só observa
+static taxa_modo_t g_taxa_modo = TAXA_FIXA;
+static uint32_t g_adapt_quieto_s = 0;      // Segundos desde o último gatilho
+static uint32_t g_adapt_relato_s = 0;      // Segundos desde o último pacote de 1 s
+static uint32_t g_adapt_lote_salvo = TELEM_LOTE_PADRAO;
+
+static inline uint32_t diferenca(int32_t a, int32_t b) { return (uint32_t)(a > b ? a - b : b - a); }
+
+/**
+ * @brief Mede a atividade do último segundo (estado filtrado e duties).
+ */
+static bool adapt_gatilho() {
+    static int16_t temp_ant = TEMP_CC_INVALIDA;
+    static uint16_t umid_ant, ldr_ant, duty_ant[ATUADOR_TOTAL];
+    static bool primeiro = true;
+    int16_t temp = g_temp_cc;
+    uint16_t umid = g_umidade_cp, ldr = g_ldr_filtrado;
+    bool gatilho = false;
+    if (!primeiro) {
+        if (temp != TEMP_CC_INVALIDA && temp_ant != TEMP_CC_INVALIDA)
+            gatilho |= diferenca(temp, temp_ant) >= ADAPT_LIMIAR_TEMP_CC;
+        gatilho |= diferenca(umid, umid_ant) >= ADAPT_LIMIAR_UMID_CP;
+        gatilho |= diferenca(ldr, ldr_ant) >= ADAPT_LIMIAR_LDR;
+        for (int a = 0; a < ATUADOR_TOTAL; a++)
+            gatilho |= diferenca(g_duty_permil[a], duty_ant[a]) >= ADAPT_LIMIAR_DUTY;
+    }
+    primeiro = false;
+    temp_ant = temp; umid_ant = umid; ldr_ant = ldr;
+    for (int a = 0; a < ATUADOR_TOTAL; a++) duty_ant[a] = g_duty_permil[a];
+    return gatilho;
+}
+
+/**
+ * @brief Roda a cada segundo no núcleo de E/S: escolhe a taxa e diz se o pacote de 1 s sai agora.
+ */
+static bool adapt_segundo() {
+    bool gatilho = adapt_gatilho();
+    if (!g_adapt_ativo || g_telem_manual) {
+        g_taxa_modo = TAXA_FIXA;
+        return g_telem_hz == 0;
+    }
+
+    g_adapt_quieto_s = gatilho ? 0 : g_adapt_quieto_s + 1;
+    taxa_modo_t modo = g_adapt_quieto_s < ADAPT_RAJADA_S ? TAXA_RAJADA
+                     : g_adapt_quieto_s < ADAPT_CALMA_S ? TAXA_NORMAL : TAXA_BATIMENTO;
+    bool fim_rajada = false;
+    if (modo == TAXA_RAJADA && g_taxa_modo != TAXA_RAJADA) {
+        g_adapt_lote_salvo = g_telem_lote;
+        telemetria_configura(ADAPT_HZ, ADAPT_LOTE);
+    } else if (modo != TAXA_RAJADA && g_taxa_modo == TAXA_RAJADA) {
+        telemetria_configura(0, g_adapt_lote_salvo);
+        fim_rajada = true; // Estado de 1 s na hora, sem esperar o período
+    }
+    g_taxa_modo = modo;
+    if (modo == TAXA_RAJADA) return false; // Os lotes já levam o estado
+
+    uint32_t periodo = (modo == TAXA_BATIMENTO) ? ADAPT_BATIMENTO_S : 1;
+    if (++g_adapt_relato_s < periodo && !fim_rajada) return false;
+    g_adapt_relato_s = 0;
+    return true;
+}
+
+/**
+ * @brief Período de relato em uso (s) para o pacote de 1 s.
+ */
+static uint16_t adapt_periodo_s() {
+    return (g_taxa_modo == TAXA_BATIMENTO) ? ADAPT_BATIMENTO_S : 1;
+}
+
+// --- Detector de Anomalias (Quadros de Evento) ---
+// Avalia, a cada segundo no núcleo de E/S, o estado filtrado e a variância móvel do
+// motor de filtros. Três famílias de condição, uma por canal ou atuador:
+//   faixa: leitura filtrada fora da faixa física do sensor (aberto ou em curto);
+//   taxa: variação em 1 s acima do piso do canal e de ANOMALIA_SIGMAS desvios do ruído;
+//   sem resposta: atuador ligado há um tempo sem a grandeza que ele move reagir.
+// Só as bordas viram quadro (início e fim), na hora e fora do calendário da
+// telemetria. Se a fila de TX recusar, a borda sai no segundo seguinte.
+// Dados do quadro PROTO_TIPO_ANOMALIA: [tipo][origem][ativa][valor i32][limiar i32][ID u32][t µs u64]
+// origem é o canal (faixa, taxa) ou o atuador (sem resposta).
+#define PROTO_TIPO_ANOMALIA 0x08
+#define ANOMALIA_DADOS 23
+#define ANOMALIA_SIGMAS 8           // Variação em 1 s acima de 8 desvios do ruído
+#define ANOMALIA_HISTERESE_ADC 20   // Volta à faixa com folga antes de encerrar
+#define ANOMALIA_TAXA_FIM_S 5       // Segundos calmos para encerrar uma anomalia de taxa
+#define ANOMALIA_DUTY_LIGADO 500    // ‰ a partir do qual o atuador conta como ligado
+
+typedef enum { ANOMALIA_FAIXA, ANOMALIA_TAXA, ANOMALIA_SEM_RESPOSTA, ANOMALIA_TIPOS } anomalia_tipo_t;
+#define ANOMALIA_ORIGENS 3 // max(ADC_NUM_CANAIS, ATUADOR_TOTAL)
+#define ANOMALIA_TOTAL (ANOMALIA_TIPOS * ANOMALIA_ORIGENS)
+
+// Faixa crua válida e piso de variação em 1 s (0 = canal sem verificação de taxa)
+typedef struct { uint16_t min, max, taxa_min; } anomalia_canal_t;
+static const anomalia_canal_t g_anomalia_canal[ADC_NUM_CANAIS] = {
+    [CANAL_LDR]     = {0, 4095, 0},    // Escuro total e sol pleno são legítimos; nuvens e o LED mudam o LDR de repente
+    [CANAL_NTC]     = {80, 4050, 100}, // Acima de 4050: NTC aberto (mesmo corte do app.py); abaixo de 80, em curto
+    [CANAL_UMIDADE] = {50, 4050, 200}, // Sensor capacitivo solto ou em curto
+};
+
+// Prazo para a grandeza reagir e variação mínima esperada (já com o sinal do efeito)
+typedef struct { uint16_t prazo_s; int16_t resposta; } anomalia_atuador_t;
+static const anomalia_atuador_t g_anomalia_atuador[ATUADOR_TOTAL] = {
+    [ATUADOR_VENTILADOR] = {300, -20}, // Temperatura cai 0,2 °C em 5 min
+    [ATUADOR_BOMBA]      = {120, 50},  // Umidade sobe 0,5 % em 2 min
+    [ATUADOR_LED]        = {10, -40},  // LDR cai 40 contagens em 10 s (menor = mais luz)
+};
+
+static struct {
+    uint16_t ativas, relatadas;            // Bit por condição (tipo x ANOMALIA_ORIGENS + origem)
+    int32_t valor[ANOMALIA_TOTAL], limiar[ANOMALIA_TOTAL];
+    uint16_t anterior[ADC_NUM_CANAIS];     // Leitura filtrada do segundo anterior
+    uint8_t calmo_s[ADC_NUM_CANAIS];       // Segundos sem variação anômala
+    uint32_t ligado_s[ATUADOR_TOTAL];      // Segundos seguidos com o atuador ligado
+    int32_t base[ATUADOR_TOTAL];           // Grandeza quando o atuador ligou
+    bool respondeu[ATUADOR_TOTAL];         // A grandeza já reagiu nesta ligação
+    bool iniciado;
+} g_anomalia;
+
+/**
+ * @brief Raiz quadrada inteira (bit a bit, sem float).
+ */
+static uint32_t raiz_u32(uint32_t x) {
+    uint32_t r = 0, bit = 1u << 30;
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= r + bit) { x -= r + bit; r = (r >> 1) + bit; }
+        else r >>= 1;
+        bit >>= 2;
+    }
+    return r;
+}
+
+static void anomalia_define(anomalia_tipo_t tipo, int origem, bool ativa, int32_t valor, int32_t limiar) {
+    int i = tipo * ANOMALIA_ORIGENS + origem;
+    if (ativa) g_anomalia.ativas |= 1u << i;
+    else g_anomalia.ativas &= ~(1u << i);
+    g_anomalia.valor[i] = valor;
+    g_anomalia.limiar[i] = limiar;
+}
+
+static inline bool anomalia_ativa(anomalia_tipo_t tipo, int origem) {
+    return g_anomalia.ativas & (1u << (tipo * ANOMALIA_ORIGENS + origem));
+}
+
+/**
+ * @brief Grandeza que cada atuador move; false se ela está inválida (NTC fora da faixa).
+ */
+static bool anomalia_grandeza(int atuador, int32_t *v) {
+    switch (atuador) {
+    case ATUADOR_VENTILADOR: *v = g_temp_cc; return *v != TEMP_CC_INVALIDA;
+    case ATUADOR_BOMBA: *v = g_umidade_cp; return true;
+    default: *v = g_ldr_filtrado; return true;
+    }
+}
+
+/**
+ * @brief Reavalia todas as condições com o estado do último segundo.
+ */
+static void anomalia_avalia() {
+    const uint16_t leitura[ADC_NUM_CANAIS] = {
+        [CANAL_LDR] = g_ldr_filtrado, [CANAL_NTC] = g_ntc_filtrado, [CANAL_UMIDADE] = g_umidade_filtrada,
+    };
+    for (int c = 0; c < ADC_NUM_CANAIS; c++) {
+        const anomalia_canal_t *cfg = &g_anomalia_canal[c];
+        int32_t x = leitura[c];
+
+        // Faixa: entra no limite, sai só com a folga da histerese
+        bool fora = x < cfg->min || x > cfg->max;
+        if (anomalia_ativa(ANOMALIA_FAIXA, c))
+            fora = x < cfg->min + ANOMALIA_HISTERESE_ADC || x > cfg->max - ANOMALIA_HISTERESE_ADC;
+        anomalia_define(ANOMALIA_FAIXA, c, fora, x, x > (cfg->min + cfg->max) / 2 ? cfg->max : cfg->min);
+
+        // Taxa: o limiar sobe junto com o ruído do canal (desvio padrão em 1/16 de contagem)
+        if (cfg->taxa_min == 0 || !g_anomalia.iniciado) continue;
+        int32_t d = x - g_anomalia.anterior[c];
+        int32_t limiar = (int32_t)(ANOMALIA_SIGMAS * raiz_u32(filtro_variancia(c)) >> (FILTRO_FRAC_BITS / 2));
+        if (limiar < cfg->taxa_min) limiar = cfg->taxa_min;
+        bool salto = (int32_t)diferenca(x, g_anomalia.anterior[c]) >= limiar;
+        g_anomalia.calmo_s[c] = salto ? 0 : (g_anomalia.calmo_s[c] < 255 ? g_anomalia.calmo_s[c] + 1 : 255);
+        bool ativa = salto || (anomalia_ativa(ANOMALIA_TAXA, c) && g_anomalia.calmo_s[c] < ANOMALIA_TAXA_FIM_S);
+        if (salto || !ativa) anomalia_define(ANOMALIA_TAXA, c, ativa, d, limiar); // O fim guarda o último salto
+    }
+    for (int c = 0; c < ADC_NUM_CANAIS; c++) g_anomalia.anterior[c] = leitura[c];
+    g_anomalia.iniciado = true;
+
+    // Sem resposta: a referência é a grandeza no instante em que o atuador ligou
+    for (int a = 0; a < ATUADOR_TOTAL; a++) {
+        const anomalia_atuador_t *cfg = &g_anomalia_atuador[a];
+        int32_t v;
+        if (g_duty_permil[a] < ANOMALIA_DUTY_LIGADO || !anomalia_grandeza(a, &v)) {
+            g_anomalia.ligado_s[a] = 0;
+            if (anomalia_ativa(ANOMALIA_SEM_RESPOSTA, a))
+                anomalia_define(ANOMALIA_SEM_RESPOSTA, a, false, g_anomalia.valor[ANOMALIA_SEM_RESPOSTA * ANOMALIA_ORIGENS + a], cfg->resposta);
+            continue;
+        }
+        if (g_anomalia.ligado_s[a]++ == 0) {
+            g_anomalia.base[a] = v;
+            g_anomalia.respondeu[a] = false;
+        }
+        int32_t efeito = v - g_anomalia.base[a];
+        if (cfg->resposta > 0 ? efeito >= cfg->resposta : efeito <= cfg->resposta) g_anomalia.respondeu[a] = true;
+        anomalia_define(ANOMALIA_SEM_RESPOSTA, a, !g_anomalia.respondeu[a] && g_anomalia.ligado_s[a] >= cfg->prazo_s,
+                        efeito, cfg->resposta);
+    }
+}
+
+/**
+ * @brief Envia um quadro para cada condição que mudou desde o último relato.
+ */
+static void anomalia_relata() {
+    uint16_t bordas = g_anomalia.ativas ^ g_anomalia.relatadas;
+    for (int i = 0; bordas && i < ANOMALIA_TOTAL; i++) {
+        if (!(bordas & (1u << i))) continue;
+        bool ativa = g_anomalia.ativas & (1u << i);
+        uint8_t d[ANOMALIA_DADOS];
+        d[0] = (uint8_t)(i / ANOMALIA_ORIGENS);
+        d[1] = (uint8_t)(i % ANOMALIA_ORIGENS);
+        d[2] = ativa;
+        escreve_u32(&d[3], (uint32_t)g_anomalia.valor[i]);
+        escreve_u32(&d[7], (uint32_t)g_anomalia.limiar[i]);
+        escreve_u32(&d[11], g_id_dispositivo);
+        escreve_u64(&d[15], g_segundo_us); // Mesmo relógio da telemetria de 1 s
+        if (!proto_envia(PROTO_TIPO_ANOMALIA, d, sizeof(d))) return; // Fila cheia: tenta no próximo segundo
+        g_anomalia.relatadas ^= 1u << i;
+    }
+}
+
+/**
+ * @brief Valida baud rates aceitos pelo comando SET,BAUD.
+ */
+bool baud_valido(uint32_t baud) {
+    static const uint32_t permitidos[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+    for (unsigned i = 0; i < sizeof(permitidos) / sizeof(permitidos[0]); i++) {
+        if (permitidos[i] == baud) return true;
+    }
+    return false;
+}
+
+// --- Exportação de Estatísticas (GET,STATS) ---
+#define PROTO_TIPO_STATS 0x04      // Uma seção de instrumentação
+#define PROTO_TIPO_CONTADORES 0x05 // Contadores de filas (TX, RX, amostras)
+
+static uint32_t le_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+extern volatile uint32_t g_log_falhas;    // Log em flash (mais abaixo)
+extern volatile uint32_t g_config_falhas; // Configuração persistente (mais abaixo)
+
+/**
+ * @brief Envia um quadro por seção e um quadro de contadores.
+ * Seção: [id][unidade][clk_sys Hz u32][contagem u32][min u32][max u32][média u32][hist 24 x u16]
+ * Contadores: TX enfileirados, descartados, bytes, pressão, pico; RX perdidas; amostras perdidas;
+ * comandos ASCII rejeitados; gravações do log em flash que falharam; gravações da configuração
+ * que falharam (u32).
+ */
+void perf_envia_stats() {
+    uint8_t d[2 + 5 * 4 + 2 * PERF_BALDES];
+    uint32_t clk = clock_get_hz(clk_sys);
+    for (int id = 0; id < SECAO_TOTAL; id++) {
+        volatile perf_secao_t *p = &g_perf[id];
+        uint32_t contagem = p->contagem;
+        d[0] = (uint8_t)id;
+        d[1] = (id == SECAO_JITTER_TIMER) ? PERF_UNIDADE_US : PERF_UNIDADE_CICLOS;
+        escreve_u32(&d[2], clk);
+        escreve_u32(&d[6], contagem);
+        escreve_u32(&d[10], p->min);
+        escreve_u32(&d[14], p->max);
+        escreve_u32(&d[18], contagem ? (uint32_t)(p->soma / contagem) : 0);
+        for (int b = 0; b < PERF_BALDES; b++) {
+            d[22 + 2 * b] = (p->hist[b] >> 8) & 0xFF;
+            d[23 + 2 * b] = p->hist[b] & 0xFF;
+        }
+        proto_envia(PROTO_TIPO_STATS, d, sizeof(d));
+    }
+
+    uint8_t c[10 * 4];
+    escreve_u32(&c[0], g_tx_stats.quadros_enfileirados);
+    escreve_u32(&c[4], g_tx_stats.quadros_descartados);
+    escreve_u32(&c[8], g_tx_stats.bytes_enfileirados);
+    escreve_u32(&c[12], g_tx_stats.eventos_pressao);
+    escreve_u32(&c[16], g_tx_stats.pico_ocupacao);
+    escreve_u32(&c[20], g_rx_linhas_perdidas);
+    escreve_u32(&c[24], g_telem_amostras_perdidas);
+    escreve_u32(&c[28], g_rx_comandos_rejeitados);
+    escreve_u32(&c[32], g_log_falhas);
+    escreve_u32(&c[36], g_config_falhas);
+    proto_envia(PROTO_TIPO_CONTADORES, c, sizeof(c));
+}
+
+/**
+ * @brief Zera a instrumentação (novo período de medição).
+ */
+void perf_zera() {
+    for (int id = 0; id < SECAO_TOTAL; id++) {
+        memset((void*)&g_perf[id], 0, sizeof(perf_secao_t));
+    }
+}
+
+// --- Identificação do Dispositivo ---
+// Vários controladores num mesmo host: telemetria, lotes e descarga levam o ID,
+// então o host separa as estufas mesmo se as portas seriais trocarem de nome.
+
+/**
+ * @brief Deriva o ID de 32 bits do ID único de 64 bits da flash (XOR das metades).
+ */
+void dispositivo_init() {
+    pico_unique_board_id_t uid;
+    pico_get_unique_board_id(&uid);
+    g_id_dispositivo = le_u32(&uid.id[0]) ^ le_u32(&uid.id[4]);
+}
+
+// --- Log Circular em Flash (Store-and-Forward) ---
+// A cada FLASH_LOG_PERIODO_S um registro compacto entra numa página em RAM; com a
+// página cheia (16 registros) ela é gravada de uma vez no fim da flash. O log gira
+// por todos os setores (desgaste uniforme): ao entrar num setor ele é apagado,
+// descartando os registros mais antigos. Os registros já ficam no formato do fio.
+// Registro: [seq u32][uptime_s u32][LDR u16][NTC u16][Umid u16][flags u8][crc u8]
+// seq cresce sempre (recuperado na partida); crc = byte baixo do CRC16 dos 15 anteriores.
+#define FLASH_LOG_BYTES (256 * 1024)   // 64 setores: 16384 registros (~45 h a cada 10 s)
+#define FLASH_LOG_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_LOG_BYTES)
+#define FLASH_LOG_PERIODO_S 10
+#define FLASH_LOG_REG_BYTES 16
+#define FLASH_LOG_REG_POR_PAGINA (FLASH_PAGE_SIZE / FLASH_LOG_REG_BYTES)
+#define FLASH_LOG_PAGINAS (FLASH_LOG_BYTES / FLASH_PAGE_SIZE)
+#define FLASH_LOG_PAGINAS_POR_SETOR (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define FLASH_LOG_FLAG_LED 0x01
+#define FLASH_LOG_TIMEOUT_MS 100       // Espera pelo lockout do outro núcleo
+
+// Descarga: quadros PROTO_TIPO_BACKLOG [n u8][uptime_agora_s u32][ID u32][n x registro];
+// um quadro com n = 0 encerra. O uptime atual permite ao host datar os registros.
+#define PROTO_TIPO_BACKLOG 0x06
+#define BACKLOG_CABECALHO 9
+#define BACKLOG_REG_POR_QUADRO 14      // 9 + 14 x 16 = 233 bytes (<= PROTO_MAX_DADOS)
+
+static uint8_t g_log_pagina[FLASH_PAGE_SIZE];  // Página em montagem (escrita só pelo núcleo 0)
+static volatile uint32_t g_log_na_pagina = 0;  // Registros válidos em g_log_pagina
+static volatile uint32_t g_log_proxima_pagina = 0; // Próxima página da flash a gravar
+static volatile uint32_t g_log_seq = 0;        // seq do próximo registro
+volatile uint32_t g_log_falhas = 0;            // flash_safe_execute sem sucesso (página mantida)
+
+static inline const uint8_t *log_flash(uint32_t pagina) {
+    return (const uint8_t *)(XIP_BASE + FLASH_LOG_OFFSET + pagina * FLASH_PAGE_SIZE);
+}
+
+static bool log_registro_valido(const uint8_t *r) {
+    return le_u32(r) != 0xFFFFFFFF && (crc16(r, FLASH_LOG_REG_BYTES - 1) & 0xFF) == r[FLASH_LOG_REG_BYTES - 1];
+}
+
+static bool log_pagina_apagada(uint32_t pagina) {
+    const uint8_t *p = log_flash(pagina);
+    for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) if (p[i] != 0xFF) return false;
+    return true;
+}
+
+/**
+ * @brief Recupera a posição de escrita varrendo o log (maior seq válido).
+ * Se a página seguinte não estiver apagada (gravação interrompida), pula para o próximo setor.
+ */
+void flash_log_init() {
+    bool achou = false;
+    uint32_t maior = 0, pagina_maior = 0;
+    for (uint32_t pg = 0; pg < FLASH_LOG_PAGINAS; pg++) {
+        const uint8_t *p = log_flash(pg);
+        for (uint32_t r = 0; r < FLASH_LOG_REG_POR_PAGINA; r++) {
+            const uint8_t *reg = &p[r * FLASH_LOG_REG_BYTES];
+            if (!log_registro_valido(reg)) continue;
+            uint32_t seq = le_u32(reg);
+            if (!achou || seq > maior) { maior = seq; pagina_maior = pg; achou = true; }
+        }
+    }
+    g_log_seq = achou ? maior + 1 : 0;
+    g_log_proxima_pagina = achou ? (pagina_maior + 1) % FLASH_LOG_PAGINAS : 0;
+    if (g_log_proxima_pagina % FLASH_LOG_PAGINAS_POR_SETOR != 0 && !log_pagina_apagada(g_log_proxima_pagina)) {
+        g_log_proxima_pagina = (g_log_proxima_pagina / FLASH_LOG_PAGINAS_POR_SETOR + 1) * FLASH_LOG_PAGINAS_POR_SETOR % FLASH_LOG_PAGINAS;
+    }
+    g_log_na_pagina = 0;
+    memset(g_log_pagina, 0xFF, sizeof(g_log_pagina));
+}
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t *dados;
+} log_op_t;
+
+// Roda com IRQs desligadas e o outro núcleo em lockout (código na RAM do SDK)
+static void log_op_flash(void *param) {
+    const log_op_t *op = (const log_op_t *)param;
+    if (op->offset % FLASH_SECTOR_SIZE == 0) flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+    flash_range_program(op->offset, op->dados, FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief Única porta de escrita na flash: roda a operação com a aquisição do ADC parada.
+ * As amostras desse intervalo se perdem (o timer reaproveita a última média).
+ */
+static int flash_executa(log_op_t *op) {
+#if ADC_MODO_DMA
+    adc_dma_pausa();
+#endif
+    int r = flash_safe_execute(log_op_flash, op, FLASH_LOG_TIMEOUT_MS);
+#if ADC_MODO_DMA
+    adc_dma_arma();
+#endif
+    return r;
+}
+
+static void log_grava_pagina() {
+    log_op_t op = { FLASH_LOG_OFFSET + g_log_proxima_pagina * FLASH_PAGE_SIZE, g_log_pagina };
+    if (flash_executa(&op) != PICO_OK) {
+        g_log_falhas++; // Página continua em RAM; nova tentativa no próximo registro
+        return;
+    }
+    g_log_proxima_pagina = (g_log_proxima_pagina + 1) % FLASH_LOG_PAGINAS;
+    g_log_na_pagina = 0;
+    memset(g_log_pagina, 0xFF, sizeof(g_log_pagina));
+}
+
+/**
+ * @brief Registra o estado filtrado a cada FLASH_LOG_PERIODO_S (núcleo 0, fora de ISR).
+ * Apagar um setor para a CPU por dezenas de ms, por isso só acontece a cada 256 registros.
+ */
+void tarefa_log() {
+    static uint32_t segundos = 0;
+    if (!evento_consome(EVT_SEGUNDO_LOG)) return;
+    if (++segundos < FLASH_LOG_PERIODO_S) return;
+    segundos = 0;
+
+    if (g_log_na_pagina < FLASH_LOG_REG_POR_PAGINA) {
+        uint8_t *r = &g_log_pagina[g_log_na_pagina * FLASH_LOG_REG_BYTES];
+        escreve_u32(&r[0], g_log_seq);
+        escreve_u32(&r[4], to_ms_since_boot(get_absolute_time()) / 1000);
+        r[8] = (g_ldr_filtrado >> 8) & 0xFF; r[9] = g_ldr_filtrado & 0xFF;
+        r[10] = (g_ntc_filtrado >> 8) & 0xFF; r[11] = g_ntc_filtrado & 0xFF;
+        r[12] = (g_umidade_filtrada >> 8) & 0xFF; r[13] = g_umidade_filtrada & 0xFF;
+        r[14] = g_duty_permil[ATUADOR_LED] > 0 ? FLASH_LOG_FLAG_LED : 0;
+        r[15] = crc16(r, FLASH_LOG_REG_BYTES - 1) & 0xFF;
+        __dmb(); // Registro completo antes de ficar visível para a descarga
+        g_log_seq++;
+        g_log_na_pagina++;
+    }
+    if (g_log_na_pagina == FLASH_LOG_REG_POR_PAGINA) log_grava_pagina();
+}
+
+// Estado da descarga (só o núcleo de E/S mexe)
+static struct {
+    bool ativo;
+    uint32_t desde;    // Menor seq pedido pelo host
+    uint32_t pagina;   // Páginas já percorridas (a partir do setor mais antigo)
+    uint32_t registro; // Próximo registro dentro da página atual
+    uint32_t inicio;   // Primeira página do percurso
+} g_backlog;
+
+/**
+ * @brief Começa a descarga dos registros com seq >= desde (do mais antigo ao mais novo).
+ * O percurso começa no setor seguinte ao da escrita: é onde estão os dados mais velhos.
+ */
+void backlog_inicia(uint32_t desde) {
+    g_backlog.desde = desde;
+    g_backlog.inicio = (g_log_proxima_pagina / FLASH_LOG_PAGINAS_POR_SETOR + 1) * FLASH_LOG_PAGINAS_POR_SETOR % FLASH_LOG_PAGINAS;
+    g_backlog.pagina = 0;
+    g_backlog.registro = 0;
+    g_backlog.ativo = true;
+}
+
+/**
+ * @brief Próximo registro a enviar: páginas da flash e, por último, a página em RAM.
+ */
+static const uint8_t *backlog_proximo() {
+    while (g_backlog.pagina <= FLASH_LOG_PAGINAS) {
+        bool em_ram = (g_backlog.pagina == FLASH_LOG_PAGINAS);
+        const uint8_t *p = em_ram ? g_log_pagina : log_flash((g_backlog.inicio + g_backlog.pagina) % FLASH_LOG_PAGINAS);
+        uint32_t limite = em_ram ? g_log_na_pagina : FLASH_LOG_REG_POR_PAGINA;
+        __dmb();
+        while (g_backlog.registro < limite) {
+            const uint8_t *r = &p[FLASH_LOG_REG_BYTES * g_backlog.registro++];
+            if (log_registro_valido(r) && le_u32(r) >= g_backlog.desde) return r;
+        }
+        g_backlog.pagina++;
+        g_backlog.registro = 0;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Envia blocos enquanto houver espaço na fila de TX; retoma no EVT_TX_VAZIA.
+ */
+void backlog_continua() {
+    uint8_t d[BACKLOG_CABECALHO + BACKLOG_REG_POR_QUADRO * FLASH_LOG_REG_BYTES];
+    while (g_backlog.ativo && tx_fila_livre() >= PROTO_MAX_QUADRO) {
+        uint32_t n = 0;
+        const uint8_t *r;
+        while (n < BACKLOG_REG_POR_QUADRO && (r = backlog_proximo()) != NULL) {
+            memcpy(&d[BACKLOG_CABECALHO + n * FLASH_LOG_REG_BYTES], r, FLASH_LOG_REG_BYTES);
+            n++;
+        }
+        d[0] = (uint8_t)n;
+        escreve_u32(&d[1], to_ms_since_boot(get_absolute_time()) / 1000);
+        escreve_u32(&d[5], g_id_dispositivo);
+        proto_envia(PROTO_TIPO_BACKLOG, d, BACKLOG_CABECALHO + n * FLASH_LOG_REG_BYTES);
+        if (n == 0) g_backlog.ativo = false; // Quadro vazio = fim da descarga
+    }
+}
+
+// --- Controle dos Atuadores (PWM + PI com Histerese) ---
+// Cada atuador tem uma malha PI em ponto fixo que define o duty do seu slice PWM.
+// A histerese liga a malha quando o erro passa de +hist e a desliga (duty 0,
+// integral zerada) abaixo de -hist, sem liga-desliga em torno do setpoint.
+// Com kp = ki = 0 a malha vira liga/desliga com histerese (duty 100 %), para cargas em relé.
+// Unidade do erro: c°C (ventilador), c% (bomba), contagens do ADC (LED).
+#define PWM_FREQ_HZ 25000       // Acima da faixa audível (ventilador sem chiado)
+#define DUTY_MAX 1000           // Duty em ‰
+#define GANHO_ESCALA_P 100      // duty = kp * erro / 100: kp em ‰ por °C, % ou 100 contagens
+#define GANHO_ESCALA_I 100000   // Integral: ki em ‰/s por °C, % ou 100 contagens (dt em ms)
+#define GANHO_MAX 10000
+#define HIST_MAX 2000
+#define CONTROLE_DT_MAX_MS 1000 // Limita o passo da integral após pausas longas
+
+typedef struct {
+    int32_t kp, ki;   // Ganhos (ver GANHO_ESCALA_*)
+    int32_t hist;     // Meia banda de histerese, na unidade do erro
+    int32_t duty_min; // Menor duty com a malha ligada (partida do motor)
+    int32_t integral; // Termo integral acumulado, em ‰ x GANHO_ESCALA_I
+    bool ligada;
+    uint pino;
+} malha_t;
+
+static malha_t g_malhas[ATUADOR_TOTAL] = {
+    [ATUADOR_VENTILADOR] = {.kp = 300, .ki = 20, .hist = 50, .duty_min = 300},  // Banda de ±0,5 °C
+    [ATUADOR_BOMBA]      = {.kp = 150, .ki = 10, .hist = 100, .duty_min = 400}, // Banda de ±1 %
+    [ATUADOR_LED]        = {.kp = 100, .ki = 20, .hist = 50, .duty_min = 100},  // Banda de ±50 contagens
+};
+static uint32_t g_pwm_nivel_max = 0; // Nível do PWM para 100 % (wrap + 1)
+
+/**
+ * @brief Coloca os pinos dos atuadores nos slices PWM, todos desligados.
+ */
+void atuadores_init() {
+    const uint pinos[ATUADOR_TOTAL] = {[ATUADOR_VENTILADOR] = FAN_PIN, [ATUADOR_BOMBA] = PUMP_PIN, [ATUADOR_LED] = LED_PIN};
+    uint32_t wrap = clock_get_hz(clk_sys) / PWM_FREQ_HZ - 1;
+    g_pwm_nivel_max = wrap + 1;
+    for (int a = 0; a < ATUADOR_TOTAL; a++) {
+        uint slice = pwm_gpio_to_slice_num(pinos[a]);
+        g_malhas[a].pino = pinos[a];
+        gpio_set_function(pinos[a], GPIO_FUNC_PWM);
+        pwm_set_clkdiv(slice, 1.0f);
+        pwm_set_wrap(slice, (uint16_t)wrap);
+        pwm_set_gpio_level(pinos[a], 0);
+        pwm_set_enabled(slice, true);
+        g_duty_permil[a] = 0;
+    }
+}
+
+/**
+ * @brief Um passo da malha PI.
+ * @param erro Positivo quando o atuador precisa agir
+ * @param permitida false força o atuador desligado (sensor inválido, meta atingida)
+ * @return Duty em ‰
+ */
+static int32_t malha_passo(malha_t *m, int32_t erro, uint32_t dt_ms, bool permitida) {
+    if (!permitida || erro < -m->hist) m->ligada = false;
+    else if (erro > m->hist) m->ligada = true;
+    if (!m->ligada) {
+        m->integral = 0;
+        return 0;
+    }
+    if (m->kp == 0 && m->ki == 0) return DUTY_MAX;
+
+    // Anti-windup: não integra com a saída saturada no sentido do erro,
+    // e a integral sozinha nunca passa de 0-100 %
+    int32_t p = m->kp * erro / GANHO_ESCALA_P;
+    bool saturada = (erro > 0) ? (p + m->integral / GANHO_ESCALA_I >= DUTY_MAX)
+                               : (p + m->integral / GANHO_ESCALA_I <= m->duty_min);
+    if (!saturada) {
+        int64_t integral = m->integral + (int64_t)m->ki * erro * (int32_t)dt_ms;
+        if (integral < 0) integral = 0;
+        if (integral > (int64_t)DUTY_MAX * GANHO_ESCALA_I) integral = (int64_t)DUTY_MAX * GANHO_ESCALA_I;
+        m->integral = (int32_t)integral;
+    }
+
+    int32_t duty = p + m->integral / GANHO_ESCALA_I;
+    if (duty < m->duty_min) duty = m->duty_min;
+    if (duty > DUTY_MAX) duty = DUTY_MAX;
+    return duty;
+}
+
+/**
+ * @brief Atualiza o nível do PWM apenas quando o duty muda.
+ */
+static void atuador_aplica(atuador_id_t id, int32_t duty) {
+    if (g_duty_permil[id] == duty) return;
+    g_duty_permil[id] = (uint16_t)duty;
+    pwm_set_gpio_level(g_malhas[id].pino, (uint16_t)((uint32_t)duty * g_pwm_nivel_max / DUTY_MAX));
+}
+
+// --- Configuração Persistente em Flash (Partida a Quente) ---
+// Setpoints, fotoperíodo, malhas PI e a dose do dia sobrevivem a queda de energia e
+// ao reset do watchdog. Dois setores logo abaixo do log circular guardam registros
+// de uma página cada, gravados em sequência: ao entrar num setor ele é apagado e o
+// outro continua com o registro anterior, então sempre sobra uma cópia válida
+// (maior seq com CRC correto). Uma mudança de configuração é gravada CONFIG_ATRASO_S
+// depois (os SETs de um "ENVIAR" do painel viram um registro só); a dose do dia, que
+// anda sozinha, só a cada CONFIG_LUZ_PERIODO_S: perde-se no máximo esse tanto de luz.
+// Registro: [magic u32][seq u32][Umid c% u16][Temp cC i16][LDR u16][meta luz u32][foto u8]
+// [dia i8][luz hoje u32][3 x (kp, ki, hist) i32][crc u16]
+#define CONFIG_SETORES 2
+#define CONFIG_OFFSET (FLASH_LOG_OFFSET - CONFIG_SETORES * FLASH_SECTOR_SIZE)
+#define CONFIG_PAGINAS (CONFIG_SETORES * FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define CONFIG_MAGIC 0x45534301u // "ESC" + versão do formato
+#define CONFIG_REG_BYTES 62
+#define CONFIG_LUZ_OFFSET 19     // Início de [dia][luz hoje]: fora da comparação de configuração
+#define CONFIG_MALHAS_OFFSET 24
+#define CONFIG_ATRASO_S 2
+#define CONFIG_LUZ_PERIODO_S 300 // Dia inteiro com luz: ~18 apagamentos de setor por dia
+
+static uint8_t g_config_pagina[FLASH_PAGE_SIZE]; // Último registro gravado (ou restaurado)
+static uint32_t g_config_seq = 0;
+static uint32_t g_config_proxima = 0;            // Próxima página da área de configuração
+volatile uint32_t g_config_gravacoes = 0;
+volatile uint32_t g_config_falhas = 0;           // flash_executa sem sucesso (registro anterior mantido)
+
+static inline const uint8_t *config_flash(uint32_t pagina) {
+    return (const uint8_t *)(XIP_BASE + CONFIG_OFFSET + pagina * FLASH_PAGE_SIZE);
+}
+
+static bool config_registro_valido(const uint8_t *r) {
+    return le_u32(r) == CONFIG_MAGIC
+        && crc16(r, CONFIG_REG_BYTES - 2) == (uint16_t)((r[CONFIG_REG_BYTES - 2] << 8) | r[CONFIG_REG_BYTES - 1]);
+}
+
+/**
+ * @brief Monta o registro com o estado atual (página inteira, sobra em 0xFF).
+ */
+static void config_monta(uint8_t *r, uint32_t seq) {
+    memset(r, 0xFF, FLASH_PAGE_SIZE);
+    escreve_u32(&r[0], CONFIG_MAGIC);
+    escreve_u32(&r[4], seq);
+    uint16_t umid = g_umidade_setpoint_cp, temp = (uint16_t)g_temp_setpoint_cc, ldr = g_ldr_limiar_raw;
+    r[8] = umid >> 8; r[9] = umid & 0xFF;
+    r[10] = temp >> 8; r[11] = temp & 0xFF;
+    r[12] = ldr >> 8; r[13] = ldr & 0xFF;
+    escreve_u32(&r[14], g_meta_luz_segundos);
+    r[CONFIG_LUZ_OFFSET - 1] = g_fotoperiodo_ativo;
+    r[CONFIG_LUZ_OFFSET] = (uint8_t)g_dia_atual;
+    escreve_u32(&r[CONFIG_LUZ_OFFSET + 1], g_segundos_de_luz_hoje);
+    for (int a = 0; a < ATUADOR_TOTAL; a++) {
+        uint8_t *m = &r[CONFIG_MALHAS_OFFSET + 12 * a];
+        escreve_u32(&m[0], (uint32_t)g_malhas[a].kp);
+        escreve_u32(&m[4], (uint32_t)g_malhas[a].ki);
+        escreve_u32(&m[8], (uint32_t)g_malhas[a].hist);
+    }
+    uint16_t crc = crc16(r, CONFIG_REG_BYTES - 2);
+    r[CONFIG_REG_BYTES - 2] = crc >> 8; r[CONFIG_REG_BYTES - 1] = crc & 0xFF;
+}
+
+/**
+ * @brief Restaura o registro mais recente. Chamada no boot, antes da E/S e do timer.
+ * Sem registro válido (placa nova ou formato antigo) ficam os valores compilados.
+ * @return true se algum registro foi restaurado
+ */
+bool config_init() {
+    bool achou = false;
+    uint32_t pagina = 0;
+    for (uint32_t pg = 0; pg < CONFIG_PAGINAS; pg++) {
+        const uint8_t *r = config_flash(pg);
+        if (!config_registro_valido(r)) continue;
+        uint32_t seq = le_u32(&r[4]);
+        if (!achou || seq > g_config_seq) { g_config_seq = seq; pagina = pg; achou = true; }
+    }
+    g_config_proxima = achou ? (pagina + 1) % CONFIG_PAGINAS : 0;
+    // Página seguinte suja (gravação interrompida): continua no início do outro setor
+    uint32_t por_setor = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+    const uint8_t *prox = config_flash(g_config_proxima);
+    bool apagada = true;
+    for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) if (prox[i] != 0xFF) apagada = false;
+    if (g_config_proxima % por_setor != 0 && !apagada)
+        g_config_proxima = (g_config_proxima / por_setor + 1) * por_setor % CONFIG_PAGINAS;
+    if (!achou) {
+        config_monta(g_config_pagina, 0); // Referência para detectar a primeira mudança
+        return false;
+    }
+
+    const uint8_t *r = config_flash(pagina);
+    memcpy(g_config_pagina, r, FLASH_PAGE_SIZE);
+    g_umidade_setpoint_cp = (uint16_t)((r[8] << 8) | r[9]);
+    g_temp_setpoint_cc = (int16_t)((r[10] << 8) | r[11]);
+    g_ldr_limiar_raw = (uint16_t)((r[12] << 8) | r[13]);
+    g_meta_luz_segundos = le_u32(&r[14]);
+    g_fotoperiodo_ativo = r[CONFIG_LUZ_OFFSET - 1] != 0;
+    // Dia salvo junto da dose: se o SET,TIME mostrar outro dia, a dose zera na virada normal
+    g_dia_atual = (int8_t)r[CONFIG_LUZ_OFFSET];
+    g_segundos_de_luz_hoje = le_u32(&r[CONFIG_LUZ_OFFSET + 1]);
+    g_dia_uptime_s = 0; // Sem RTC, a dose restaurada dura no máximo mais DIA_SEM_RTC_S
+    for (int a = 0; a < ATUADOR_TOTAL; a++) {
+        const uint8_t *m = &r[CONFIG_MALHAS_OFFSET + 12 * a];
+        g_malhas[a].kp = (int32_t)le_u32(&m[0]);
+        g_malhas[a].ki = (int32_t)le_u32(&m[4]);
+        g_malhas[a].hist = (int32_t)le_u32(&m[8]);
+    }
+    return true;
+}
+
+static void config_grava() {
+    static uint8_t pagina[FLASH_PAGE_SIZE];
+    config_monta(pagina, g_config_seq + 1);
+    log_op_t op = { CONFIG_OFFSET + g_config_proxima * FLASH_PAGE_SIZE, pagina }; // Apaga ao entrar no setor
+    if (flash_executa(&op) != PICO_OK) {
+        g_config_falhas++; // Tenta de novo no próximo segundo
+        return;
+    }
+    g_config_seq++;
+    g_config_proxima = (g_config_proxima + 1) % CONFIG_PAGINAS;
+    g_config_gravacoes++;
+    memcpy(g_config_pagina, pagina, FLASH_PAGE_SIZE);
+}
+
+/**
+ * @brief Grava o registro quando a configuração mudou ou a dose andou (núcleo 0, a cada segundo).
+ */
+void tarefa_config() {
+    static uint32_t mudou_s = 0, luz_s = 0;
+    if (!evento_consome(EVT_SEGUNDO_CONFIG)) return;
+    uint8_t atual[FLASH_PAGE_SIZE];
+    config_monta(atual, g_config_seq);
+    bool config = memcmp(&atual[8], &g_config_pagina[8], CONFIG_LUZ_OFFSET - 8) != 0
+               || memcmp(&atual[CONFIG_MALHAS_OFFSET], &g_config_pagina[CONFIG_MALHAS_OFFSET], 12 * ATUADOR_TOTAL) != 0;
+    bool luz = memcmp(&atual[CONFIG_LUZ_OFFSET], &g_config_pagina[CONFIG_LUZ_OFFSET], 5) != 0;
+    mudou_s = config ? mudou_s + 1 : 0;
+    luz_s = luz ? luz_s + 1 : 0;
+    if (mudou_s >= CONFIG_ATRASO_S || luz_s >= CONFIG_LUZ_PERIODO_S) {
+        config_grava();
+        mudou_s = luz_s = 0;
+    }
+}
+
+// --- Tabela de Parâmetros (compartilhada pelos caminhos binário e ASCII) ---
+// O índice é o ID usado em SET_PARAM/BATCH; o nome é o usado em "SET,<NOME>,<VALOR>".
+#define PARAM_HUMID 0x01
+#define PARAM_TEMP 0x02
+#define PARAM_LDR 0x03
+#define PARAM_FOTO 0x04
+#define PARAM_META_LUZ 0x05
+#define PARAM_TELEM_HZ 0x06
+#define PARAM_TELEM_LOTE 0x07
+#define PARAM_BAUD 0x08
+#define PARAM_TEMP_C 0x09     // Centésimos de °C
+#define PARAM_HUMID_PCT 0x0A  // Centésimos de %
+#define PARAM_FAN_KP 0x0B     // Malhas PI: ganhos e histerese (ver GANHO_ESCALA_*)
+#define PARAM_FAN_KI 0x0C
+#define PARAM_FAN_HIST 0x0D
+#define PARAM_PUMP_KP 0x0E
+#define PARAM_PUMP_KI 0x0F
+#define PARAM_PUMP_HIST 0x10
+#define PARAM_LED_KP 0x11
+#define PARAM_LED_KI 0x12
+#define PARAM_LED_HIST 0x13
+#define PARAM_TIME 0x14       // Hora local em segundos desde 1970 (acerta o RTC)
+#define PARAM_TELEM_DELTA 0x15 // 1 = lotes no formato compacto (PROTO_TIPO_DELTA)
+#define PARAM_ADAPT 0x16      // 1 = taxa adaptativa (batimento / 1 s / rajada)
+#define PARAM_TOTAL 0x17
+
+typedef struct {
+    const char *nome;
+    bool (*aplica)(uint32_t valor); // false = valor rejeitado
+    uint8_t id_extra;               // Parâmetro que recebe o 2º valor ASCII (0 = nenhum)
+} parametro_t;
+
+// HUMID/TEMP aceitam o ADC cru (compatibilidade) e viram setpoint físico pela tabela
+static bool set_humid(uint32_t v) { if (v > 4095) return false; g_umidade_setpoint_cp = umidade_cp_de_adc((uint16_t)v); return true; }
+static bool set_temp(uint32_t v) {
+    if (v > 4095) return false;
+    int16_t cc = temp_cc_de_adc((uint16_t)v);
+    if (cc == TEMP_CC_INVALIDA) return false;
+    g_temp_setpoint_cc = cc;
+    return true;
+}
+static bool set_temp_c(uint32_t v) { // Centésimos de °C em complemento de 2
+    int32_t cc = (int32_t)v;
+    if (cc < TEMP_SETPOINT_MIN_CC || cc > TEMP_SETPOINT_MAX_CC) return false;
+    g_temp_setpoint_cc = (int16_t)cc;
+    return true;
+}
+static bool set_humid_pct(uint32_t v) { if (v > UMIDADE_MAX_CP) return false; g_umidade_setpoint_cp = (uint16_t)v; return true; }
+
+#define SET_MALHA(nome, atuador, campo, maximo) \
+    static bool nome(uint32_t v) { if (v > (maximo)) return false; g_malhas[atuador].campo = (int32_t)v; return true; }
+SET_MALHA(set_fan_kp, ATUADOR_VENTILADOR, kp, GANHO_MAX)
+SET_MALHA(set_fan_ki, ATUADOR_VENTILADOR, ki, GANHO_MAX)
+SET_MALHA(set_fan_hist, ATUADOR_VENTILADOR, hist, HIST_MAX)
+SET_MALHA(set_pump_kp, ATUADOR_BOMBA, kp, GANHO_MAX)
+SET_MALHA(set_pump_ki, ATUADOR_BOMBA, ki, GANHO_MAX)
+SET_MALHA(set_pump_hist, ATUADOR_BOMBA, hist, HIST_MAX)
+SET_MALHA(set_led_kp, ATUADOR_LED, kp, GANHO_MAX)
+SET_MALHA(set_led_ki, ATUADOR_LED, ki, GANHO_MAX)
+SET_MALHA(set_led_hist, ATUADOR_LED, hist, HIST_MAX)
+static bool set_ldr(uint32_t v) { if (v > 4095) return false; g_ldr_limiar_raw = (uint16_t)v; return true; }
+static bool set_foto(uint32_t v) { g_fotoperiodo_ativo = (v == 1); return true; }
+static bool set_meta_luz(uint32_t v) { g_meta_luz_segundos = v; return true; }
+static bool set_telem_hz(uint32_t v) {
+    g_telem_manual = (v != 0);
+    if (g_taxa_modo == TAXA_RAJADA) g_taxa_modo = TAXA_NORMAL; // A rajada em curso deixa de ser do modo adaptativo
+    telemetria_configura(v, g_telem_lote);
+    return true;
+}
+static bool set_telem_lote(uint32_t v) { telemetria_configura(g_telem_hz, v); return true; }
+static bool set_adapt(uint32_t v) {
+    if (v > 1) return false;
+    if (g_taxa_modo == TAXA_RAJADA) telemetria_configura(0, g_adapt_lote_salvo);
+    g_taxa_modo = TAXA_FIXA;
+    g_adapt_quieto_s = ADAPT_RAJADA_S; // Começa no pacote de 1 s, sem rajada
+    g_adapt_relato_s = 0;
+    g_adapt_ativo = (v == 1);
+    return true;
+}
+static bool set_telem_delta(uint32_t v) {
+    if (v > 1) return false;
+    g_telem_delta = (v == 1);
+    telemetria_configura(g_telem_hz, g_telem_lote); // Reinicia o fluxo no formato novo
+    return true;
+}
+static bool set_baud(uint32_t v) {
+    if (!baud_valido(v)) return false;
+    g_baud_pendente = v;
+    return true;
+}
+
+static const parametro_t g_parametros[PARAM_TOTAL] = {
+    [PARAM_HUMID]      = {"HUMID", set_humid, 0},
+    [PARAM_TEMP]       = {"TEMP", set_temp, 0},
+    [PARAM_LDR]        = {"LDR", set_ldr, 0},
+    [PARAM_FOTO]       = {"FOTO", set_foto, 0},
+    [PARAM_META_LUZ]   = {"META_LUZ", set_meta_luz, 0},
+    [PARAM_TELEM_HZ]   = {"TELEM", set_telem_hz, PARAM_TELEM_LOTE}, // SET,TELEM,<hz>,<lote>
+    [PARAM_TELEM_LOTE] = {"TELEM_LOTE", set_telem_lote, 0},
+    [PARAM_BAUD]       = {"BAUD", set_baud, 0},
+    [PARAM_TEMP_C]     = {"TEMP_C", set_temp_c, 0},
+    [PARAM_HUMID_PCT]  = {"HUMID_PCT", set_humid_pct, 0},
+    [PARAM_FAN_KP]     = {"FAN_KP", set_fan_kp, PARAM_FAN_KI}, // SET,FAN_KP,<kp>,<ki>
+    [PARAM_FAN_KI]     = {"FAN_KI", set_fan_ki, 0},
+    [PARAM_FAN_HIST]   = {"FAN_HIST", set_fan_hist, 0},
+    [PARAM_PUMP_KP]    = {"PUMP_KP", set_pump_kp, PARAM_PUMP_KI},
+    [PARAM_PUMP_KI]    = {"PUMP_KI", set_pump_ki, 0},
+    [PARAM_PUMP_HIST]  = {"PUMP_HIST", set_pump_hist, 0},
+    [PARAM_LED_KP]     = {"LED_KP", set_led_kp, PARAM_LED_KI},
+    [PARAM_LED_KI]     = {"LED_KI", set_led_ki, 0},
+    [PARAM_LED_HIST]   = {"LED_HIST", set_led_hist, 0},
+    [PARAM_TIME]       = {"TIME", relogio_define, 0},
+    [PARAM_TELEM_DELTA] = {"TELEM_DELTA", set_telem_delta, 0},
+    [PARAM_ADAPT]      = {"ADAPT", set_adapt, 0},
+};
+
+/**
+ * @brief Aplica um parâmetro pelo ID.
+ */
+bool parametro_aplica(uint8_t id, uint32_t valor) {
+    if (id == 0 || id >= PARAM_TOTAL || g_parametros[id].aplica == NULL) return false;
+    if (!g_parametros[id].aplica(valor)) return false;
+    evento_posta(EVT_CONTROLE); // Setpoint novo vale já, sem esperar a próxima amostra
+    return true;
+}
+
+static void reset_timer_luz() { g_pedido_reset_luz = true; } // Aplicado no próximo tick do timer
+
+// --- Comandos Binários (Caminho Rápido) ---
+// Quadro do host: 0x00 COBS([versão][opcode][seq u16][args...][CRC16]) 0x00.
+// Toda execução responde com PROTO_TIPO_ACK: [seq u16][opcode][status].
+#define OP_SET_PARAM 0x10   // args: [id u8][valor u32]
+#define OP_RESET_TIMER 0x11 // args: nenhum
+#define OP_BATCH 0x12       // args: [n u8][n x (id u8, valor u32)]
+#define OP_GET_STATS 0x13   // args: [zerar u8] (opcional); responde com quadros STATS/CONTADORES
+#define OP_GET_BACKLOG 0x14 // args: [desde u32] (opcional); responde com quadros BACKLOG
+#define OP_PRIMEIRO OP_SET_PARAM
+#define OP_TOTAL 5
+
+#define ACK_OK 0x00
+#define ACK_OPCODE_INVALIDO 0x01
+#define ACK_PARAM_INVALIDO 0x02
+#define ACK_TAMANHO_INVALIDO 0x03
+#define ACK_VERSAO_INVALIDA 0x04
+
+static uint8_t op_set_param(const uint8_t *args, uint32_t len) {
+    if (len != 5) return ACK_TAMANHO_INVALIDO;
+    return parametro_aplica(args[0], le_u32(&args[1])) ? ACK_OK : ACK_PARAM_INVALIDO;
+}
+
+static uint8_t op_reset_timer(const uint8_t *args, uint32_t len) {
+    (void)args;
+    if (len != 0) return ACK_TAMANHO_INVALIDO;
+    reset_timer_luz();
+    return ACK_OK;
+}
+
+static uint8_t op_batch(const uint8_t *args, uint32_t len) {
+    if (len < 1 || len != 1u + 5u * args[0]) return ACK_TAMANHO_INVALIDO;
+    uint8_t status = ACK_OK;
+    for (uint8_t i = 0; i < args[0]; i++) {
+        const uint8_t *item = &args[1 + 5 * i];
+        if (!parametro_aplica(item[0], le_u32(&item[1]))) status = ACK_PARAM_INVALIDO; // Aplica os demais
+    }
+    return status;
+}
+
+static uint8_t op_get_stats(const uint8_t *args, uint32_t len) {
+    if (len > 1) return ACK_TAMANHO_INVALIDO;
+    perf_envia_stats();
+    if (len == 1 && args[0]) perf_zera();
+    return ACK_OK;
+}
+
+static uint8_t op_get_backlog(const uint8_t *args, uint32_t len) {
+    if (len != 0 && len != 4) return ACK_TAMANHO_INVALIDO;
+    backlog_inicia(len == 4 ? le_u32(args) : 0);
+    return ACK_OK; // Os blocos saem pelo tarefa_io, depois do ACK
+}
+
+typedef uint8_t (*comando_binario_t)(const uint8_t *args, uint32_t len);
+static const comando_binario_t g_comandos_binarios[OP_TOTAL] = {
+    op_set_param,   // OP_SET_PARAM
+    op_reset_timer, // OP_RESET_TIMER
+    op_batch,       // OP_BATCH
+    op_get_stats,   // OP_GET_STATS
+    op_get_backlog, // OP_GET_BACKLOG
+};
+
+/**
+ * @brief Valida (COBS + CRC16), despacha pela tabela de opcodes e envia o ACK.
+ * Quadros corrompidos não recebem ACK: o host reenvia por timeout.
+ */
+void processa_quadro_binario(const uint8_t *quadro, uint32_t len) {
+    uint8_t carga[RX_BUFFER_SIZE];
+    int n = cobs_decodifica(quadro, len, carga, sizeof(carga));
+    if (n < PROTO_CABECALHO + 2) return;
+    uint16_t crc = (uint16_t)((carga[n - 2] << 8) | carga[n - 1]);
+    if (crc16(carga, (uint32_t)n - 2) != crc) return;
+
+    uint8_t opcode = carga[1];
+    uint8_t status;
+    if (carga[0] != PROTO_VERSAO) {
+        status = ACK_VERSAO_INVALIDA;
+    } else if (opcode < OP_PRIMEIRO || opcode >= OP_PRIMEIRO + OP_TOTAL) {
+        status = ACK_OPCODE_INVALIDO;
+    } else {
+        status = g_comandos_binarios[opcode - OP_PRIMEIRO](&carga[PROTO_CABECALHO], (uint32_t)n - PROTO_CABECALHO - 2);
+    }
+
+    uint8_t ack[4] = {carga[2], carga[3], opcode, status}; // Ecoa a seq do comando
+    proto_envia(PROTO_TIPO_ACK, ack, sizeof(ack));
+}
+
+/**
+ * @brief Interpretador de Comandos ASCII (compatibilidade)
+ * Formato esperado: "SET,<NOME>,<VALOR>[,<VALOR2>]", "RESET,TIMER_LUZ", "GET,STATS[,1]"
+ * ou "GET,BACKLOG[,<desde>]".
+ * Uma única passada separa o nome; o valor sai da tabela de parâmetros. O valor
+ * principal é aplicado antes do extra (SET,TELEM,<hz>,<lote> já reconfigura na taxa
+ * nova). Sem ACK neste caminho, um SET recusado conta em g_rx_comandos_rejeitados.
+ */
+void processa_comando_texto(const char *cmd) {
+    if (strncmp(cmd, "SET,", 4) == 0) {
+        const char *nome = cmd + 4;
+        const char *virgula = strchr(nome, ',');
+        if (virgula == NULL) { g_rx_comandos_rejeitados++; return; }
+        size_t tam = (size_t)(virgula - nome);
+
+        for (uint8_t id = 1; id < PARAM_TOTAL; id++) {
+            const parametro_t *p = &g_parametros[id];
+            if (strlen(p->nome) != tam || strncmp(p->nome, nome, tam) != 0) continue;
+
+            char *fim;
+            uint32_t valor = (uint32_t)strtoul(virgula + 1, &fim, 10);
+            bool ok = parametro_aplica(id, valor);
+            if (ok && *fim == ',' && p->id_extra != 0) {
+                ok = parametro_aplica(p->id_extra, (uint32_t)strtoul(fim + 1, NULL, 10));
+            }
+            if (!ok) g_rx_comandos_rejeitados++;
+            return;
+        }
+        g_rx_comandos_rejeitados++; // Nome fora da tabela
+    }
+    else if (strncmp(cmd, "RESET,TIMER_LUZ", 15) == 0) {
+        reset_timer_luz();
+    }
+    else if (strncmp(cmd, "GET,STATS", 9) == 0) {
+        perf_envia_stats();
+        if (strcmp(cmd + 9, ",1") == 0) perf_zera(); // GET,STATS,1 zera após enviar
+    }
+    else if (strncmp(cmd, "GET,BACKLOG", 11) == 0) {
+        backlog_inicia(cmd[11] == ',' ? (uint32_t)strtoul(cmd + 12, NULL, 10) : 0);
+    }
+}
+
+/**
+ * @brief Interpretador de Comandos
+ * Encaminha cada entrada da fila para o caminho binário ou ASCII.
+ */
+void processa_comando(const rx_linha_t *linha) {
+    uint32_t t0 = perf_inicio();
+    if (linha->binario) processa_quadro_binario((const uint8_t*)linha->dados, linha->len);
+    else processa_comando_texto(linha->dados);
+    perf_fim(SECAO_COMANDO, t0);
+}
+
+// --- Tarefas do Loop Principal ---
+
+/**
+ * @brief Configura UART, interrupção de RX, DMA de TX e a pilha USB.
+ * Deve rodar no núcleo que fará a E/S: irq_set_enabled() vale para o núcleo chamador
+ * (a IRQ da USB também fica no núcleo que chama tusb_init()).
+ */
+void io_init() {
+    uart_init(UART_ID, BAUD_RATE);
+    gpio_set_function(UART_TX_PIN, GPIO_FUNC_UART);
+    gpio_set_function(UART_RX_PIN, GPIO_FUNC_UART);
+    
+    // Habilita interrupção de RX para não travar a CPU esperando dados
+    irq_set_exclusive_handler(UART0_IRQ, on_uart_rx);
+    irq_set_enabled(UART0_IRQ, true);
+    uart_set_irq_enables(UART_ID, true, false);
+
+    // Telemetria sai pela fila com DMA (sem uart_write_blocking no loop)
+    tx_dma_init();
+
+#if TRANSPORTE_USB
+    // CDC na USB nativa; vira o enlace ativo quando o host abre a porta
+    tusb_init();
+#endif
+}
+
+/**
+ * @brief Comandos recebidos, troca de baud e telemetria (lotes e pacote de 1 s).
+ * Só faz trabalho para os eventos pendentes.
+ */
+void tarefa_io() {
+    uint8_t packet[36];
+
+#if TRANSPORTE_USB
+    // Pilha USB (enumeração, DTR e FIFOs do CDC) e bytes recebidos pela USB
+    tud_task();
+    usb_rx();
+#endif
+
+    // 1. Processamento de Comandos (Prioridade)
+    // Esvazia a fila: vários comandos podem ter chegado em sequência
+    if (evento_consome(EVT_COMANDO)) {
+        const rx_linha_t *linha;
+        while ((linha = fila_rx_frente()) != NULL) {
+            processa_comando(linha);
+            fila_rx_libera();
+        }
+    }
+
+    // 2. Telemetria (Envio Não-Bloqueante)
+    // Modo alta taxa: despacha os lotes completos assim que ficam prontos
+    if (evento_consome(EVT_LOTE)) {
+        uint32_t t0 = perf_inicio();
+        telemetria_envia_lotes();
+        perf_fim(SECAO_TELEMETRIA, t0);
+    }
+
+    // Troca de baud só com a fila vazia (resta no máximo o FIFO da UART; não afeta a USB)
+    evento_consome(EVT_TX_VAZIA);
+    if (g_baud_pendente != 0 && g_tx_cabeca == g_tx_cauda) {
+        uart_tx_wait_blocking(UART_ID);
+        uart_set_baudrate(UART_ID, g_baud_pendente);
+        g_baud_pendente = 0;
+    }
+
+    // Descarga do log em flash (GET,BACKLOG): preenche a fila de TX aos blocos
+    if (g_backlog.ativo) backlog_continua();
+
+    // Anomalias antes do pacote de 1 s: as bordas saem no mesmo segundo em qualquer modo de taxa
+    bool segundo = evento_consome(EVT_SEGUNDO_IO);
+    if (segundo) {
+        anomalia_avalia();
+        anomalia_relata();
+    }
+
+    // Modo padrão: envia estado atual a cada 1 segundo (tick do timer de amostragem);
+    // no modo adaptativo, a cada ADAPT_BATIMENTO_S com sinais parados ou nunca durante a rajada
+    if (segundo && adapt_segundo()) {
+        uint32_t t0 = perf_inicio();
+
+        // Montagem dos dados de telemetria (Big Endian)
+        // Divide uint16_t/uint32_t em bytes individuais para transporte serial
+        packet[0] = (g_ldr_filtrado >> 8) & 0xFF;
+        packet[1] = g_ldr_filtrado & 0xFF;
+        packet[2] = (g_ntc_filtrado >> 8) & 0xFF;
+        packet[3] = g_ntc_filtrado & 0xFF;
+        packet[4] = (g_umidade_filtrada >> 8) & 0xFF;
+        packet[5] = g_umidade_filtrada & 0xFF;
+        packet[6] = g_duty_permil[ATUADOR_LED] > 0 ? 1 : 0;
+        // Tempo de luz (32 bits = 4 bytes)
+        packet[7] = (g_segundos_de_luz_hoje >> 24) & 0xFF;
+        packet[8] = (g_segundos_de_luz_hoje >> 16) & 0xFF;
+        packet[9] = (g_segundos_de_luz_hoje >> 8) & 0xFF;
+        packet[10] = g_segundos_de_luz_hoje & 0xFF;
+        // Unidades físicas em centésimos (o host não refaz a conversão)
+        uint16_t temp = (uint16_t)g_temp_cc, umid = g_umidade_cp;
+        packet[11] = temp >> 8; packet[12] = temp & 0xFF;
+        packet[13] = umid >> 8; packet[14] = umid & 0xFF;
+        for (int a = 0; a < ATUADOR_TOTAL; a++) { // Duty (‰): ventilador, bomba, LED
+            packet[15 + 2 * a] = g_duty_permil[a] >> 8;
+            packet[16 + 2 * a] = g_duty_permil[a] & 0xFF;
+        }
+        escreve_u32(&packet[21], g_id_dispositivo);
+        escreve_u64(&packet[25], g_segundo_us); // Relógio do dispositivo: o host corrige para o de parede
+        uint16_t periodo_s = adapt_periodo_s();
+        packet[33] = (uint8_t)g_taxa_modo;
+        packet[34] = periodo_s >> 8; packet[35] = periodo_s & 0xFF;
+
+        // Enquadramento COBS + CRC16; retorna na hora e o DMA transmite.
+        // No modo alta taxa (g_telem_hz != 0) os lotes já carregam LED e luz acumulada.
+        proto_envia(PROTO_TIPO_TELEMETRIA, packet, sizeof(packet));
+        perf_fim(SECAO_TELEMETRIA, t0);
+    }
+
+#if TRANSPORTE_USB
+    // Com a USB ativa, o que foi enfileirado nesta volta sai pela FIFO do CDC
+    usb_tx_drena();
+#endif
+}
+
+static bool io_pendente() {
+#if TRANSPORTE_USB
+    if (usb_pendente()) return true;
+#endif
+    return g_eventos[EVT_COMANDO] || g_eventos[EVT_LOTE] || g_eventos[EVT_SEGUNDO_IO] || g_eventos[EVT_TX_VAZIA];
+}
+
+/**
+ * @brief Lógica de Controle (Atuadores)
+ * Baseado nos valores filtrados atualizados pelo Timer; roda a cada EVT_CONTROLE.
+ */
+void tarefa_controle() {
+    static uint32_t ultimo_ms = 0;
+    if (!evento_consome(EVT_CONTROLE)) return;
+
+    uint32_t agora_ms = to_ms_since_boot(get_absolute_time());
+    uint32_t dt_ms = agora_ms - ultimo_ms;
+    if (dt_ms > CONTROLE_DT_MAX_MS) dt_ms = CONTROLE_DT_MAX_MS;
+    ultimo_ms = agora_ms;
+
+    // Sensor de temperatura inválido (desconectado/curto) mantém o ventilador desligado
+    int16_t temp = g_temp_cc;
+    atuador_aplica(ATUADOR_VENTILADOR, malha_passo(&g_malhas[ATUADOR_VENTILADOR],
+                   (int32_t)temp - g_temp_setpoint_cc, dt_ms, temp != TEMP_CC_INVALIDA));
+    atuador_aplica(ATUADOR_BOMBA, malha_passo(&g_malhas[ATUADOR_BOMBA],
+                   (int32_t)g_umidade_setpoint_cp - g_umidade_cp, dt_ms, true));
+
+    // Lógica Complementar de Luz:
+    // Se o fotoperíodo está ativo e a meta diária não foi atingida, o LED
+    // complementa a luz natural na medida em que o LDR fica acima do limiar.
+    // Desliga se meta atingida ou fotoperíodo desativado.
+    bool luz_permitida = g_fotoperiodo_ativo && (g_segundos_de_luz_hoje < g_meta_luz_segundos);
+    atuador_aplica(ATUADOR_LED, malha_passo(&g_malhas[ATUADOR_LED],
+                   (int32_t)g_ldr_filtrado - g_ldr_limiar_raw, dt_ms, luz_permitida));
+}
+
+static bool controle_pendente() {
+    return g_eventos[EVT_CONTROLE] || g_eventos[EVT_SEGUNDO_CONTROLE] || g_eventos[EVT_SEGUNDO_LOG]
+        || g_eventos[EVT_SEGUNDO_CONFIG];
+}
+
+#if DUAL_CORE_IO
+// Incrementado a cada volta do loop do núcleo 1; o núcleo 0 só alimenta o
+// watchdog enquanto ele avança, então o travamento de qualquer núcleo reinicia.
+static volatile uint32_t g_core1_batimentos = 0;
+
+/**
+ * @brief Ponto de entrada do núcleo 1 (E/S)
+ * As IRQs de UART, DMA de TX e USB são habilitadas aqui para rodarem neste núcleo.
+ */
+void core1_main() {
+    perf_init_nucleo(); // SysTick é por núcleo
+    multicore_lockout_victim_init(); // Permite ao núcleo 0 pausar este núcleo ao gravar a flash
+    io_init();
+    while (1) {
+        tarefa_io();
+        g_core1_batimentos++;
+        if (!io_pendente()) __wfe(); // Dorme até uma ISR ou o outro núcleo postar evento
+    }
+}
+
+/**
+ * @brief Alimenta o watchdog se o núcleo 1 deu sinal de vida recentemente.
+ * O núcleo 1 acorda ao menos a cada EVT_SEGUNDO_IO, então 1,5 s dá folga à ordem dos núcleos.
+ */
+static void watchdog_tarefa() {
+    static uint32_t ultimo_batimento = 0;
+    static uint32_t ultimo_visto_ms = 0;
+    if (!evento_consome(EVT_SEGUNDO_CONTROLE)) return;
+    uint32_t agora = to_ms_since_boot(get_absolute_time());
+    if (g_core1_batimentos != ultimo_batimento) {
+        ultimo_batimento = g_core1_batimentos;
+        ultimo_visto_ms = agora;
+    }
+    if (agora - ultimo_visto_ms < 1500) watchdog_update();
+}
+#else
+static void watchdog_tarefa() {
+    if (evento_consome(EVT_SEGUNDO_CONTROLE)) watchdog_update();
+}
+#endif
+
+// --- MAIN ---
+// No build de simulação (sim/) o harness faz a inicialização e dirige o relógio.
+#ifndef ESTUFA_SIM
+int main() {
+    // 1. Inicialização de Periféricos
+    stdio_init_all(); 
+    perf_init_nucleo();
+    adc_init();
+    adc_gpio_init(PIN_ADC_0_LDR); adc_gpio_init(PIN_ADC_1_NTC); adc_gpio_init(PIN_ADC_2_UMIDADE);
+    
+    // Atuadores nos slices PWM (duty 0 até a primeira avaliação do controle)
+    atuadores_init();
+
+    // RTC parado até o primeiro SET,TIME (sem ele, o dia só vira por RESET,TIMER_LUZ)
+    rtc_init();
+
+    // ID antes da E/S: é o número de série do descritor USB
+    dispositivo_init();
+
+    // Setpoints, malhas e dose do dia gravados antes do reset: o controle já parte certo
+    // (antes da E/S, para um comando recebido no boot não ser sobrescrito)
+    config_init();
+
+    // 2. Configuração da UART e Interrupções (no núcleo que fará a E/S)
+#if DUAL_CORE_IO
+    multicore_launch_core1(core1_main);
+#else
+    io_init();
+#endif
+    
+    // Watchdog de 2 segundos para reinício automático em caso de travamento
+    watchdog_enable(2000, 1);
+
+    // Inicialização de variáveis e buffers
+    filtro_init();
+
+    // Retoma o log em flash depois do último registro gravado
+    flash_log_init();
+
+#if ADC_MODO_DMA
+    // Inicia a conversão contínua antes do timer para já haver blocos na 1ª coleta
+    adc_dma_init();
+#endif
+
+    // Inicializa timer recorrente (100ms) para leitura de sensores
+    repeating_timer_t timer;
+    add_repeating_timer_ms(-TIMER_ISR_INTERVAL_MS, timer_callback, NULL, &timer);
+
+    // --- Loop Principal (Orientado a Eventos) ---
+    while (1) {
+#if !DUAL_CORE_IO
+        tarefa_io();
+#endif
+        tarefa_controle();
+        tarefa_log();
+        tarefa_config();
+
+        // "Chuta" o watchdog indicando que o sistema está vivo
+        watchdog_tarefa();
+        
+        // Sem eventos pendentes: dorme em WFE até a próxima interrupção/SEV
+#if DUAL_CORE_IO
+        if (!controle_pendente()) __wfe();
+#else
+        if (!controle_pendente() && !io_pendente()) __wfe();
+#endif
+    }
+}
+#endif // ESTUFA_SIM
\ No newline at end of file
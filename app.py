@@ -10,32 +10,126 @@
 """
 
 import serial
+from serial.tools import list_ports
 import sqlite3
 import threading
+import selectors
+import queue
+from collections import deque
+from itertools import islice
 import struct
+import binascii
 import os
 import math 
+import numpy as np
 import google.generativeai as genai
 import time
 import pandas as pd
 import plotly.graph_objects as go
 import dash
 import dash_bootstrap_components as dbc
-from dash import dcc, html, Input, Output, State
+from dash import dcc, html, Input, Output, State, Patch
 import json
-from datetime import datetime
+import unicodedata
+from datetime import datetime, timezone, timedelta
 import logging
+try: # Opcional: sem pyarrow o arquivo em Parquet fica desligado
+    import pyarrow as pa
+    import pyarrow.parquet as pq
+    import pyarrow.dataset as ds
+except ImportError:
+    pa = None
 
 # =============================================================================
 # CONFIGURAÇÕES GERAIS E CONSTANTES
 # =============================================================================
 
-# Configuração da Porta Serial (Verificar no Gerenciador de Dispositivos)
-COM_PORT = 'COM12' 
+# Portas Seriais das estufas (Verificar no Gerenciador de Dispositivos)
+# Uma única thread atende todas; cada estufa se identifica pelo ID do quadro
+COM_PORTS = ['COM12']
 BAUD_RATE = 9600
+SERIAL_POLL_S = 0.005    # Varredura das portas no Windows (sem select() para seriais)
+SERIAL_RECONEXAO_S = 5   # Espera antes de reabrir uma porta que falhou
+SERIAL_BUF_MAX = 1024    # Bytes sem delimitador antes de descartar (ruído na linha)
+
+# Relógio do dispositivo -> relógio de parede. As amostras são datadas pelo time_us_64()
+# do firmware; o deslocamento é o menor atraso visto em cada janela (o quadro que
+# passou sem fila) e a deriva do cristal sai da reta pelos mínimos das últimas janelas.
+RELOGIO_JANELA_S = 30
+RELOGIO_JANELAS = 20         # ~10 min de histórico para a deriva
+RELOGIO_DERIVA_MAX = 500e-6  # Cristal do Pico: ±30 ppm; acima disso é ruído do ajuste
+
+# USB nativa do Pico (CDC do firmware, mesmo protocolo): portas detectadas sozinhas
+# pelo VID:PID e somadas a COM_PORTS; no USB o baud não limita a taxa
+SERIAL_AUTODETECTA_USB = True
+USB_VID = 0x2E8A # Raspberry Pi (USB_VID em Estufa.c)
+USB_PID = 0x000A # USB_PID em Estufa.c
+USB_PRODUTO = 'Estufa Inteligente'
 DB_FILE = 'minha_estufa.db'
 
-# Parâmetros de Calibração dos Sensores
+# Telemetria de Alta Taxa (0 = pacote padrão filtrado de 1 s)
+# Ex.: TELEM_HZ = 50 e TELEM_LOTE = 10 -> 5 quadros/s com 10 amostras cada
+TELEM_HZ = 0
+TELEM_LOTE = 10
+TELEM_BAUD = 115200
+TELEM_BAUD_ESPERA_S = 0.2 # Após o SET,BAUD: o firmware troca o baud quando a fila de TX esvaziar
+# Lotes compactos (deltas em varint, ~2x menos bytes por amostra): até 48 amostras por quadro
+TELEM_DELTA = False
+# Taxa adaptativa (com TELEM_HZ = 0): batimento a cada 10 s com sinais parados, rajada de
+# 50 Hz quando um sinal ou atuador muda (limiares ADAPT_* em Estufa.c)
+TAXA_ADAPTATIVA = False
+TAXA_MODOS = {0: 'fixa', 1: 'batimento', 2: 'normal', 3: 'rajada'} # taxa_modo_t em Estufa.c
+
+# Protocolo Binário (deve casar com PROTO_* em Estufa.c)
+PROTO_VERSAO = 1
+PROTO_TIPO_TELEMETRIA = 0x01
+PROTO_TIPO_LOTE = 0x02
+PROTO_TIPO_ACK = 0x03
+PROTO_TIPO_STATS = 0x04
+PROTO_TIPO_CONTADORES = 0x05
+PROTO_TIPO_BACKLOG = 0x06
+PROTO_TIPO_DELTA = 0x07
+DELTA_FLAG_LUZ = 0x01  # Cabeçalho do quadro compacto traz a luz acumulada
+DELTA_FLAG_DUTY = 0x02 # ... e os 3 duties
+PROTO_TIPO_ANOMALIA = 0x08 # Borda (início/fim) de uma anomalia detectada no firmware
+ANOMALIA_TIPOS = {0: 'faixa', 1: 'taxa', 2: 'sem resposta'} # anomalia_tipo_t em Estufa.c
+ANOMALIA_CANAIS = ['LDR', 'NTC', 'umidade']         # Origem das anomalias de faixa e de taxa
+ANOMALIA_ATUADORES = ['ventilador', 'bomba', 'LED'] # Origem das anomalias sem resposta
+
+# Comandos binários (opcodes) e IDs de parâmetro (tabela g_parametros do firmware)
+OP_SET_PARAM = 0x10
+OP_RESET_TIMER = 0x11
+OP_BATCH = 0x12
+OP_GET_STATS = 0x13
+OP_GET_BACKLOG = 0x14
+PARAM_HUMID = 0x01
+PARAM_TEMP = 0x02
+PARAM_LDR = 0x03
+PARAM_FOTO = 0x04
+PARAM_META_LUZ = 0x05
+PARAM_TELEM_HZ = 0x06
+PARAM_TELEM_LOTE = 0x07
+PARAM_BAUD = 0x08
+PARAM_TEMP_C = 0x09    # Centésimos de °C
+PARAM_HUMID_PCT = 0x0A # Centésimos de %
+TEMP_CC_INVALIDA = -32768 # Temperatura inválida reportada pelo firmware
+PARAM_FAN_KP, PARAM_FAN_KI, PARAM_FAN_HIST = 0x0B, 0x0C, 0x0D       # Malhas PI (ganhos e histerese)
+PARAM_PUMP_KP, PARAM_PUMP_KI, PARAM_PUMP_HIST = 0x0E, 0x0F, 0x10
+PARAM_LED_KP, PARAM_LED_KI, PARAM_LED_HIST = 0x11, 0x12, 0x13
+PARAM_TIME = 0x14 # Hora local (segundos desde 1970): acerta o RTC do firmware
+PARAM_TELEM_DELTA = 0x15 # 1 = lotes no formato compacto (PROTO_TIPO_DELTA)
+PARAM_ADAPT = 0x16       # 1 = taxa adaptativa
+ACK_STATUS = {0x00: "OK", 0x01: "opcode inválido", 0x02: "parâmetro inválido", 0x03: "tamanho inválido", 0x04: "versão inválida"}
+ACK_TIMEOUT_S = 0.5
+FLASH_LOG_PERIODO_S = 10 # Deve casar com FLASH_LOG_PERIODO_S em Estufa.c
+
+# Instrumentação do firmware (ordem = perf_secao_id_t em Estufa.c)
+PERF_SECOES = ["timer_callback", "on_uart_rx", "processa_comando", "telemetria", "on_adc_dma", "jitter do timer"]
+PERF_CONTADORES = ["quadros TX", "quadros TX descartados", "bytes TX", "eventos de pressão TX", "pico fila TX (bytes)", "linhas RX perdidas", "amostras perdidas",
+                   "comandos ASCII rejeitados", "falhas de gravação do log", "falhas de gravação da configuração"]
+
+# Parâmetros de Calibração dos Sensores (o firmware usa tabelas geradas com os
+# mesmos valores por tools/gera_tabelas.py; aqui só servem ao log em flash, que é cru)
 # NTC 10k: Beta 3950, resistor divisor de 10k
 R_FIXO_NTC = 10000.0
 R_NOMINAL_NTC = 10000.0
@@ -51,6 +145,39 @@ ADC_MAX = 4095.0
 V_IN = 3.3
 LDR_LIMIAR_FIXO = 2000
 
+# Ingestão no SQLite: as amostras ficam em memória e são gravadas numa única
+# transação a cada INGEST_LOTE_MAX amostras ou INGEST_INTERVALO_MS (o que vier primeiro)
+INGEST_LOTE_MAX = 500
+INGEST_INTERVALO_MS = 250
+INGEST_FILA_MAX = 50000 # Amostras pendentes antes de descartar (disco travado)
+# Cada leitura da serial vira um só bloco na fila: os lotes de um chunk são decodificados
+# com numpy (sem laço por amostra no Python) e seguem juntos para o gravador
+
+# Rollups (tabela, resolução em ms): min/max/média por canal, mantidos a cada lote gravado
+ROLLUPS = [('readings_1m', 60000), ('readings_15m', 900000), ('readings_1h', 3600000)]
+HISTORY_RAW_MAX_MS = 30 * 60000 # Janelas até 30 min leem as amostras cruas
+HISTORY_MAX_PONTOS = 2000       # Acima disso, sobe para o próximo rollup
+
+# Arquivo colunar: leituras cruas mais velhas que ARQUIVO_IDADE_DIAS saem do SQLite para
+# Parquet (zstd) particionado por estufa e dia (UTC); os rollups continuam no banco
+ARQUIVO_DIR = 'arquivo'
+ARQUIVO_IDADE_DIAS = 30    # 0 = desliga. Bem acima do log em flash (~45 h): o backlog acha as lacunas no SQLite
+ARQUIVO_INTERVALO_S = 3600
+ARQUIVO_LINHAS_MAX = 200000 # Linhas por arquivo (limita a memória de cada passada)
+
+# Cache em memória da janela ao vivo: a thread serial anexa, o dashboard só envia o que é novo
+LIVE_JANELA_MS = 600000 # 10 minutos no gráfico principal
+LIVE_CACHE_MAX = 60000  # Amostras guardadas (10 min a 100 Hz)
+LIVE_MAX_PONTOS = 3000  # Pontos mantidos no navegador por série (maxPoints do extendData)
+
+# Histórico longo no gráfico principal: lido dos rollups e reduzido por LTTB
+HISTORY_RANGES = {'1h': 3600000, '1d': 86400000, '1w': 7 * 86400000, '1m': 30 * 86400000}
+HISTORY_PONTOS_TRACO = 500 # Orçamento de pontos por série enviado ao navegador
+
+# Agrônomo virtual: respostas do Gemini guardadas no SQLite por planta (nome normalizado)
+IA_CACHE_TTL_DIAS = 30
+IA_POLL_MS = 500 # Intervalo com que o painel confere a consulta em andamento
+
 # =============================================================================
 # INTEGRAÇÃO COM IA (Google Gemini)
 # =============================================================================
@@ -62,6 +189,70 @@ except KeyError:
     print("Aviso: GOOGLE_API_KEY não encontrada. A IA não funcionará.")
     model = None
 
+IA_CAMPOS = ('umidade_ideal_percent', 'temperatura_ideal_celsius', 'fotoperiodo_horas')
+
+# Consultas fora do callback do Dash: a thread ia_worker chama a API e o painel
+# confere o resultado pelo intervalo 'ia-poll'. Uma planta já pedida não entra de novo na fila.
+ia_queue = queue.Queue()
+ia_lock = threading.Lock()
+ia_jobs = {} # chave -> {'estado': 'pendente' | 'ok' | 'erro', 'dados': dict, 'erro': str}
+
+def normaliza_planta(nome):
+    """Chave do cache: minúsculas, sem acentos e com espaços simples ("  Orquídea " -> "orquidea")."""
+    sem_acento = ''.join(c for c in unicodedata.normalize('NFKD', nome) if not unicodedata.combining(c))
+    return ' '.join(sem_acento.lower().split())
+
+def ia_cache_busca(chave):
+    """Setpoints já consultados para a planta, ou None se não há ou passaram de IA_CACHE_TTL_DIAS."""
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    row = con.execute("SELECT dados, criado_ms FROM ai_cache WHERE planta = ?", (chave,)).fetchone()
+    con.close()
+    if row is None or time.time() * 1000 - row[1] > IA_CACHE_TTL_DIAS * 86400000: return None
+    return json.loads(row[0])
+
+def ia_cache_grava(chave, dados):
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    with con:
+        con.execute("INSERT OR REPLACE INTO ai_cache VALUES (?, ?, ?)", (chave, json.dumps(dados), int(time.time() * 1000)))
+    con.close()
+
+def ia_consulta(plant):
+    """Pede ao Gemini o JSON estruturado com os parâmetros ideais e confere os campos."""
+    prompt = f"""Dados para {plant}: JSON {{ "umidade_ideal_percent": float, "temperatura_ideal_celsius": float, "fotoperiodo_horas": float, "descricao": string }}"""
+    resp = model.generate_content(prompt)
+    data = json.loads(resp.text.replace("```json","").replace("```",""))
+    dados = {campo: float(data[campo]) for campo in IA_CAMPOS}
+    dados['descricao'] = str(data.get('descricao', ''))
+    return dados
+
+def ia_pede(plant):
+    """
+    Retorna (chave, dados): dados vem do cache na hora; com None a consulta ficou
+    na fila (ou já estava em andamento) e o resultado aparece em ia_jobs[chave].
+    """
+    chave = normaliza_planta(plant)
+    dados = ia_cache_busca(chave)
+    if dados is not None: return chave, dados
+    with ia_lock:
+        job = ia_jobs.get(chave)
+        if job is None or job['estado'] != 'pendente':
+            ia_jobs[chave] = {'estado': 'pendente', 'dados': None, 'erro': None}
+            ia_queue.put_nowait((chave, plant))
+    return chave, None
+
+def ia_worker():
+    """Worker Thread: uma consulta por vez ao Gemini; o resultado vai para o cache e para ia_jobs."""
+    print(">>> Thread do Agrônomo Virtual Iniciada")
+    while True:
+        chave, plant = ia_queue.get()
+        try:
+            dados = ia_consulta(plant)
+            ia_cache_grava(chave, dados)
+            job = {'estado': 'ok', 'dados': dados, 'erro': None}
+        except Exception as e:
+            job = {'estado': 'erro', 'dados': None, 'erro': str(e)}
+        with ia_lock: ia_jobs[chave] = job
+
 # =============================================================================
 # FUNÇÕES DE FÍSICA E MATEMÁTICA (Conversão ADC -> Unidade Real)
 # =============================================================================
@@ -101,32 +292,25 @@ def calculate_humidity_percent(adc_raw):
     except: 
         return None
 
-def calculate_humidity_setpoint_raw(perc):
-    """Converte setpoint do usuário (%) para valor RAW esperado pelo MCU."""
-    try: 
-        return int(max(0, min(4095, HUMID_A * math.exp(HUMID_B * (perc / 100.0)))))
-    except: 
-        return 3000 
-
-def calculate_temp_setpoint_raw(temp_c):
-    """Converte setpoint do usuário (°C) para valor RAW esperado pelo MCU."""
-    try:
-        t_k = temp_c + 273.15
-        t0_k = TEMP_NOMINAL_C + 273.15
-        r_ntc = R_NOMINAL_NTC * math.exp(((1.0/t_k) - (1.0/t0_k)) * BETA_NTC)
-        v_out = (r_ntc * V_IN) / (R_FIXO_NTC + r_ntc)
-        return int(max(0, min(4095, (v_out * ADC_MAX) / V_IN)))
-    except: 
-        return 1600
+# As mesmas curvas tabeladas para cada contagem do ADC de 12 bits: converter vira indexar
+ADC_CONTAGENS = 4096
+TEMP_NTC_LUT = [calculate_temp_ntc(r) for r in range(ADC_CONTAGENS)]
+UMIDADE_LUT = [calculate_humidity_percent(r) for r in range(ADC_CONTAGENS)]
 
 # =============================================================================
 # CAMADA DE DADOS (SQLite)
 # =============================================================================
 
+def table_columns(con, table):
+    """Nomes das colunas de uma tabela (vazio se ela não existe)."""
+    return [r[1] for r in con.execute(f'PRAGMA table_info({table})')]
+
 def init_db():
     """Inicializa o esquema do banco de dados se não existir."""
     try:
         con = sqlite3.connect(DB_FILE)
+        # WAL: o gravador não bloqueia as leituras do dashboard (modo persiste no arquivo)
+        con.execute('PRAGMA journal_mode=WAL')
         con.execute('''
             CREATE TABLE IF NOT EXISTS readings (
                 id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -136,65 +320,957 @@ def init_db():
                 umidade_raw INTEGER, 
                 umidade_percent REAL,
                 led_status INTEGER, 
-                luz_acumulada_s INTEGER
+                luz_acumulada_s INTEGER,
+                device_id INTEGER NOT NULL DEFAULT 0
             )
         ''')
+        # Estufas já vistas (o seletor do dashboard lista também as desconectadas)
+        con.execute('CREATE TABLE IF NOT EXISTS devices (device_id INTEGER PRIMARY KEY, porta TEXT, visto_ms INTEGER)')
+        # Banco de uma estufa só (sem ID): as amostras antigas ficam no dispositivo 0
+        if 'device_id' not in table_columns(con, 'readings'):
+            con.execute('ALTER TABLE readings ADD COLUMN device_id INTEGER NOT NULL DEFAULT 0')
+            con.execute("INSERT OR IGNORE INTO devices SELECT 0, 'legado', (SELECT MAX(timestamp) FROM readings) "
+                        "WHERE EXISTS (SELECT 1 FROM readings)")
+        # Consultas por janela de tempo usam o índice em vez de varrer a tabela
+        con.execute('CREATE INDEX IF NOT EXISTS idx_readings_timestamp ON readings(timestamp)')
+        con.execute('CREATE INDEX IF NOT EXISTS idx_readings_device_ts ON readings(device_id, timestamp)')
+        # Bordas das anomalias detectadas no firmware (uma linha por início ou fim)
+        con.execute('''
+            CREATE TABLE IF NOT EXISTS events (
+                id INTEGER PRIMARY KEY AUTOINCREMENT,
+                device_id INTEGER NOT NULL,
+                timestamp INTEGER,
+                tipo TEXT,      -- faixa, taxa, sem resposta
+                origem TEXT,    -- Canal (LDR, NTC, umidade) ou atuador (ventilador, bomba, LED)
+                ativa INTEGER,  -- 1 = começou, 0 = terminou
+                valor INTEGER,  -- Leitura crua, variação em 1 s ou efeito do atuador
+                limiar INTEGER
+            )
+        ''')
+        con.execute('CREATE INDEX IF NOT EXISTS idx_events_device_ts ON events(device_id, timestamp)')
+        # Respostas do agrônomo virtual por planta (JSON já validado; validade pelo criado_ms)
+        con.execute('CREATE TABLE IF NOT EXISTS ai_cache (planta TEXT PRIMARY KEY, dados TEXT, criado_ms INTEGER)')
+        # Estado persistente do host (ex.: último seq descarregado do log em flash)
+        con.execute('CREATE TABLE IF NOT EXISTS meta (chave TEXT PRIMARY KEY, valor INTEGER)')
+        for table, res_ms in ROLLUPS:
+            # Rollup antigo (chave só por bucket): migra para (device_id, bucket) como dispositivo 0
+            legado = table_columns(con, table)
+            if legado and 'device_id' not in legado:
+                con.execute(f'ALTER TABLE {table} RENAME TO {table}_v1')
+            con.execute(f'''
+                CREATE TABLE IF NOT EXISTS {table} (
+                    device_id INTEGER,
+                    bucket INTEGER, -- Início do intervalo (ms)
+                    n INTEGER,
+                    ldr_min INTEGER, ldr_max INTEGER, ldr_sum INTEGER,
+                    temp_n INTEGER, temp_min REAL, temp_max REAL, temp_sum REAL,
+                    hum_n INTEGER, hum_min REAL, hum_max REAL, hum_sum REAL,
+                    led_sum INTEGER, luz_max INTEGER,
+                    PRIMARY KEY (device_id, bucket)
+                )
+            ''')
+            if legado and 'device_id' not in legado:
+                con.execute(f'INSERT INTO {table} SELECT 0, * FROM {table}_v1')
+                con.execute(f'DROP TABLE {table}_v1')
+            # Banco antigo sem rollups: reconstrói uma vez a partir das amostras cruas
+            if con.execute(f'SELECT 1 FROM {table} LIMIT 1').fetchone() is None:
+                con.execute(f'''
+                    INSERT INTO {table}
+                    SELECT device_id, (timestamp / {res_ms}) * {res_ms}, COUNT(*),
+                           MIN(ldr_raw), MAX(ldr_raw), SUM(ldr_raw),
+                           COUNT(temperature_c), MIN(temperature_c), MAX(temperature_c), SUM(temperature_c),
+                           COUNT(umidade_percent), MIN(umidade_percent), MAX(umidade_percent), SUM(umidade_percent),
+                           SUM(led_status), MAX(luz_acumulada_s)
+                    FROM readings GROUP BY 1, 2
+                ''')
         con.commit()
         con.close()
     except Exception as e: 
         print(f"Erro BD: {e}")
 
+# Linhas em toda a aplicação: (timestamp, ldr, temp_c, umid_raw, umid_pct, led, luz_s, device_id)
+INSERT_READING = "INSERT INTO readings (timestamp, ldr_raw, temperature_c, umidade_raw, umidade_percent, led_status, luz_acumulada_s, device_id) VALUES (?,?,?,?,?,?,?,?)"
+
+# Fila entre a thread serial (produtor) e o gravador (consumidor): blocos de linhas.
+# O limite é em amostras (ingest_stats['fila']), não em blocos.
+ingest_queue = queue.Queue()
+ingest_lock = threading.Lock()
+ingest_stats = {
+    'fila': 0, 'fila_pico': 0, 'gravadas': 0, 'descartadas': 0, 'lotes': 0,
+    'lote_ultimo': 0, 'flush_ms_ultimo': 0.0, 'flush_ms_medio': 0.0, 'flush_ms_max': 0.0,
+}
+
+def query_history(con, device, inicio_ms, fim_ms=None):
+    """
+    Histórico de uma estufa na resolução adequada à janela: amostras cruas para janelas curtas,
+    senão o rollup mais fino que caiba em HISTORY_MAX_PONTOS pontos.
+    Colunas: timestamp, ldr_raw, temperature_c, umidade_percent, led_status, luz_acumulada_s
+    (+ *_min/*_max quando vem de rollup, com as médias nas colunas principais).
+    """
+    fim_ms = int(time.time()*1000) if fim_ms is None else int(fim_ms)
+    inicio_ms = int(inicio_ms)
+    span = fim_ms - inicio_ms
+    if span <= HISTORY_RAW_MAX_MS:
+        df = pd.read_sql_query(
+            "SELECT timestamp, ldr_raw, temperature_c, umidade_percent, led_status, luz_acumulada_s "
+            "FROM readings WHERE device_id = ? AND timestamp > ? AND timestamp <= ? ORDER BY timestamp",
+            con, params=(device, inicio_ms, fim_ms))
+        if ARQUIVO_IDADE_DIAS > 0 and inicio_ms < int(time.time()*1000) - ARQUIVO_IDADE_DIAS * 86400000:
+            antigas = query_arquivo(device, inicio_ms, fim_ms, list(df.columns))
+            if len(antigas): df = pd.concat([antigas, df], ignore_index=True)
+        return df
+
+    table, res_ms = next(((t, r) for t, r in ROLLUPS if span // r <= HISTORY_MAX_PONTOS), ROLLUPS[-1])
+    return pd.read_sql_query(
+        f"SELECT bucket AS timestamp, CAST(ldr_sum AS REAL) / n AS ldr_raw, "
+        f"temp_sum / NULLIF(temp_n, 0) AS temperature_c, hum_sum / NULLIF(hum_n, 0) AS umidade_percent, "
+        f"CAST(led_sum AS REAL) / n AS led_status, luz_max AS luz_acumulada_s, "
+        f"ldr_min, ldr_max, temp_min, temp_max, hum_min, hum_max "
+        f"FROM {table} WHERE device_id = ? AND bucket >= ? AND bucket <= ? ORDER BY bucket",
+        con, params=(device, (inicio_ms // res_ms) * res_ms, fim_ms))
+
+# --- Arquivo em Parquet ---
+# arquivo/device_id=<ID>/dia=<AAAA-MM-DD>/part-<primeiro timestamp>-<rowid>.parquet. Contagens cruas
+# em int16 e físicas em float32; o nome do arquivo vem dos dados, então repetir uma passada
+# interrompida (arquivo escrito, DELETE não) sobrescreve o mesmo arquivo em vez de duplicar.
+ARQUIVO_COLUNAS = ['timestamp', 'ldr_raw', 'temperature_c', 'umidade_raw', 'umidade_percent', 'led_status', 'luz_acumulada_s']
+if pa is not None:
+    ARQUIVO_SCHEMA = pa.schema([
+        ('timestamp', pa.int64()), ('ldr_raw', pa.int16()), ('temperature_c', pa.float32()),
+        ('umidade_raw', pa.int16()), ('umidade_percent', pa.float32()), ('led_status', pa.int8()),
+        ('luz_acumulada_s', pa.int32()),
+    ])
+    ARQUIVO_PARTICOES = ds.partitioning(pa.schema([('device_id', pa.int64()), ('dia', pa.string())]), flavor='hive')
+
+def dia_utc(ts_ms):
+    return datetime.fromtimestamp(ts_ms / 1000, timezone.utc).strftime('%Y-%m-%d')
+
+def arquiva_antigas(agora_ms=None):
+    """
+    Move para o arquivo as leituras cruas mais velhas que ARQUIVO_IDADE_DIAS, um (estufa, dia)
+    por vez: grava o Parquet (nome temporário + rename) e só então apaga as linhas do SQLite.
+    Retorna quantas linhas foram movidas.
+    """
+    agora_ms = int(time.time()*1000) if agora_ms is None else agora_ms
+    corte = agora_ms - ARQUIVO_IDADE_DIAS * 86400000
+    con = sqlite3.connect(DB_FILE, timeout=30)
+    movidas = 0
+    try:
+        while True:
+            r = con.execute("SELECT device_id, timestamp FROM readings WHERE timestamp < ? ORDER BY timestamp LIMIT 1",
+                            (corte,)).fetchone()
+            if r is None: break
+            device, ts0 = r
+            dia = dia_utc(ts0)
+            dia_fim = int((datetime.strptime(dia, '%Y-%m-%d').replace(tzinfo=timezone.utc) + timedelta(days=1)).timestamp() * 1000)
+            linhas = con.execute(
+                f"SELECT rowid, {', '.join(ARQUIVO_COLUNAS)} FROM readings "
+                "WHERE device_id = ? AND timestamp >= ? AND timestamp < ? ORDER BY timestamp LIMIT ?",
+                (device, ts0, min(dia_fim, corte), ARQUIVO_LINHAS_MAX)).fetchall()
+            rowids, *colunas = zip(*linhas)
+            tabela = pa.table(dict(zip(ARQUIVO_COLUNAS, colunas)), schema=ARQUIVO_SCHEMA)
+            pasta = os.path.join(ARQUIVO_DIR, f'device_id={device}', f'dia={dia}')
+            os.makedirs(pasta, exist_ok=True)
+            destino = os.path.join(pasta, f'part-{ts0}-{rowids[0]}.parquet')
+            pq.write_table(tabela, destino + '.tmp', compression='zstd')
+            os.replace(destino + '.tmp', destino)
+            with con:
+                con.executemany("DELETE FROM readings WHERE rowid = ?", ((i,) for i in rowids))
+            movidas += len(linhas)
+    finally:
+        con.close()
+    return movidas
+
+def query_arquivo(device, inicio_ms, fim_ms, colunas=None):
+    """
+    Leituras arquivadas de uma estufa em (inicio_ms, fim_ms], ordenadas. O filtro desce até
+    as partições (só os dias da janela são abertos) e às estatísticas dos row groups.
+    Também serve para análise offline: query_arquivo(ID, 0, 2**62) traz tudo da estufa.
+    """
+    colunas = colunas or ARQUIVO_COLUNAS
+    if pa is None or not os.path.isdir(ARQUIVO_DIR): return pd.DataFrame(columns=colunas)
+    dset = ds.dataset(ARQUIVO_DIR, format='parquet', partitioning=ARQUIVO_PARTICOES)
+    filtro = ((ds.field('device_id') == device) & (ds.field('dia') >= dia_utc(max(inicio_ms, 0)))
+              & (ds.field('dia') <= dia_utc(min(fim_ms, 253402300799000))) # Até 9999-12-31
+              & (ds.field('timestamp') > inicio_ms) & (ds.field('timestamp') <= fim_ms))
+    return dset.to_table(columns=colunas, filter=filtro).to_pandas().sort_values('timestamp', ignore_index=True)
+
+def arquivador():
+    """Worker Thread: uma passada de arquivamento a cada ARQUIVO_INTERVALO_S."""
+    print(f">>> Arquivador Parquet: leituras com mais de {ARQUIVO_IDADE_DIAS} dias vão para {ARQUIVO_DIR}/")
+    while True:
+        try:
+            t0 = time.perf_counter()
+            movidas = arquiva_antigas()
+            if movidas: print(f"[ARQUIVO] {movidas} leituras movidas para Parquet em {time.perf_counter() - t0:.1f} s")
+        except Exception as e:
+            print(f"[ERRO ARQUIVO] {e}") # As linhas continuam no SQLite; tenta de novo na próxima passada
+        time.sleep(ARQUIVO_INTERVALO_S)
+
+# Um anel por estufa com as amostras mais recentes; 'total' conta tudo que já entrou (cursor dos clientes)
+live_lock = threading.Lock()
+live = {} # device_id -> {'rows': deque, 'total': int}
+
+def live_append(device, rows):
+    """Anexa linhas decodificadas ao cache ao vivo da estufa (chamado pela thread serial)."""
+    with live_lock:
+        cache = live.get(device)
+        if cache is None: cache = live[device] = {'rows': deque(maxlen=LIVE_CACHE_MAX), 'total': 0}
+        cache['rows'].extend(rows)
+        cache['total'] += len(rows)
+
+def live_seed():
+    """Preenche os caches com a janela ao vivo já gravada (modo visualização / reinício)."""
+    con = sqlite3.connect(DB_FILE)
+    rows = con.execute(
+        "SELECT timestamp, ldr_raw, temperature_c, umidade_raw, umidade_percent, led_status, luz_acumulada_s, device_id "
+        "FROM readings WHERE timestamp > ? ORDER BY timestamp", (int(time.time()*1000) - LIVE_JANELA_MS,)).fetchall()
+    con.close()
+    por_device = {}
+    for r in rows: por_device.setdefault(r[7], []).append(r)
+    for device, linhas in por_device.items(): live_append(device, linhas)
+
+def live_since(device, cursor):
+    """
+    Linhas da estufa que chegaram depois do cursor do cliente.
+    Retorna (linhas, novo_cursor, reset); reset = True quando o cliente é novo ou
+    ficou para trás do anel, e então as linhas são a janela ao vivo inteira.
+    """
+    with live_lock:
+        cache = live.get(device)
+        if cache is None: return [], None, True
+        rows, total = cache['rows'], cache['total']
+        n = len(rows)
+        if cursor is None or cursor > total or total - cursor > n:
+            limite = int(time.time()*1000) - LIVE_JANELA_MS
+            return [r for r in rows if r[0] > limite], total, True
+        return list(islice(rows, n - (total - cursor), n)), total, False
+
+def lttb(xs, ys, n_out):
+    """
+    Largest-Triangle-Three-Buckets: escolhe n_out índices que preservam a forma da série.
+    Mantém o primeiro e o último ponto; em cada balde fica o ponto que forma o maior
+    triângulo com o ponto escolhido no balde anterior e a média do balde seguinte.
+    """
+    n = len(xs)
+    if n_out >= n or n_out < 3: return list(range(n))
+    idx = [0]
+    step = (n - 2) / (n_out - 2)
+    a = 0
+    for i in range(n_out - 2):
+        start = int(i * step) + 1
+        end = int((i + 1) * step) + 1
+        # Média do próximo balde (o último "balde" é o ponto final)
+        nxt_start, nxt_end = end, min(int((i + 2) * step) + 1, n)
+        if nxt_start >= nxt_end: nxt_start, nxt_end = n - 1, n
+        cnt = nxt_end - nxt_start
+        avg_x = sum(xs[nxt_start:nxt_end]) / cnt
+        avg_y = sum(ys[nxt_start:nxt_end]) / cnt
+        ax, ay = xs[a], ys[a]
+        best, best_area = start, -1.0
+        for j in range(start, end):
+            area = abs((ax - avg_x) * (ys[j] - ay) - (ax - xs[j]) * (avg_y - ay))
+            if area > best_area: best, best_area = j, area
+        idx.append(best)
+        a = best
+    idx.append(n - 1)
+    return idx
+
+def build_history_figure(device, range_key):
+    """Gráfico principal para uma janela longa: rollup adequado + LTTB por série."""
+    con = sqlite3.connect(DB_FILE)
+    df = query_history(con, device, int(time.time()*1000) - HISTORY_RANGES[range_key])
+    con.close()
+    fig = go.Figure(layout=go.Layout(**DARK_LAYOUT))
+    traces = [('temperature_c', 'Temp', 'red', 'y'), ('ldr_raw', 'LDR', 'gold', 'y2'), ('umidade_percent', 'Umid', 'deepskyblue', 'y3')]
+    for col, name, color, axis in traces:
+        serie = df[['timestamp', col]].dropna()
+        xs, ys = serie['timestamp'].tolist(), serie[col].tolist()
+        keep = lttb(xs, ys, HISTORY_PONTOS_TRACO)
+        fig.add_trace(go.Scatter(x=[row_time(xs[k]) for k in keep], y=[ys[k] for k in keep], name=name, line=dict(color=color), yaxis=axis))
+    fig.update_layout(
+        yaxis=dict(title=dict(text='Temp (°C)', font=dict(color='red'))),
+        yaxis2=dict(title=dict(text='LDR', font=dict(color='gold')), overlaying='y', side='right'),
+        yaxis3=dict(title=dict(text='Umid (%)', font=dict(color='deepskyblue')), overlaying='y', side='right', position=0.95)
+    )
+    return fig
+
+def ingest_rows(rows):
+    """Enfileira um bloco de linhas decodificadas para o gravador sem bloquear a leitura serial."""
+    st = ingest_stats
+    with ingest_lock:
+        if st['fila'] + len(rows) > INGEST_FILA_MAX:
+            st['descartadas'] += len(rows)
+            return
+        st['fila'] += len(rows)
+        if st['fila'] > st['fila_pico']: st['fila_pico'] = st['fila']
+    ingest_queue.put_nowait(rows)
+
+def ingest_retira(bloco):
+    """Desconta da fila um bloco que o gravador tirou dela."""
+    with ingest_lock: ingest_stats['fila'] -= len(bloco)
+    return bloco
+
+def _acc_min(a, b): return b if a is None else a if b is None else min(a, b)
+def _acc_max(a, b): return b if a is None else a if b is None else max(a, b)
+
+def rollup_batch(batch, res_ms):
+    """Agrega o lote por estufa e intervalo de res_ms; valores None (sensor inválido) ficam de fora."""
+    acc = {}
+    for ts, ldr, temp_c, hum, hum_p, led, acc_luz, device in batch:
+        b = (int(ts) // res_ms) * res_ms
+        a = acc.get((device, b))
+        if a is None:
+            a = acc[(device, b)] = [device, b, 0, None, None, 0, 0, None, None, 0.0, 0, None, None, 0.0, 0, None]
+        a[2] += 1
+        a[3] = _acc_min(a[3], ldr); a[4] = _acc_max(a[4], ldr); a[5] += ldr
+        if temp_c is not None:
+            a[6] += 1; a[7] = _acc_min(a[7], temp_c); a[8] = _acc_max(a[8], temp_c); a[9] += temp_c
+        if hum_p is not None:
+            a[10] += 1; a[11] = _acc_min(a[11], hum_p); a[12] = _acc_max(a[12], hum_p); a[13] += hum_p
+        a[14] += led
+        a[15] = _acc_max(a[15], acc_luz)
+    return list(acc.values())
+
+def upsert_rollup_sql(table):
+    """Soma o lote ao intervalo existente (MIN/MAX com NULL tratado como ausente)."""
+    def mn(c): return f"MIN(COALESCE({c}, excluded.{c}), COALESCE(excluded.{c}, {c}))"
+    def mx(c): return f"MAX(COALESCE({c}, excluded.{c}), COALESCE(excluded.{c}, {c}))"
+    return f'''
+        INSERT INTO {table} VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)
+        ON CONFLICT(device_id, bucket) DO UPDATE SET
+            n = n + excluded.n,
+            ldr_min = {mn('ldr_min')}, ldr_max = {mx('ldr_max')}, ldr_sum = ldr_sum + excluded.ldr_sum,
+            temp_n = temp_n + excluded.temp_n, temp_min = {mn('temp_min')}, temp_max = {mx('temp_max')},
+            temp_sum = temp_sum + excluded.temp_sum,
+            hum_n = hum_n + excluded.hum_n, hum_min = {mn('hum_min')}, hum_max = {mx('hum_max')},
+            hum_sum = hum_sum + excluded.hum_sum,
+            led_sum = led_sum + excluded.led_sum, luz_max = {mx('luz_max')}
+    '''
+
+UPSERT_ROLLUP = {table: upsert_rollup_sql(table) for table, _ in ROLLUPS}
+
+def flush_rows(con, batch):
+    """Grava o lote e atualiza os rollups numa transação; atualiza as métricas de latência."""
+    t0 = time.perf_counter()
+    with con: # Uma transação (um fsync) por lote
+        con.executemany(INSERT_READING, batch)
+        for table, res_ms in ROLLUPS:
+            con.executemany(UPSERT_ROLLUP[table], rollup_batch(batch, res_ms))
+    dt_ms = (time.perf_counter() - t0) * 1000
+    st = ingest_stats
+    st['lotes'] += 1
+    st['gravadas'] += len(batch)
+    st['lote_ultimo'] = len(batch)
+    st['flush_ms_ultimo'] = dt_ms
+    st['flush_ms_medio'] = dt_ms if st['lotes'] == 1 else 0.9 * st['flush_ms_medio'] + 0.1 * dt_ms
+    if dt_ms > st['flush_ms_max']: st['flush_ms_max'] = dt_ms
+
+def db_writer():
+    """
+    Worker Thread: única conexão de escrita no SQLite.
+    Acumula amostras da fila e grava por tamanho (INGEST_LOTE_MAX) ou por prazo
+    (INGEST_INTERVALO_MS contado a partir da primeira amostra do lote).
+    """
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    con.execute('PRAGMA journal_mode=WAL')
+    con.execute('PRAGMA synchronous=NORMAL') # Em WAL, fsync só no checkpoint
+    print(">>> Thread de Gravação SQLite Iniciada")
+    batch = []
+    deadline = 0.0
+
+    while True:
+        try:
+            timeout = max(0.0, deadline - time.monotonic()) if batch else None
+            bloco = ingest_queue.get(timeout=timeout)
+            if not batch: deadline = time.monotonic() + INGEST_INTERVALO_MS / 1000.0
+            batch.extend(ingest_retira(bloco))
+            while len(batch) < INGEST_LOTE_MAX: # Esvazia o que já chegou sem bloquear
+                batch.extend(ingest_retira(ingest_queue.get_nowait()))
+        except queue.Empty:
+            pass
+
+        if batch and (len(batch) >= INGEST_LOTE_MAX or time.monotonic() >= deadline):
+            try:
+                flush_rows(con, batch)
+                batch = []
+            except Exception as e:
+                print(f"[ERRO BD] Falha ao gravar lote de {len(batch)} amostras: {e}")
+                time.sleep(1) # Mantém o lote e tenta de novo; a fila absorve nesse meio tempo
+
 # =============================================================================
 # THREAD DE COMUNICAÇÃO SERIAL (Backend)
 # =============================================================================
 
-def read_from_pico(ser): 
+def configure_telemetry(conn):
     """
-    Worker Thread: Monitora a porta serial continuamente.
-    Lê pacotes binários de 13 bytes, valida checksum e salva no SQLite.
-    Isso roda em paralelo para não travar a interface Dash.
+    Liga/desliga a taxa adaptativa e ativa o modo de alta taxa no firmware (se TELEM_HZ > 0).
+    O SET,BAUD vai no baud padrão; se o Pico já estiver no baud alto o comando
+    se perde, mas o resultado é o mesmo. Na USB não há baud a negociar.
+    Na UART a troca fica pendente em conn['baud_troca'] (sem sleep: a thread serial
+    atende as outras estufas) e o hub chama finish_telemetry() quando o prazo vence.
     """
-    # SQLite precisa de conexão própria por thread
-    db_con = sqlite3.connect(DB_FILE, check_same_thread=False)
-    print(">>> Thread de Leitura Serial Iniciada")
-    
+    ser = conn['ser']
+    ser.write(f"SET,ADAPT,{int(TAXA_ADAPTATIVA)}\n".encode())
+    if TELEM_HZ > 0 and not conn['usb']:
+        ser.write(f"SET,BAUD,{TELEM_BAUD}\n".encode())
+        ser.flush()
+        conn['baud_troca'] = time.monotonic() + TELEM_BAUD_ESPERA_S
+        return
+    finish_telemetry(conn)
+
+def finish_telemetry(conn):
+    """Segunda metade da configuração, já no baud final: modo de alta taxa e acerto do RTC."""
+    conn['baud_troca'] = None
+    ser = conn['ser']
+    if TELEM_HZ > 0:
+        if not conn['usb']: ser.baudrate = TELEM_BAUD
+        ser.write(f"SET,TELEM_DELTA,{int(TELEM_DELTA)}\n".encode()) # Antes do SET,TELEM: vale para o limite do lote
+        ser.write(f"SET,TELEM,{TELEM_HZ},{TELEM_LOTE}\n".encode())
+        formato = 'compactos' if TELEM_DELTA else 'completos'
+        print(f">>> Telemetria alta taxa: {TELEM_HZ} Hz, {TELEM_LOTE} amostras/quadro ({formato}) @ {'USB' if conn['usb'] else f'{TELEM_BAUD} baud'}")
+    sync_clock(ser)
+
+# =============================================================================
+# PROTOCOLO BINÁRIO (COBS + CRC16)
+# =============================================================================
+# Carga: [versão][tipo][seq u16][dados...][CRC16 u16], codificada em COBS e
+# terminada por 0x00. Qualquer 0x00 é fronteira de quadro: ressincronia em O(1).
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE (polinômio 0x1021, inicial 0xFFFF), igual ao firmware."""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+def cobs_encode(data):
+    """Codifica em COBS (sem o delimitador final)."""
+    out = bytearray()
+    block = bytearray()
+    for b in data:
+        if b == 0:
+            out.append(len(block) + 1); out += block; block.clear()
+        else:
+            block.append(b)
+            if len(block) == 254:
+                out.append(0xFF); out += block; block.clear()
+    out.append(len(block) + 1); out += block
+    return bytes(out)
+
+def encode_frame(tipo, seq, dados=b''):
+    """Monta [versão][tipo][seq][dados][CRC16] e devolve 0x00 + COBS + 0x00."""
+    payload = struct.pack('>BBH', PROTO_VERSAO, tipo, seq) + bytes(dados)
+    payload += struct.pack('>H', crc16(payload))
+    return b'\x00' + cobs_encode(payload) + b'\x00'
+
+def cobs_decode(data):
+    """Decodifica um bloco COBS (sem o delimitador). Retorna None se malformado."""
+    out = bytearray()
+    i, n = 0, len(data)
+    while i < n:
+        code = data[i]
+        if code == 0 or i + code > n: return None
+        out += data[i+1:i+code]
+        i += code
+        if code < 0xFF and i < n: out.append(0)
+    return bytes(out)
+
+def decode_frame(frame):
+    """
+    Valida um quadro recebido (sem o 0x00 final).
+    Retorna (tipo, seq, dados) ou None se COBS, versão ou CRC forem inválidos.
+    """
+    payload = cobs_decode(frame)
+    if payload is None or len(payload) < 6: return None
+    if crc16(payload[:-2]) != struct.unpack('>H', payload[-2:])[0]: return None
+    if payload[0] != PROTO_VERSAO: return None
+    seq = struct.unpack('>H', payload[2:4])[0]
+    return payload[1], seq, payload[4:-2]
+
+# Conexões abertas pela thread serial e, das já identificadas, o mapa ID -> conexão (lido pelo Dash)
+conexoes = []
+dispositivos = {}
+
+def nova_conexao(porta, usb=False):
+    """Estado de uma porta: buffer de recepção, estufa identificada, sequência e diagnóstico."""
+    return {
+        'porta': porta, 'usb': usb, 'ser': None, 'buf': bytearray(), 'retry': 0.0,
+        'baud_troca': None, # Prazo (monotonic) para trocar o baud após o SET,BAUD; None = nada pendente
+        'device': None, 'last_seq': None, 'lost': 0, 'backlog_regs': [],
+        'duty': [0, 0, 0], # Duty (‰) do último quadro: ventilador, bomba, LED (malhas PI do firmware)
+        'luz': None,       # Luz acumulada do último cabeçalho compacto (None = ainda não recebida)
+        'relogio': novo_relogio(),
+        'amostras_perdidas': 0, 'proxima_amostra_us': None, # Lacunas entre lotes, pelos carimbos do firmware
+        'taxa': None, # Taxa em uso informada pelo firmware (texto para o diagnóstico)
+        'anomalias': {}, # (tipo, origem) -> ms de início, das anomalias ainda ativas
+        'diag': {'secoes': {}, 'contadores': None, 'atualizado': None}, # Último GET,STATS recebido
+    }
+
+def registra_dispositivo(device, porta):
+    """Guarda a estufa na tabela devices (o seletor do dashboard lista também as desconectadas)."""
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    with con:
+        con.execute("INSERT INTO devices VALUES (?, ?, ?) ON CONFLICT(device_id) DO UPDATE SET "
+                    "porta = excluded.porta, visto_ms = excluded.visto_ms", (device, porta, int(time.time()*1000)))
+    con.close()
+
+def identifica(conn, device):
+    """
+    Associa o ID do quadro à porta. Na primeira vez (e depois de cada reconexão) registra
+    a estufa e pede o backlog, que é guardado por dispositivo.
+    """
+    if conn['device'] == device: return
+    conn['device'] = device
+    conn['relogio'] = novo_relogio() # Outra estufa na porta: outro cristal
+    conn['proxima_amostra_us'] = None
+    dispositivos[device] = conn
+    registra_dispositivo(device, conn['porta'])
+    print(f">>> Estufa {device:08X} em {conn['porta']}")
+    request_backlog(conn)
+
+# --- Relógio do dispositivo ---
+def novo_relogio():
+    return {'ultimo_us': None, 'janela': None, 'minimos': deque(maxlen=RELOGIO_JANELAS),
+            'base_us': None, 'base_ms': 0.0, 'deriva': 0.0}
+
+def relogio_ajusta(r):
+    """Reta (mínimos quadrados) pelos mínimos de cada janela: deslocamento e deriva."""
+    pts = list(r['minimos']) + ([r['janela'][1:]] if r['janela'] else [])
+    if not pts: return
+    if len(pts) >= 2:
+        mx = sum(x for x, _ in pts) / len(pts)
+        my = sum(y for _, y in pts) / len(pts)
+        sxx = sum((x - mx) ** 2 for x, _ in pts)
+        b = sum((x - mx) * (y - my) for x, y in pts) / sxx * 1000.0 if sxx else 0.0 # ms de atraso por ms
+        r['deriva'] = max(-RELOGIO_DERIVA_MAX, min(RELOGIO_DERIVA_MAX, b))
+        r['base_us'], r['base_ms'] = mx, my
+    else:
+        r['base_us'], r['base_ms'] = pts[0]
+    # Um atraso abaixo da reta é a melhor medida que existe: a reta desce até ele
+    for x, y in pts:
+        d = y - relogio_deslocamento(r, x)
+        if d < 0: r['base_ms'] += d
+
+def relogio_deslocamento(r, t_us):
+    return r['base_ms'] + r['deriva'] * (t_us - r['base_us']) / 1000.0
+
+def relogio_observa(conn, t_us, t_rx_ms):
+    """
+    Registra que o quadro cuja amostra mais recente é t_us (relógio do dispositivo)
+    chegou em t_rx_ms (relógio do host). Um t_us menor que o anterior é reboot do Pico.
+    """
+    r = conn['relogio']
+    if r['ultimo_us'] is not None and t_us < r['ultimo_us'] - 1_000_000:
+        print(f"[AVISO {conn['porta']}] Relógio do dispositivo voltou (reboot?): reiniciando o mapeamento")
+        conn['relogio'] = r = novo_relogio()
+        conn['proxima_amostra_us'] = None
+    r['ultimo_us'] = t_us
+    atraso = t_rx_ms - t_us / 1000.0 # Deslocamento + latência do enlace
+    j = r['janela']
+    if j is None or t_us - j[0] >= RELOGIO_JANELA_S * 1_000_000:
+        if j is not None: r['minimos'].append(j[1:])
+        j = r['janela'] = [t_us, t_us, atraso]
+        relogio_ajusta(r)
+    elif atraso < j[2]:
+        j[1], j[2] = t_us, atraso
+        relogio_ajusta(r)
+
+def relogio_ms(conn, t_us):
+    """Converte um instante do dispositivo (µs) para ms de parede com o mapeamento atual."""
+    r = conn['relogio']
+    return int(t_us / 1000.0 + relogio_deslocamento(r, t_us))
+
+def relogio_ms_np(conn, t_us):
+    """relogio_ms() para um array de instantes."""
+    r = conn['relogio']
+    return (t_us / 1000.0 + relogio_deslocamento(r, t_us)).astype(np.int64)
+
+def confere_lacuna(conn, t0_us, periodo_us, n):
+    """Conta as amostras que faltam entre o lote anterior e este (fila cheia no firmware ou quadro perdido)."""
+    esperado = conn['proxima_amostra_us']
+    if esperado is not None and periodo_us and t0_us > esperado + periodo_us // 2:
+        conn['amostras_perdidas'] += round((t0_us - esperado) / periodo_us)
+    conn['proxima_amostra_us'] = t0_us + n * periodo_us
+
+def decode_telemetry(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_TELEMETRIA: LDR, NTC, Umid (u16), LED (u8), Luz (u32), Temp (i16, c°C), Umid (u16, c%),
+    Duty ‰ (u16) do ventilador, bomba e LED, ID da estufa (u32), instante do estado (u64, µs do dispositivo),
+    modo de taxa (u8) e período de relato (u16, s). As unidades físicas já vêm convertidas pelo firmware.
+    """
+    ldr, _ntc, hum, led, acc_luz, temp_cc, hum_cp, *duty, device, t_us, modo, periodo_s = \
+        struct.unpack('>HHHBIhH3HIQBH', dados[:36])
+    conn['duty'][:] = duty
+    conn['taxa'] = f"{TAXA_MODOS.get(modo, modo)}, 1 pacote a cada {periodo_s} s"
+    identifica(conn, device)
+    relogio_observa(conn, t_us, t_rx_ms)
+    if temp_cc == TEMP_CC_INVALIDA: return []
+    return [(relogio_ms(conn, t_us), ldr, temp_cc / 100.0, hum, hum_cp / 100.0, led, acc_luz, device)]
+
+# Amostra dos lotes 0x02 (TELEM_BYTES_AMOSTRA em Estufa.c)
+LOTE_DTYPE = np.dtype([('ldr', '>u2'), ('temp_cc', '>i2'), ('umid', '>u2'), ('umid_cp', '>u2')])
+
+def linhas_do_lote(conn, device, t0_us, periodo_us, ldr, temp_cc, umid, umid_cp, led, acc_luz):
+    """
+    Monta as linhas do INSERT a partir das colunas (arrays) de um lote, datadas pelo relógio
+    do dispositivo. As conversões são operações de array; só o zip final é por amostra.
+    """
+    ok = temp_cc != TEMP_CC_INVALIDA
+    t_us = t0_us + np.flatnonzero(ok) * periodo_us
+    ts = relogio_ms_np(conn, t_us)
+    n = len(ts)
+    return list(zip(ts.tolist(), ldr[ok].tolist(), (temp_cc[ok] / 100.0).tolist(), umid[ok].tolist(),
+                    (umid_cp[ok] / 100.0).tolist(), [led] * n, [acc_luz] * n, [device] * n))
+
+def decode_batch(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_LOTE: [N][LED][Luz u32][Duty ‰ x 3][ID u32][t0 µs u64][período µs u32]
+    [N x (LDR, Temp c°C i16, Umid, Umid c%)]. Retorna linhas prontas para o INSERT, datadas
+    pelo relógio do dispositivo (amostra i em t0 + i x período).
+    """
+    n, led, acc_luz, *duty, device, t0_us, periodo_us = struct.unpack('>BBI3HIQI', dados[:28])
+    conn['duty'][:] = duty
+    conn['taxa'] = f"alta taxa, {1e6 / periodo_us:.0f} Hz" if periodo_us else None
+    identifica(conn, device)
+    relogio_observa(conn, t0_us + (n - 1) * periodo_us, t_rx_ms)
+    confere_lacuna(conn, t0_us, periodo_us, n)
+    a = np.frombuffer(dados, LOTE_DTYPE, count=min(n, (len(dados) - 28) // LOTE_DTYPE.itemsize), offset=28)
+    return linhas_do_lote(conn, device, t0_us, periodo_us, a['ldr'], a['temp_cc'], a['umid'], a['umid_cp'], led, acc_luz)
+
+def le_varint(dados, k):
+    """Lê um varint (7 bits por byte, bit 7 = continua) a partir de k. Retorna (valor, próximo k)."""
+    v = s = 0
     while True:
-        try:
-            # Protocolo: Aguarda byte 0xAA (Final de pacote)
-            packet = ser.read_until(b'\xAA')
-            
-            # Validação do Tamanho do Pacote (definido no firmware C)
-            if len(packet) == 13: 
-                # Cálculo de Checksum (Soma dos primeiros 11 bytes)
-                chk = (sum(packet[0:11])) & 0xFF
-                
-                # Validação de Integridade
-                if chk == packet[11]: 
-                    # Decodificação Big Endian (MSB primeiro)
-                    ldr = (packet[0]<<8) | packet[1]
-                    ntc = (packet[2]<<8) | packet[3]
-                    hum = (packet[4]<<8) | packet[5]
-                    led = packet[6] 
-                    # Luz acumulada é um uint32 (4 bytes)
-                    acc_luz = (packet[7]<<24) | (packet[8]<<16) | (packet[9]<<8) | packet[10] 
-                    
-                    # Conversão física
-                    temp_c = calculate_temp_ntc(ntc)
-                    hum_p = calculate_humidity_percent(hum)
-                    
-                    if temp_c is not None and hum_p is not None:
-                        # Persistência
-                        db_con.execute(
-                            "INSERT INTO readings (timestamp, ldr_raw, temperature_c, umidade_raw, umidade_percent, led_status, luz_acumulada_s) VALUES (?,?,?,?,?,?,?)", 
-                            (int(time.time()*1000), ldr, temp_c, hum, hum_p, led, acc_luz)
-                        )
-                        db_con.commit()
-                        print(f"[RX] LDR:{ldr} | T:{temp_c:.1f}°C | H:{hum_p:.1f}% | LED:{led} | Luz:{acc_luz}s")
+        b = dados[k]
+        k += 1
+        v |= (b & 0x7F) << s
+        if b < 0x80: return v, k
+        s += 7
+
+def varints_np(buf, total):
+    """Decodifica de uma vez os `total` primeiros varints de buf; None se o buffer acabar antes."""
+    b = np.frombuffer(buf, np.uint8).astype(np.int64)
+    fim = np.flatnonzero(b < 0x80)[:total] # Último byte de cada varint
+    if len(fim) < total: return None
+    inicio = np.concatenate(([0], fim[:-1] + 1))
+    pos = np.arange(fim[-1] + 1) - np.repeat(inicio, fim - inicio + 1) # Posição do byte dentro do varint
+    return np.add.reduceat((b[:fim[-1] + 1] & 0x7F) << (7 * pos), inicio)
+
+def decode_delta(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_DELTA: [N][flags][ID u32][t0 µs u64][período µs varint][Luz varint se flags.0][Duty ‰ varint x 3 se flags.1]
+    [N x (LDR, Temp c°C, Umid, Umid c%) em varint zigzag da diferença para a amostra anterior].
+    Luz e duty que não vieram repetem o último cabeçalho; até o primeiro com a luz as amostras são descartadas.
+    """
+    n, flags, device, t0_us = struct.unpack('>BBIQ', dados[:14])
+    identifica(conn, device)
+    periodo_us, k = le_varint(dados, 14)
+    conn['taxa'] = f"alta taxa compacta, {1e6 / periodo_us:.0f} Hz" if periodo_us else None
+    relogio_observa(conn, t0_us + (n - 1) * periodo_us, t_rx_ms)
+    confere_lacuna(conn, t0_us, periodo_us, n)
+    if flags & DELTA_FLAG_LUZ:
+        conn['luz'], k = le_varint(dados, k)
+    if flags & DELTA_FLAG_DUTY:
+        for a in range(3):
+            conn['duty'][a], k = le_varint(dados, k)
+    acc_luz, led = conn['luz'], int(conn['duty'][2] > 0)
+    z = varints_np(dados[k:], 4 * n) if n else None
+    if acc_luz is None or z is None: return []
+    v = ((z >> 1) ^ -(z & 1)).reshape(n, 4).cumsum(axis=0) # Zigzag -> diferenças -> valores
+    return linhas_do_lote(conn, device, t0_us, periodo_us, v[:, 0], v[:, 1], v[:, 2], v[:, 3], led, acc_luz)
+
+# --- Comandos binários com confirmação (ACK) ---
+_cmd_lock = threading.Lock()
+_cmd_seq = 0
+_pending_acks = {} # seq -> [threading.Event, status]
+
+def send_command(ser, opcode, args=b'', wait=True, retries=2):
+    """
+    Envia um comando binário. Com wait=True aguarda o ACK (reenviando por timeout)
+    e retorna o status do firmware, ou None se nenhuma confirmação chegou.
+    """
+    global _cmd_seq
+    with _cmd_lock:
+        seq = _cmd_seq
+        _cmd_seq = (_cmd_seq + 1) & 0xFFFF
+        entry = [threading.Event(), None]
+        if wait: _pending_acks[seq] = entry
+    frame = encode_frame(opcode, seq, args)
+    try:
+        for _ in range(1 + (retries if wait else 0)):
+            ser.write(frame)
+            if not wait or entry[0].wait(ACK_TIMEOUT_S): break
+    finally:
+        with _cmd_lock: _pending_acks.pop(seq, None)
+    return entry[1]
+
+def set_params(ser, params, wait=True):
+    """Envia vários (id, valor) num único OP_BATCH."""
+    args = struct.pack('>B', len(params)) + b''.join(struct.pack('>BI', pid, int(v)) for pid, v in params)
+    return send_command(ser, OP_BATCH, args, wait=wait)
+
+def decode_ack(conn, dados, t_rx_ms):
+    """Dados PROTO_TIPO_ACK: [seq do comando u16][opcode][status]. Libera quem espera."""
+    seq, opcode, status = struct.unpack('>HBB', dados[:4])
+    with _cmd_lock: entry = _pending_acks.get(seq)
+    if entry is not None:
+        entry[1] = status
+        entry[0].set()
+    if status != 0:
+        print(f"[ACK] Comando 0x{opcode:02X} #{seq}: {ACK_STATUS.get(status, status)}")
+    return []
+
+def decode_stats(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_STATS: [secao][unidade][clk Hz u32][contagem u32][min u32][max u32][media u32][24 x u16].
+    Converte ciclos para microssegundos usando o clock do sistema informado.
+    """
+    secao, unidade, clk, contagem, vmin, vmax, media = struct.unpack('>BBIIIII', dados[:22])
+    hist = struct.unpack('>24H', dados[22:70])
+    escala = 1.0 if unidade == 1 else 1e6 / clk
+    diag = conn['diag']
+    diag['secoes'][secao] = {
+        'contagem': contagem, 'min_us': vmin * escala, 'max_us': vmax * escala,
+        'media_us': media * escala, 'hist': hist, 'unidade': unidade,
+    }
+    diag['atualizado'] = datetime.now()
+    return []
+
+def decode_counters(conn, dados, t_rx_ms):
+    """Dados PROTO_TIPO_CONTADORES: u32 na ordem de PERF_CONTADORES (firmwares antigos mandam 7)."""
+    diag = conn['diag']
+    n = min(len(dados) // 4, len(PERF_CONTADORES))
+    diag['contadores'] = struct.unpack(f'>{n}I', dados[:4 * n])
+    diag['atualizado'] = datetime.now()
+    return []
+
+def decode_backlog(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_BACKLOG: [n][uptime_agora_s u32][ID u32][n x (seq u32, uptime_s u32, LDR, NTC, Umid u16, flags, crc)].
+    Os registros se acumulam na conexão e vão direto para o banco ao fim da descarga
+    (quadro com n = 0); não entram no gráfico ao vivo.
+    """
+    n, uptime_agora, device = struct.unpack('>BII', dados[:9])
+    regs = conn['backlog_regs']
+    for i in range(n):
+        seq, up, ldr, ntc, umid, flags, _crc = struct.unpack('>IIHHHBB', dados[9 + 16*i : 25 + 16*i])
+        regs.append((seq, up, ldr, ntc, umid, flags))
+    if n == 0:
+        conn['backlog_regs'] = []
+        store_backlog(device, sorted(regs), uptime_agora, t_rx_ms)
+    return []
+
+def store_backlog(device, regs, uptime_agora, t_rx_ms):
+    """
+    Data os registros e grava os que preenchem lacunas do histórico.
+    Boot atual: ts = instante do boot + uptime. Registros de boots anteriores (o uptime
+    volta a crescer do zero) são estimados supondo que o boot anterior terminou um
+    período de log antes do seguinte.
+    """
+    if not regs: return
+    periodo_ms = FLASH_LOG_PERIODO_S * 1000
+    boot_ms = t_rx_ms - uptime_agora * 1000
+    next_up = uptime_agora
+    datados = []
+    for seq, up, ldr, ntc, umid, flags in reversed(regs):
+        if up > next_up: boot_ms = boot_ms - periodo_ms - up * 1000 # Reinício entre este e o seguinte
+        next_up = up
+        datados.append((int(boot_ms + up * 1000), seq, ldr, ntc, umid, flags))
+
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    rows = []
+    for ts, seq, ldr, ntc, umid, flags in reversed(datados):
+        # Já há leitura ao vivo nesse intervalo: o host estava online
+        if con.execute("SELECT 1 FROM readings WHERE device_id = ? AND timestamp BETWEEN ? AND ? LIMIT 1",
+                       (device, ts - periodo_ms // 2, ts + periodo_ms // 2)).fetchone(): continue
+        temp_c = TEMP_NTC_LUT[min(ntc, ADC_CONTAGENS - 1)]
+        rows.append((ts, ldr, temp_c, umid, UMIDADE_LUT[min(umid, ADC_CONTAGENS - 1)], flags & 1, None, device))
+    if rows: flush_rows(con, rows)
+    with con:
+        con.execute("INSERT OR REPLACE INTO meta VALUES (?, ?)", (f'backlog_seq:{device}', regs[-1][0]))
+    con.close()
+    print(f"[BACKLOG {device:08X}] {len(regs)} registros do log em flash, {len(rows)} gravados em lacunas (seq {regs[0][0]}..{regs[-1][0]})")
+
+def decode_anomalia(conn, dados, t_rx_ms):
+    """
+    Dados PROTO_TIPO_ANOMALIA: [tipo][origem][ativa][valor i32][limiar i32][ID u32][t µs u64].
+    O firmware só envia as bordas: cada quadro vira uma linha de events na hora, sem
+    esperar o gravador, e as anomalias ativas ficam na conexão para o diagnóstico.
+    """
+    tipo, origem, ativa, valor, limiar, device, t_us = struct.unpack('>BBBiiIQ', dados[:23])
+    identifica(conn, device)
+    relogio_observa(conn, t_us, t_rx_ms)
+    ts = relogio_ms(conn, t_us)
+    nomes = ANOMALIA_ATUADORES if tipo == 2 else ANOMALIA_CANAIS
+    chave = (ANOMALIA_TIPOS.get(tipo, str(tipo)), nomes[origem] if origem < len(nomes) else str(origem))
+    con = sqlite3.connect(DB_FILE, timeout=10)
+    with con:
+        con.execute("INSERT INTO events (device_id, timestamp, tipo, origem, ativa, valor, limiar) VALUES (?,?,?,?,?,?,?)",
+                    (device, ts, *chave, ativa, valor, limiar))
+    con.close()
+    if ativa: conn['anomalias'][chave] = ts
+    else: conn['anomalias'].pop(chave, None)
+    print(f"[ANOMALIA {device:08X}] {chave[0]} em {chave[1]} {'começou' if ativa else 'terminou'} (valor {valor}, limiar {limiar})")
+    return []
+
+def sync_clock(ser):
+    """Acerta o RTC do firmware com a hora local; a virada do dia passa a ser feita lá."""
+    agora = datetime.now().astimezone()
+    epoch_local = int(agora.timestamp() + agora.utcoffset().total_seconds())
+    send_command(ser, OP_SET_PARAM, struct.pack('>BI', PARAM_TIME, epoch_local), wait=False)
+
+def request_backlog(conn):
+    """Pede à estufa identificada os registros do log em flash ainda não descarregados."""
+    con = sqlite3.connect(DB_FILE)
+    last = con.execute("SELECT valor FROM meta WHERE chave = ?", (f"backlog_seq:{conn['device']}",)).fetchone()
+    con.close()
+    desde = last[0] + 1 if last else 0
+    send_command(conn['ser'], OP_GET_BACKLOG, struct.pack('>I', desde), wait=False)
+    print(f">>> Backlog de {conn['device']:08X} solicitado a partir do seq {desde}")
+
+FRAME_DECODERS = {
+    PROTO_TIPO_TELEMETRIA: decode_telemetry,
+    PROTO_TIPO_LOTE: decode_batch,
+    PROTO_TIPO_DELTA: decode_delta,
+    PROTO_TIPO_ACK: decode_ack,
+    PROTO_TIPO_STATS: decode_stats,
+    PROTO_TIPO_CONTADORES: decode_counters,
+    PROTO_TIPO_BACKLOG: decode_backlog,
+    PROTO_TIPO_ANOMALIA: decode_anomalia,
+}
+
+def handle_frame(conn, frame, t_rx_ms):
+    """
+    Valida um quadro COBS (sem o 0x00) e retorna as linhas decodificadas (vazio se não houver).
+    Lacunas no número de sequência contabilizam quadros perdidos no enlace da porta.
+    """
+    decoded = decode_frame(frame)
+    if decoded is None:
+        print(f"[ERRO {conn['porta']}] Quadro inválido (COBS/CRC/versão), {len(frame) + 1} bytes descartados")
+        return []
+    tipo, seq, dados = decoded
+
+    # Detecção de perdas pela sequência (16 bits, com wrap)
+    if conn['last_seq'] is not None:
+        gap = (seq - conn['last_seq'] - 1) & 0xFFFF
+        if gap:
+            conn['lost'] += gap
+            print(f"[AVISO {conn['porta']}] {gap} quadro(s) perdido(s) (total {conn['lost']})")
+    conn['last_seq'] = seq
+
+    decoder = FRAME_DECODERS.get(tipo)
+    if decoder is None: return []
+    return decoder(conn, dados, t_rx_ms)
+
+def processa_bytes(conn, chunk, t_rx_ms):
+    """Acumula os bytes da porta e processa cada quadro completo (delimitado por 0x00)."""
+    buf = conn['buf']
+    buf += chunk
+    if b'\x00' not in chunk:
+        if len(buf) > SERIAL_BUF_MAX:
+            print(f"[ERRO {conn['porta']}] {len(buf)} bytes sem delimitador descartados")
+            buf.clear()
+        return
+    *quadros, resto = bytes(buf).split(b'\x00')
+    conn['buf'] = bytearray(resto)
+    rows = []
+    for frame in quadros:
+        if frame: rows += handle_frame(conn, frame, t_rx_ms) # Vazio = delimitador isolado
+    if rows:
+        # Um bloco por leitura: persistência em lote pela thread db_writer + cache do dashboard
+        ingest_rows(rows)
+        live_append(conn['device'], rows)
+        ts, ldr, temp_c, hum, hum_p, led, acc_luz, device = rows[-1]
+        prefix = f"[{device:08X} RX #{conn['last_seq']}]" if len(rows) == 1 else f"[{device:08X} RX #{conn['last_seq']} x{len(rows)}]"
+        print(f"{prefix} LDR:{ldr} | T:{temp_c:.1f}°C | H:{hum_p:.1f}% | LED:{led} | Luz:{acc_luz}s")
+
+def abre_conexao(conn, sel):
+    """Abre a porta sem bloqueio (timeout=0), reconfigura o firmware e registra no seletor."""
+    try:
+        conn['ser'] = serial.Serial(conn['porta'], BAUD_RATE, timeout=0)
+    except Exception as e:
+        print(f">>> AVISO: {conn['porta']} indisponível ({e}); nova tentativa em {SERIAL_RECONEXAO_S} s")
+        conn['retry'] = time.monotonic() + SERIAL_RECONEXAO_S
+        return
+    print(f">>> Serial conectada em {conn['porta']}{' (USB)' if conn['usb'] else ''}")
+    conn['buf'] = bytearray()
+    conn['last_seq'] = None
+    conn['device'] = None # O próximo quadro com ID reidentifica a estufa e pede o backlog
+    configure_telemetry(conn)
+    if sel is not None: sel.register(conn['ser'], selectors.EVENT_READ, conn)
+
+def fecha_conexao(conn, sel, erro):
+    """Fecha a porta que falhou; a reabertura fica para daqui a SERIAL_RECONEXAO_S."""
+    print(f"[ERRO CRÍTICO] Falha na Serial {conn['porta']}: {erro}")
+    if sel is not None:
+        try: sel.unregister(conn['ser'])
+        except Exception: pass
+    try: conn['ser'].close()
+    except Exception: pass
+    conn['ser'] = None
+    conn['baud_troca'] = None
+    conn['luz'] = None # Quadros compactos perdidos: espera o próximo cabeçalho completo
+    conn['retry'] = time.monotonic() + SERIAL_RECONEXAO_S
+
+def portas_usb():
+    """Portas CDC do firmware pelo VID:PID (o produto é conferido quando o SO o informa)."""
+    return [p.device for p in list_ports.comports()
+            if p.vid == USB_VID and p.pid == USB_PID and p.product in (None, USB_PRODUTO)]
+
+def atualiza_portas_usb():
+    """Inclui portas USB recém-conectadas e esquece as desconectadas que já fecharam."""
+    atuais = set(portas_usb())
+    conexoes[:] = [c for c in conexoes if not c['usb'] or c['ser'] is not None or c['porta'] in atuais]
+    conhecidas = {c['porta'] for c in conexoes}
+    conexoes.extend(nova_conexao(p, usb=True) for p in sorted(atuais - conhecidas))
+
+def serial_hub(portas):
+    """
+    Worker Thread: uma única thread atende todas as portas seriais.
+    No POSIX as portas ficam num selectors.DefaultSelector (epoll/kqueue) e a thread só
+    acorda quando há bytes; no Windows, onde seriais não entram no select(), varre as
+    portas a cada SERIAL_POLL_S. Portas que falham são reabertas sozinhas e, com
+    SERIAL_AUTODETECTA_USB, as portas CDC do firmware entram e saem conforme são plugadas.
+    """
+    print(f">>> Thread de Leitura Serial Iniciada ({len(portas)} porta(s){' + USB' if SERIAL_AUTODETECTA_USB else ''})")
+    conexoes[:] = [nova_conexao(p) for p in portas]
+    sel = selectors.DefaultSelector() if os.name != 'nt' else None
+    varredura_usb = 0.0
+
+    while True:
+        agora = time.monotonic()
+        if SERIAL_AUTODETECTA_USB and agora >= varredura_usb:
+            try: atualiza_portas_usb()
+            except Exception as e: print(f"[ERRO] Falha ao listar portas USB: {e}")
+            varredura_usb = agora + SERIAL_RECONEXAO_S
+        espera = 1.0
+        for conn in conexoes:
+            if conn['ser'] is None and agora >= conn['retry']: abre_conexao(conn, sel)
+            if conn['ser'] is not None and conn['baud_troca'] is not None:
+                if agora >= conn['baud_troca']:
+                    try: finish_telemetry(conn)
+                    except Exception as e: fecha_conexao(conn, sel, e)
                 else:
-                    print(f"[ERRO] Checksum Inválido: Calc {chk} != Rec {packet[11]}")
-        except Exception as e: 
-            print(f"[ERRO CRÍTICO] Falha na Serial: {e}")
-            time.sleep(5) # Espera antes de tentar reconectar
+                    espera = min(espera, conn['baud_troca'] - agora) # Acorda a tempo da troca
+
+        if sel is not None and sel.get_map():
+            prontas = [key.data for key, _ in sel.select(timeout=espera)]
+        elif sel is not None:
+            time.sleep(1.0) # Nenhuma porta aberta: só aguarda a reconexão
+            prontas = []
+        else:
+            time.sleep(SERIAL_POLL_S)
+            prontas = [c for c in conexoes if c['ser'] is not None]
+
+        t_rx_ms = time.time()*1000
+        for conn in prontas:
+            if conn['ser'] is None: continue
+            try:
+                n = conn['ser'].in_waiting
+                if n == 0 and sel is None: continue
+                chunk = conn['ser'].read(max(n, 1))
+                if conn['baud_troca'] is not None: continue # Bytes da troca de baud: descartados
+                if chunk: processa_bytes(conn, chunk, t_rx_ms)
+            except Exception as e:
+                fecha_conexao(conn, sel, e)
 
 # =============================================================================
 # FRONTEND DASHBOARD (Dash + Plotly)
@@ -210,7 +1286,14 @@ app.layout = dbc.Container(fluid=True, style={'backgroundColor': '#111111', 'col
     # Cabeçalho
     dbc.Row(dbc.Col(html.H1("MONITORAMENTO ESTUFA IOT", className="text-center text-primary mb-4"))),
     
+    # Seletor de Estufa (uma linha por dispositivo da tabela devices)
+    dbc.Row(dbc.Col(md=4, children=dcc.Dropdown(id='device', placeholder='Selecione a estufa', clearable=False, style={'color': 'black'})),
+            justify="center", className="mb-2"),
+
     # Gráfico Principal (Histórico)
+    dbc.Row(dbc.Col(dbc.RadioItems(id='history-range', value='live', inline=True, className="text-center", options=[
+        {'label': 'Ao vivo (10 min)', 'value': 'live'}, {'label': '1 hora', 'value': '1h'}, {'label': '1 dia', 'value': '1d'},
+        {'label': '1 semana', 'value': '1w'}, {'label': '1 mês', 'value': '1m'}]))),
     dbc.Row(dbc.Col(dcc.Graph(id='main-graph')), className="mb-4"),
     
     # Cards de Indicadores Atuais (Gauges)
@@ -251,13 +1334,26 @@ app.layout = dbc.Container(fluid=True, style={'backgroundColor': '#111111', 'col
             dbc.CardBody([
                 dcc.Input(id='in-plant', type='text', placeholder='Digite o nome da planta (ex: Orquídea)...', className="dbc", style={'width':'70%', 'marginRight':'10px'}),
                 dbc.Button('Consultar IA', id='btn-api', n_clicks=0, color="primary"),
-                html.Div(id='out-api', style={'marginTop':'15px', 'padding':'10px', 'backgroundColor':'#333', 'minHeight':'200px', 'borderRadius':'5px'})
+                html.Div(id='out-api', style={'marginTop':'15px', 'padding':'10px', 'backgroundColor':'#333', 'minHeight':'200px', 'borderRadius':'5px'}),
+                dcc.Store(id='ia-job'), # Chave da consulta em andamento
+                dcc.Interval(id='ia-poll', interval=IA_POLL_MS, disabled=True)
             ])
         ])])
-    ]),
+    ], className="mb-4"),
+
+    # Diagnóstico do Firmware (instrumentação GET,STATS)
+    dbc.Row(dbc.Col(dbc.Card(style=CARD_STYLE, children=[
+        dbc.CardHeader("Diagnóstico do Firmware"),
+        dbc.CardBody([
+            dbc.Button('Atualizar Diagnóstico', id='btn-diag', n_clicks=0, color="info", className="mb-2 me-2"),
+            dbc.Button('Atualizar e Zerar', id='btn-diag-reset', n_clicks=0, color="secondary", className="mb-2"),
+            html.Div(id='out-diag', className="text-muted")
+        ])
+    ]))),
     
     # Timers para atualização automática
     dcc.Interval(id='tick', interval=2000), # Atualiza gráficos a cada 2s
+    dcc.Store(id='live-cursor'), # Posição de cada aba no cache ao vivo
     dcc.Interval(id='clock', interval=60000) # Eventos de relógio (minuto a minuto)
 ])
 
@@ -265,125 +1361,189 @@ app.layout = dbc.Container(fluid=True, style={'backgroundColor': '#111111', 'col
 # CALLBACKS (Lógica Reativa)
 # =============================================================================
 
+DARK_LAYOUT = dict(template="plotly_dark", paper_bgcolor='#2a2a2a', plot_bgcolor='#2a2a2a')
+LED_OFF = {'width':'50px', 'height':'50px', 'borderRadius':'50%', 'margin':'0 auto 20px auto', 'backgroundColor':'gray', 'boxShadow': 'none'}
+LED_ON = {'width':'50px', 'height':'50px', 'borderRadius':'50%', 'margin':'0 auto 20px auto', 'backgroundColor':'#00FF00', 'boxShadow': '0 0 20px #00FF00'}
+
+def row_time(ts):
+    """Timestamp (ms) -> datetime UTC sem fuso (mesma base de pd.to_datetime(unit='ms'))."""
+    return datetime.fromtimestamp(ts / 1000, timezone.utc).replace(tzinfo=None)
+
+def build_main_figure(rows):
+    """Gráfico multieixo (Temp, LDR, Umid) completo; depois só recebe extendData."""
+    x = [row_time(r[0]) for r in rows]
+    fig = go.Figure(layout=go.Layout(**DARK_LAYOUT))
+    fig.add_trace(go.Scatter(x=x, y=[r[2] for r in rows], name='Temp', line=dict(color='red')))
+    fig.add_trace(go.Scatter(x=x, y=[r[1] for r in rows], name='LDR', line=dict(color='gold'), yaxis='y2'))
+    fig.add_trace(go.Scatter(x=x, y=[r[4] for r in rows], name='Umid', line=dict(color='deepskyblue'), yaxis='y3'))
+    fig.update_layout(
+        yaxis=dict(title=dict(text='Temp (°C)', font=dict(color='red'))),
+        yaxis2=dict(title=dict(text='LDR', font=dict(color='gold')), overlaying='y', side='right'),
+        yaxis3=dict(title=dict(text='Umid (%)', font=dict(color='deepskyblue')), overlaying='y', side='right', position=0.95)
+    )
+    return fig
+
+def mk_gauge(val, min_v, max_v, col):
+    """Cria um gauge; nos ticks seguintes só o valor é atualizado via Patch."""
+    return go.Figure(go.Indicator(
+        mode="gauge+number", value=val, 
+        domain={'x':[0,1], 'y':[0,1]}, 
+        gauge={'axis':{'range':[min_v,max_v]}, 'bar':{'color':'white'}, 'steps':[{'range':[min_v, max_v], 'color':col}]}
+    )).update_layout(template="plotly_dark", height=200, margin=dict(l=20, r=20, t=20, b=20), paper_bgcolor='#2a2a2a')
+
+def patch_gauge(val):
+    p = Patch()
+    p['data'][0]['value'] = val
+    return p
+
+def conexao_ativa(device):
+    """Conexão com a porta aberta da estufa, ou None se ela não está conectada."""
+    conn = dispositivos.get(device)
+    return conn if conn is not None and conn['ser'] is not None and conn['device'] == device else None
+
+@app.callback([Output('device','options'), Output('device','value')], Input('tick','n_intervals'), State('device','value'))
+def update_devices(n, atual):
+    """Lista as estufas conhecidas (online primeiro); escolhe uma se nada estiver selecionado."""
+    con = sqlite3.connect(DB_FILE)
+    known = con.execute("SELECT device_id, porta FROM devices ORDER BY device_id").fetchall()
+    con.close()
+    options = []
+    for device, porta in known:
+        online = conexao_ativa(device) is not None
+        options.append((not online, {'label': f"{device:08X} · {porta} · {'online' if online else 'offline'}", 'value': device}))
+    options = [o for _, o in sorted(options, key=lambda o: o[0])]
+    if atual in (o['value'] for o in options) or not options: return options, dash.no_update
+    return options, options[0]['value']
+
 @app.callback(
-    [Output('main-graph','figure'), Output('g-temp','figure'), Output('s-temp','children'),
+    [Output('main-graph','figure'), Output('main-graph','extendData'), Output('g-temp','figure'), Output('s-temp','children'),
      Output('g-ldr','figure'), Output('s-ldr','children'), Output('g-hum','figure'), Output('s-hum','children'),
-     Output('led-indicator','style'), Output('light-counter','children'), Output('light-progress','value')],
-    Input('tick','n_intervals'), State('in-meta', 'value')
+     Output('led-indicator','style'), Output('light-counter','children'), Output('light-progress','value'),
+     Output('live-cursor','data')],
+    [Input('tick','n_intervals'), Input('history-range','value'), Input('device','value')], [State('in-meta', 'value'), State('live-cursor', 'data')]
 )
-def update_graphs(n, meta_horas):
+def update_graphs(n, history_range, device, meta_horas, cursor):
     """
-    Callback principal: Busca dados no DB e atualiza todos os gráficos.
-    Gera gauges de tempo real e gráfico de linha histórico.
+    Callback principal: atualiza gráficos a partir do cache ao vivo (sem SQLite).
+    Na primeira carga (ou se a aba ficou para trás do anel) envia as figuras completas;
+    depois envia só os pontos novos (extendData) e o valor dos gauges (Patch).
+    Com uma janela histórica selecionada, o gráfico principal vem dos rollups (LTTB)
+    e só é refeito quando a janela muda; os gauges seguem ao vivo.
+    Trocar de estufa recomeça do zero (o cursor é de um cache por estufa).
     """
     try:
-        # Busca últimos 10 minutos de dados
-        con = sqlite3.connect(DB_FILE)
-        df = pd.read_sql_query("SELECT * FROM readings WHERE timestamp > ?", con, params=(int(time.time()*1000)-600000,))
-        con.close()
+        trigger = dash.callback_context.triggered[0]['prop_id'] if dash.callback_context.triggered else ''
+        history = history_range in HISTORY_RANGES
+        mudou = trigger.startswith(('history-range', 'device.'))
+        if trigger.startswith('device.') or (mudou and not history): cursor = None # Volta ao vivo: figura completa
+        rows, cursor, reset = live_since(device, cursor)
+        rows = [r for r in rows if r[2] is not None and r[4] is not None]
         
-        df = df.dropna(subset=['temperature_c', 'umidade_percent'])
+        if not rows:
+            main = build_history_figure(device, history_range) if history and (reset or mudou) else dash.no_update
+            if not reset: return [main] + [dash.no_update]*10 + [cursor]
+            empty_fig = go.Figure().update_layout(**DARK_LAYOUT)
+            if main is dash.no_update: main = empty_fig
+            return [main, dash.no_update, empty_fig, "N/A", empty_fig, "N/A", empty_fig, "N/A", LED_OFF, "0s", 0, None]
         
-        # Definição de estilos visuais
-        empty_fig = go.Figure().update_layout(template="plotly_dark", paper_bgcolor='#2a2a2a', plot_bgcolor='#2a2a2a')
-        led_off = {'width':'50px', 'height':'50px', 'borderRadius':'50%', 'margin':'0 auto 20px auto', 'backgroundColor':'gray', 'boxShadow': 'none'}
-        led_on = {'width':'50px', 'height':'50px', 'borderRadius':'50%', 'margin':'0 auto 20px auto', 'backgroundColor':'#00FF00', 'boxShadow': '0 0 20px #00FF00'}
+        ts, ldr, temp_c, hum, hum_p, led_val, acc_luz, _device = rows[-1]
         
-        if df.empty: return [empty_fig]*2 + ["N/A"] + [empty_fig] + ["N/A"] + [empty_fig] + ["N/A"] + [led_off] + ["0s"] + [0]
-        
-        df['time'] = pd.to_datetime(df['timestamp'], unit='ms')
-        last = df.iloc[-1]
-        
-        # Gráfico Multieixo (Temp, LDR, Umid)
-        fig = go.Figure(layout=go.Layout(template="plotly_dark", paper_bgcolor='#2a2a2a', plot_bgcolor='#2a2a2a'))
-        fig.add_trace(go.Scatter(x=df['time'], y=df['temperature_c'], name='Temp', line=dict(color='red')))
-        fig.add_trace(go.Scatter(x=df['time'], y=df['ldr_raw'], name='LDR', line=dict(color='gold'), yaxis='y2'))
-        fig.add_trace(go.Scatter(x=df['time'], y=df['umidade_percent'], name='Umid', line=dict(color='deepskyblue'), yaxis='y3'))
-        
-        fig.update_layout(
-            yaxis=dict(title=dict(text='Temp (°C)', font=dict(color='red'))),
-            yaxis2=dict(title=dict(text='LDR', font=dict(color='gold')), overlaying='y', side='right'),
-            yaxis3=dict(title=dict(text='Umid (%)', font=dict(color='deepskyblue')), overlaying='y', side='right', position=0.95)
-        )
-
-        # Helper para criar Gauges
-        def mk_gauge(val, min_v, max_v, col):
-            return go.Figure(go.Indicator(
-                mode="gauge+number", value=val, 
-                domain={'x':[0,1], 'y':[0,1]}, 
-                gauge={'axis':{'range':[min_v,max_v]}, 'bar':{'color':'white'}, 'steps':[{'range':[min_v, max_v], 'color':col}]}
-            )).update_layout(template="plotly_dark", height=200, margin=dict(l=20, r=20, t=20, b=20), paper_bgcolor='#2a2a2a')
-
         # Cálculo de Progresso de Luz
-        led_val = last['led_status'] if 'led_status' in last else 0
-        acc_luz = last['luz_acumulada_s'] if 'luz_acumulada_s' in last else 0
-        led_style = led_on if led_val == 1 else led_off
-        
+        led_style = LED_ON if led_val == 1 else LED_OFF
         meta_segundos = float(meta_horas) * 3600 if meta_horas else 1
         progresso = (acc_luz / meta_segundos) * 100
-        
-        return fig, \
-               mk_gauge(last['temperature_c'], 10, 40, 'red'), f"{last['temperature_c']:.1f}°C", \
-               mk_gauge(last['ldr_raw'], 0, 4095, 'gold'), f"{last['ldr_raw']}", \
-               mk_gauge(last['umidade_percent'], 0, 100, 'deepskyblue'), f"{last['umidade_percent']:.1f}%", \
-               led_style, f"{acc_luz}s / {int(meta_segundos)}s", progresso
+        tail = [led_style, f"{acc_luz}s / {int(meta_segundos)}s", progresso, cursor]
+        conn = dispositivos.get(device)
+        fan, pump, led_duty = (d / 10 for d in (conn['duty'] if conn else (0, 0, 0)))
+        texts = [f"{temp_c:.1f}°C · ventilador {fan:.0f}%", f"{ldr} · LED {led_duty:.0f}%", f"{hum_p:.1f}% · bomba {pump:.0f}%"]
+
+        if history:
+            main = build_history_figure(device, history_range) if mudou or reset else dash.no_update
+            main_out = [main, dash.no_update]
+        elif reset:
+            main_out = [build_main_figure(rows), dash.no_update]
+        else:
+            x = [row_time(r[0]) for r in rows]
+            main_out = [dash.no_update, (dict(x=[x, x, x], y=[[r[2] for r in rows], [r[1] for r in rows], [r[4] for r in rows]]), [0, 1, 2], LIVE_MAX_PONTOS)]
+
+        if reset:
+            return main_out + [mk_gauge(temp_c, 10, 40, 'red'), texts[0],
+                               mk_gauge(ldr, 0, 4095, 'gold'), texts[1],
+                               mk_gauge(hum_p, 0, 100, 'deepskyblue'), texts[2]] + tail
+        return main_out + [patch_gauge(temp_c), texts[0], patch_gauge(ldr), texts[1], patch_gauge(hum_p), texts[2]] + tail
 
     except Exception as e: 
         print(f"Erro no Update de Gráficos: {e}")
-        return [go.Figure()]*2 + ["Err"] + [go.Figure()] + ["Err"] + [go.Figure()] + ["Err"] + [{'backgroundColor':'red'}] + ["Err"] + [0]
+        return [go.Figure(), dash.no_update, go.Figure(), "Err", go.Figure(), "Err", go.Figure(), "Err", {'backgroundColor':'red'}, "Err", 0, None]
+
+def ia_resposta(dados, cache=False):
+    """Texto da sugestão e os três valores que preenchem os campos de setpoint."""
+    origem = " (consulta anterior, do cache)" if cache else ""
+    return [[html.H5("Sugestão da IA:"), html.P(dados['descricao']), html.Hr(), f"Valores sugeridos aplicados nos campos!{origem}"],
+            dados['umidade_ideal_percent'], dados['temperatura_ideal_celsius'], dados['fotoperiodo_horas']]
+
+IA_SEM_VALORES = [dash.no_update] * 3
 
 @app.callback(
-    [Output('out-api','children'), Output('in-hum','value'), Output('in-temp','value'), Output('in-meta','value')],
+    [Output('out-api','children'), Output('in-hum','value'), Output('in-temp','value'), Output('in-meta','value'),
+     Output('ia-job','data'), Output('ia-poll','disabled')],
     Input('btn-api','n_clicks'), State('in-plant','value'), prevent_initial_call=True
 )
 def ask_api(n, plant):
     """
     Integração com LLM: Pede JSON estruturado ao Gemini com parâmetros ideais.
-    Preenche automaticamente os inputs do usuário.
+    Planta já consultada responde na hora pelo cache; senão a consulta vai para a
+    thread ia_worker e ia_result preenche os inputs quando ela terminar.
     """
-    if not plant: return "Digite uma planta", dash.no_update, dash.no_update, dash.no_update
-    
-    prompt = f"""Dados para {plant}: JSON {{ "umidade_ideal_percent": float, "temperatura_ideal_celsius": float, "fotoperiodo_horas": float, "descricao": string }}"""
-    
+    if not plant or not plant.strip(): return ["Digite uma planta"] + IA_SEM_VALORES + [None, True]
     try:
-        if model:
-            resp = model.generate_content(prompt)
-            data = json.loads(resp.text.replace("```json","").replace("```",""))
-            
-            return [html.H5("Sugestão da IA:"), html.P(data['descricao']), html.Hr(), "Valores sugeridos aplicados nos campos!"], \
-                   data['umidade_ideal_percent'], \
-                   data['temperatura_ideal_celsius'], \
-                   data['fotoperiodo_horas']
-        return "Erro: API Key inválida", dash.no_update, dash.no_update, dash.no_update
-    except Exception as e: 
-        return f"Erro na IA: {e}", dash.no_update, dash.no_update, dash.no_update
+        chave, dados = ia_pede(plant) if model else (None, ia_cache_busca(normaliza_planta(plant)))
+        if dados is not None: return ia_resposta(dados, cache=True) + [None, True]
+        if chave is None: return ["Erro: API Key inválida"] + IA_SEM_VALORES + [None, True]
+        return [f"Consultando o Gemini sobre {plant.strip()}..."] + IA_SEM_VALORES + [chave, False]
+    except Exception as e:
+        return [f"Erro na IA: {e}"] + IA_SEM_VALORES + [None, True]
+
+@app.callback(
+    [Output('out-api','children', allow_duplicate=True), Output('in-hum','value', allow_duplicate=True),
+     Output('in-temp','value', allow_duplicate=True), Output('in-meta','value', allow_duplicate=True),
+     Output('ia-poll','disabled', allow_duplicate=True)],
+    Input('ia-poll','n_intervals'), State('ia-job','data'), prevent_initial_call=True
+)
+def ia_result(n, chave):
+    """Confere a consulta em andamento; ao terminar mostra o resultado e desliga o intervalo."""
+    with ia_lock: job = ia_jobs.get(chave)
+    if job is None: return [dash.no_update] + IA_SEM_VALORES + [True]
+    if job['estado'] == 'pendente': return [dash.no_update] * 5
+    if job['estado'] == 'erro': return [f"Erro na IA: {job['erro']}"] + IA_SEM_VALORES + [True]
+    return ia_resposta(job['dados']) + [True]
 
 @app.callback(
     Output('out-apply','children'), 
     Input('btn-apply','n_clicks'), 
-    [State('in-hum','value'), State('in-temp','value'), State('in-meta','value')], 
+    [State('in-hum','value'), State('in-temp','value'), State('in-meta','value'), State('device','value')], 
     prevent_initial_call=True
 )
-def apply_settings(n, h, t, m):
+def apply_settings(n, h, t, m, device):
     """
-    Envia comandos via Serial para o Microcontrolador.
-    Protocolo textual: SET,TIPO,VALOR
+    Envia comandos via Serial para a estufa selecionada.
+    Protocolo binário: um OP_BATCH com os quatro setpoints, confirmado por ACK.
     """
-    global ser
-    if ser and ser.is_open:
+    conn = conexao_ativa(device)
+    if conn:
         try:
-            # Converte valores físicos para RAW antes de enviar
-            cmd_hum = f"SET,HUMID,{calculate_humidity_setpoint_raw(float(h))}\n"
-            cmd_temp = f"SET,TEMP,{calculate_temp_setpoint_raw(float(t))}\n"
-            cmd_ldr = f"SET,LDR,{LDR_LIMIAR_FIXO}\n"
-            cmd_meta = f"SET,META_LUZ,{int(float(m)*3600)}\n"
-            
-            ser.write(cmd_hum.encode()); time.sleep(0.1)
-            ser.write(cmd_temp.encode()); time.sleep(0.1)
-            ser.write(cmd_ldr.encode()); time.sleep(0.1)
-            ser.write(cmd_meta.encode())
-            
-            return dbc.Alert("Configurações enviadas com sucesso!", color="success")
+            # Setpoints em centésimos: a conversão para o ADC fica no firmware
+            status = set_params(conn['ser'], [
+                (PARAM_HUMID_PCT, round(float(h) * 100)),
+                (PARAM_TEMP_C, round(float(t) * 100) & 0xFFFFFFFF),
+                (PARAM_LDR, LDR_LIMIAR_FIXO),
+                (PARAM_META_LUZ, int(float(m)*3600)),
+            ])
+            if status is None:
+                return dbc.Alert("Sem confirmação do firmware (ACK não recebido)", color="warning")
+            if status != 0:
+                return dbc.Alert(f"Firmware rejeitou: {ACK_STATUS.get(status, status)}", color="danger")
+            return dbc.Alert(f"Configurações confirmadas pela estufa {device:08X}!", color="success")
         except Exception as e:
             return dbc.Alert(f"Erro ao enviar: {e}", color="danger")
     return dbc.Alert("Erro: Serial desconectada", color="danger")
@@ -391,44 +1551,92 @@ def apply_settings(n, h, t, m):
 @app.callback(Output('out-apply','children', allow_duplicate=True), Input('clock','n_intervals'), prevent_initial_call=True)
 def scheduled_events(n):
     """
-    Eventos agendados (Relógio).
-    Reseta o contador de luz do firmware à meia-noite.
+    Eventos agendados (Relógio), para todas as estufas conectadas.
+    Reacerta o RTC do firmware (que zera o contador de luz sozinho à meia-noite).
     Controla ativação do fotoperíodo baseado na hora do servidor.
     """
-    global ser
-    if ser and ser.is_open:
-        now = datetime.now()
-        # Reset diário
-        if now.hour == 0 and now.minute == 0: 
-            ser.write(b"RESET,TIMER_LUZ\n")
-        
-        # Habilita fotoperíodo entre 01:00 e 23:00 (Exemplo)
-        ser.write(b"SET,FOTO,1\n" if 1 <= now.hour < 23 else b"SET,FOTO,0\n")
+    now = datetime.now()
+    for conn in list(conexoes):
+        ser = conn['ser']
+        if ser is None or conn['baud_troca'] is not None: continue # Troca de baud pendente: o hub acerta o RTC em seguida
+        try:
+            sync_clock(ser) # Corrige a deriva do RTC; perder uma chamada não atrasa a virada do dia
+
+            # Habilita fotoperíodo entre 01:00 e 23:00 (Exemplo)
+            send_command(ser, OP_SET_PARAM, struct.pack('>BI', PARAM_FOTO, 1 if 1 <= now.hour < 23 else 0), wait=False)
+        except Exception as e:
+            print(f"[ERRO {conn['porta']}] Evento agendado: {e}")
     return dash.no_update
 
+@app.callback(
+    Output('out-diag','children'),
+    [Input('btn-diag','n_clicks'), Input('btn-diag-reset','n_clicks'), Input('tick','n_intervals')], State('device','value'),
+    prevent_initial_call=True
+)
+def update_diagnostics(n, n_reset, tick, device):
+    """
+    Pede as estatísticas ao firmware da estufa selecionada (botões) e renderiza o último
+    diagnóstico recebido dela. A resposta chega assíncrona pela thread serial; o tick redesenha a tabela.
+    """
+    trigger = dash.callback_context.triggered[0]['prop_id'] if dash.callback_context.triggered else ''
+    conn = conexao_ativa(device)
+    if trigger.startswith('btn-diag') and conn:
+        send_command(conn['ser'], OP_GET_STATS, b'\x01' if trigger.startswith('btn-diag-reset') else b'', wait=False)
+    st = ingest_stats
+    ingest = html.P(f"Ingestão SQLite: fila {st['fila']} (pico {st['fila_pico']}) | {st['gravadas']} gravadas, "
+                    f"{st['descartadas']} descartadas | {st['lotes']} lotes (último x{st['lote_ultimo']}) | "
+                    f"flush {st['flush_ms_ultimo']:.1f} ms (média {st['flush_ms_medio']:.1f}, máx {st['flush_ms_max']:.1f})",
+                    className="small")
+    conn = dispositivos.get(device)
+    diag = conn['diag'] if conn else None
+    if diag is None or diag['atualizado'] is None:
+        return [html.P("Nenhum diagnóstico do firmware recebido ainda."), ingest]
+
+    header = html.Thead(html.Tr([html.Th(c) for c in ["Seção", "Amostras", "Mín (µs)", "Média (µs)", "Máx (µs)"]]))
+    body = html.Tbody([
+        html.Tr([html.Td(PERF_SECOES[i] if i < len(PERF_SECOES) else f"#{i}"), html.Td(s['contagem']),
+                 html.Td(f"{s['min_us']:.1f}"), html.Td(f"{s['media_us']:.1f}"), html.Td(f"{s['max_us']:.1f}")])
+        for i, s in sorted(diag['secoes'].items())
+    ])
+    children = [dbc.Table([header, body], bordered=True, size="sm", color="dark")]
+    if diag['contadores'] is not None:
+        itens = [f"{nome}: {v}" for nome, v in zip(PERF_CONTADORES, diag['contadores'])]
+        itens.append(f"quadros perdidos no enlace: {conn['lost']}")
+        itens.append(f"amostras faltando entre lotes: {conn['amostras_perdidas']}")
+        r = conn['relogio']
+        itens.append(f"deriva do relógio: {r['deriva'] * 1e6:+.1f} ppm")
+        if conn['taxa']: itens.append(f"taxa: {conn['taxa']}")
+        ativas = [f"{t} em {o} desde {datetime.fromtimestamp(ms / 1000):%H:%M:%S}" for (t, o), ms in conn['anomalias'].items()]
+        itens.append(f"anomalias ativas: {', '.join(ativas) if ativas else 'nenhuma'}")
+        children.append(html.P(" | ".join(itens), className="small"))
+    children.append(ingest)
+    children.append(html.P(f"Atualizado em {diag['atualizado']:%H:%M:%S}", className="small"))
+    return children
+
 # =============================================================================
 # INICIALIZAÇÃO E MAIN
 # =============================================================================
 
-ser = None
 # Silencia logs desnecessários do servidor Flask interno
 log = logging.getLogger('werkzeug'); log.setLevel(logging.ERROR)
 
 if __name__ == '__main__':
     print(">>> Inicializando Sistema da Estufa...")
     init_db()
+    live_seed()
+    if ARQUIVO_IDADE_DIAS > 0 and pa is not None:
+        threading.Thread(target=arquivador, daemon=True).start()
+    elif ARQUIVO_IDADE_DIAS > 0:
+        print(">>> AVISO: pyarrow não instalado; leituras antigas ficam no SQLite (sem arquivo Parquet)")
+    if model is not None:
+        threading.Thread(target=ia_worker, daemon=True).start()
     
-    # Tenta conexão serial
-    try: 
-        ser = serial.Serial(COM_PORT, BAUD_RATE, timeout=2)
-        print(f">>> Serial conectada em {COM_PORT}")
-    except: 
-        print(">>> AVISO: Serial Offline (Modo de visualização apenas)")
-    
-    # Inicia Thread de Leitura em Background
-    if ser: 
-        t = threading.Thread(target=read_from_pico, args=(ser,), daemon=True)
-        t.start()
+    # Inicia Threads de Leitura e Gravação em Background (as portas abrem e reconectam na thread serial)
+    if COM_PORTS or SERIAL_AUTODETECTA_USB:
+        threading.Thread(target=db_writer, daemon=True).start()
+        threading.Thread(target=serial_hub, args=(COM_PORTS,), daemon=True).start()
+    else:
+        print(">>> AVISO: Nenhuma porta serial configurada nem detecção USB (Modo de visualização apenas)")
     
     # Inicia Servidor Web
 
@@ -0,0 +1,645 @@
+/**
+ * @file bench_estufa.c
+ * @brief Benchmark do firmware no host: reproduz leituras gravadas e mede custo.
+ *
+ * Uso: bench_estufa [banco.db] [ticks]
+ * 1. Filtro/controle: cada leitura de minha_estufa.db vira o valor do ADC simulado
+ *    durante um período de 100ms (timer_callback + DMA do ADC + controle + telemetria).
+ * 2. Parser: um fluxo de comandos binários (SET_PARAM/BATCH) e ASCII (SET,...) é
+ *    injetado na UART em fatias do tamanho da FIFO e processado por tarefa_io().
+ * 3. Backlog: GET,BACKLOG descarrega o log em flash gravado na fase 1; confere que os
+ *    seq chegam completos e em ordem.
+ * 4-6. USB, lotes compactos e taxa adaptativa.
+ * 7. Anomalias: NTC aberto e bomba ligada sem resposta; confere início e fim das bordas.
+ * 8. Configuração persistente: apaga a RAM como num reset e confere o que volta da flash.
+ * Após cada fase o benchmark pede GET,STATS,1 e imprime a instrumentação do próprio
+ * firmware (ns por seção no host), além da vazão medida pelo relógio do host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "sim_hal.h"
+
+// --- Interface do Firmware (Estufa.c) ---
+void io_init(void);
+void adc_dma_init(void);
+void tarefa_io(void);
+void tarefa_controle(void);
+void tarefa_log(void);
+void flash_log_init(void);
+bool config_init(void);
+void tarefa_config(void);
+void atuadores_init(void);
+void dispositivo_init(void);
+bool timer_callback(repeating_timer_t *t);
+uint16_t crc16(const uint8_t *dados, uint32_t len);
+uint32_t cobs_codifica(const uint8_t *entrada, uint32_t len, uint8_t *saida);
+int cobs_decodifica(const uint8_t *entrada, uint32_t len, uint8_t *saida, uint32_t max);
+extern volatile uint16_t g_umidade_setpoint_cp, g_ldr_limiar_raw;
+extern volatile int16_t g_temp_setpoint_cc;
+extern volatile uint32_t g_meta_luz_segundos, g_segundos_de_luz_hoje, g_config_gravacoes;
+extern volatile bool g_fotoperiodo_ativo;
+extern volatile uint32_t g_rx_comandos_rejeitados;
+
+// Deve casar com PROTO_* / OP_* / PARAM_* em Estufa.c
+#define PROTO_VERSAO 1
+#define PROTO_TIPO_ACK 0x03
+#define PROTO_TIPO_STATS 0x04
+#define PROTO_TIPO_CONTADORES 0x05
+#define PROTO_TIPO_BACKLOG 0x06
+#define PROTO_TIPO_TELEMETRIA 0x01
+#define PROTO_TIPO_LOTE 0x02
+#define PROTO_TIPO_DELTA 0x07
+#define PROTO_TIPO_ANOMALIA 0x08
+#define ANOMALIA_DADOS 23 // [tipo][origem][ativa][valor i32][limiar i32][ID u32][t µs u64]
+#define ANOMALIA_ORIGENS 3
+#define ANOMALIA_FAIXA 0
+#define ANOMALIA_SEM_RESPOSTA 2
+#define CANAL_NTC 1
+#define ATUADOR_BOMBA 1
+#define BACKLOG_CABECALHO 9 // [n][uptime u32][ID u32]
+#define OP_SET_PARAM 0x10
+#define OP_BATCH 0x12
+#define PARAM_HUMID 0x01
+#define PARAM_TEMP 0x02
+#define PARAM_LDR 0x03
+
+#define TICK_US 100000 // TIMER_ISR_INTERVAL_MS
+#define TICKS_PADRAO 200000
+#define FATIA_RX 32    // Profundidade da FIFO de RX
+
+// Calibração do NTC (a mesma de app.py) para reconstruir o valor cru do ADC
+#define R_FIXO_NTC 10000.0
+#define R_NOMINAL_NTC 10000.0
+#define TEMP_NOMINAL_C 25.0
+#define BETA_NTC 3950.0
+#define ADC_MAX 4095.0
+
+static const char *SECOES[] = { "timer_callback", "on_uart_rx", "processa_comando", "telemetria", "on_adc_dma", "jitter (us)" };
+
+typedef struct { uint16_t ldr, ntc, umidade; } leitura_t;
+
+// --- Leitura do Traço Gravado ---
+static uint16_t ntc_raw_de_temp(double temp_c) {
+    double r = R_NOMINAL_NTC * exp(BETA_NTC * (1.0 / (temp_c + 273.15) - 1.0 / (TEMP_NOMINAL_C + 273.15)));
+    double raw = ADC_MAX * r / (r + R_FIXO_NTC);
+    return (uint16_t)(raw < 0 ? 0 : raw > ADC_MAX ? ADC_MAX : raw);
+}
+
+static leitura_t *carrega_traco(const char *caminho, int *n) {
+    sqlite3 *db;
+    sqlite3_stmt *st;
+    *n = 0;
+    if (sqlite3_open_v2(caminho, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Erro abrindo %s: %s\n", caminho, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    if (sqlite3_prepare_v2(db, "SELECT ldr_raw, temperature_c, umidade_raw FROM readings ORDER BY timestamp", -1, &st, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Erro lendo readings: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    int cap = 1024;
+    leitura_t *v = malloc(cap * sizeof(leitura_t));
+    while (sqlite3_step(st) == SQLITE_ROW) {
+        if (*n == cap) { cap *= 2; v = realloc(v, cap * sizeof(leitura_t)); }
+        double temp = sqlite3_column_type(st, 1) == SQLITE_NULL ? TEMP_NOMINAL_C : sqlite3_column_double(st, 1);
+        v[*n].ldr = (uint16_t)sqlite3_column_int(st, 0);
+        v[*n].ntc = ntc_raw_de_temp(temp);
+        v[*n].umidade = (uint16_t)sqlite3_column_int(st, 2);
+        (*n)++;
+    }
+    sqlite3_finalize(st);
+    sqlite3_close(db);
+    return v;
+}
+
+// --- Saída da UART e da USB (decodifica os quadros do firmware) ---
+// Cada enlace remonta seus próprios quadros: a troca não mistura bytes dos dois.
+typedef struct {
+    uint8_t quadro[512];
+    uint32_t len;
+    uint64_t bytes;
+} enlace_t;
+static enlace_t s_uart, s_usb;
+static uint64_t s_bytes_tx = 0, s_quadros_rx = 0, s_quadros_invalidos = 0;
+static uint64_t s_acks_ok = 0, s_acks_erro = 0;
+static uint32_t s_contadores[10];
+static uint64_t s_backlog_registros = 0, s_backlog_fora_de_ordem = 0;
+static int64_t s_backlog_ultimo_seq = -1;
+static bool s_backlog_fim = false;
+static uint64_t s_lote_amostras = 0, s_delta_amostras = 0, s_delta_invalidas = 0;
+static uint64_t s_telem_quadros = 0; // Pacotes de 1 s
+static uint8_t s_taxa_modo = 0;      // Modo de taxa do último pacote de 1 s
+static uint64_t s_adapt_falhas = 0, s_config_falhas = 0, s_parser_falhas = 0;
+// Quadros de anomalia: bordas por condição (tipo x ANOMALIA_ORIGENS + origem)
+static uint64_t s_anomalia_inicios[9], s_anomalia_fins[9], s_anomalia_invalidas = 0;
+static bool s_anomalia_estado[9];
+// Carimbos de tempo dos lotes: o t0 de cada quadro tem de continuar o anterior
+static uint64_t s_telem_proximo_us = 0, s_telem_lacunas = 0, s_telem_fora_de_ordem = 0;
+
+static uint32_t le_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t le_u64(const uint8_t *p) {
+    return ((uint64_t)le_u32(p) << 32) | le_u32(&p[4]);
+}
+
+/**
+ * @brief Confere o t0 do quadro contra o fim do anterior (meio período de folga).
+ */
+static void confere_carimbo(uint64_t t0, uint32_t periodo, uint32_t n) {
+    if (s_telem_proximo_us != 0) {
+        int64_t erro = (int64_t)(t0 - s_telem_proximo_us);
+        if (erro < -(int64_t)periodo / 2) s_telem_fora_de_ordem++;
+        else if (erro > (int64_t)periodo / 2) s_telem_lacunas++; // Amostras perdidas entre os quadros
+    }
+    s_telem_proximo_us = t0 + (uint64_t)n * periodo;
+}
+
+// Quadro PROTO_TIPO_DELTA decodificado por inteiro (mesmo algoritmo do app.py)
+static uint32_t le_varint(const uint8_t *d, uint32_t len, uint32_t *k, bool *ok) {
+    uint32_t v = 0;
+    for (int s = 0; s < 35; s += 7) {
+        if (*k >= len) break;
+        uint8_t b = d[(*k)++];
+        v |= (uint32_t)(b & 0x7F) << s;
+        if (!(b & 0x80)) return v;
+    }
+    *ok = false;
+    return 0;
+}
+
+static void decodifica_delta(const uint8_t *d, uint32_t len) {
+    bool ok = len >= 14;
+    uint32_t k = 14;
+    uint32_t periodo = ok ? le_varint(d, len, &k, &ok) : 0;
+    if (ok) confere_carimbo(le_u64(&d[6]), periodo, d[0]);
+    if (ok && (d[1] & 0x01)) le_varint(d, len, &k, &ok);
+    for (int a = 0; ok && (d[1] & 0x02) && a < 3; a++) {
+        if (le_varint(d, len, &k, &ok) > 1000) ok = false;
+    }
+    int32_t v[4] = {0, 0, 0, 0};
+    for (uint32_t i = 0; ok && i < d[0]; i++) {
+        for (int c = 0; c < 4; c++) {
+            uint32_t z = le_varint(d, len, &k, &ok);
+            v[c] += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+        }
+        // LDR e umidade crua são contagens de 12 bits; temperatura e umidade em centésimos
+        if (v[0] < 0 || v[0] > 4095 || v[2] < 0 || v[2] > 4095 || v[3] < 0 || v[3] > 10000) ok = false;
+        s_delta_amostras++;
+    }
+    if (!ok || k != len) s_delta_invalidas++; // Sobra ou falta de bytes também é erro
+}
+
+/**
+ * @brief Confere um quadro de anomalia: tamanho, faixas e alternância início/fim por condição.
+ */
+static void registra_anomalia(const uint8_t *d, uint32_t len) {
+    if (len != ANOMALIA_DADOS || d[0] >= 3 || d[1] >= ANOMALIA_ORIGENS || d[2] > 1) {
+        s_anomalia_invalidas++;
+        return;
+    }
+    int i = d[0] * ANOMALIA_ORIGENS + d[1];
+    if (s_anomalia_estado[i] == (d[2] != 0)) s_anomalia_invalidas++; // Duas bordas iguais seguidas
+    s_anomalia_estado[i] = d[2];
+    if (d[2]) s_anomalia_inicios[i]++; else s_anomalia_fins[i]++;
+}
+
+static void imprime_stats(const uint8_t *d) {
+    uint32_t clk = le_u32(&d[2]), contagem = le_u32(&d[6]);
+    if (d[0] >= sizeof(SECOES) / sizeof(SECOES[0]) || contagem == 0) return;
+    double escala = (d[1] == 1) ? 1.0 : 1e9 / clk; // Ciclos -> ns (jitter já vem em us)
+    printf("    %-18s %10u  %10.0f  %10.0f  %10.0f\n", SECOES[d[0]], contagem,
+           le_u32(&d[10]) * escala, le_u32(&d[18]) * escala, le_u32(&d[14]) * escala);
+}
+
+static void trata_quadro(const uint8_t *cobs, uint32_t len) {
+    uint8_t q[512];
+    int n = cobs_decodifica(cobs, len, q, sizeof(q));
+    if (n < 6 || q[0] != PROTO_VERSAO || crc16(q, (uint32_t)n - 2) != (uint16_t)((q[n - 2] << 8) | q[n - 1])) {
+        s_quadros_invalidos++;
+        return;
+    }
+    s_quadros_rx++;
+    const uint8_t *d = &q[4];
+    if (q[1] == PROTO_TIPO_ACK) {
+        if (d[3] == 0) s_acks_ok++; else s_acks_erro++;
+    } else if (q[1] == PROTO_TIPO_STATS) {
+        imprime_stats(d);
+    } else if (q[1] == PROTO_TIPO_CONTADORES) {
+        for (int i = 0; i < 10; i++) s_contadores[i] = le_u32(&d[4 * i]);
+    } else if (q[1] == PROTO_TIPO_TELEMETRIA) {
+        s_telem_quadros++;
+        s_taxa_modo = d[33];
+    } else if (q[1] == PROTO_TIPO_LOTE) {
+        s_lote_amostras += d[0];
+        confere_carimbo(le_u64(&d[16]), le_u32(&d[24]), d[0]);
+    } else if (q[1] == PROTO_TIPO_DELTA) {
+        decodifica_delta(d, (uint32_t)n - 6);
+    } else if (q[1] == PROTO_TIPO_ANOMALIA) {
+        registra_anomalia(d, (uint32_t)n - 6);
+    } else if (q[1] == PROTO_TIPO_BACKLOG) {
+        if (d[0] == 0) s_backlog_fim = true;
+        for (int i = 0; i < d[0]; i++) {
+            int64_t seq = le_u32(&d[BACKLOG_CABECALHO + 16 * i]);
+            if (s_backlog_ultimo_seq >= 0 && seq != s_backlog_ultimo_seq + 1) s_backlog_fora_de_ordem++;
+            s_backlog_ultimo_seq = seq;
+            s_backlog_registros++;
+        }
+    }
+}
+
+static void recebe(enlace_t *e, const uint8_t *dados, uint32_t len) {
+    s_bytes_tx += len;
+    e->bytes += len;
+    for (uint32_t i = 0; i < len; i++) {
+        if (dados[i] == 0x00) {
+            if (e->len) trata_quadro(e->quadro, e->len);
+            e->len = 0;
+        } else if (e->len < sizeof(e->quadro)) {
+            e->quadro[e->len++] = dados[i];
+        }
+    }
+}
+
+static void saida_uart(const uint8_t *dados, uint32_t len) { recebe(&s_uart, dados, len); }
+static void saida_usb(const uint8_t *dados, uint32_t len) { recebe(&s_usb, dados, len); }
+
+// --- Utilitários ---
+static double agora_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void injeta(const uint8_t *dados, uint32_t len) {
+    for (uint32_t i = 0; i < len; ) {
+        uint32_t fatia = (len - i < FATIA_RX) ? len - i : FATIA_RX;
+        i += sim_uart_injeta(&dados[i], fatia);
+        tarefa_io();
+        sim_conclui_tx();
+    }
+}
+
+static void pede_stats(const char *titulo) {
+    printf("  Instrumentação do firmware (%s)\n", titulo);
+    printf("    %-18s %10s  %10s  %10s  %10s\n", "seção (ns)", "contagem", "mín", "média", "máx");
+    injeta((const uint8_t *)"GET,STATS,1\n", 12);
+    printf("    TX: %u quadros, %u descartados | RX perdidas: %u | ASCII rejeitados: %u | falhas do log: %u | falhas da config: %u\n",
+           s_contadores[0], s_contadores[1], s_contadores[5], s_contadores[7], s_contadores[8], s_contadores[9]);
+}
+
+/**
+ * @brief Monta um comando binário completo: 0x00 + COBS([ver][op][seq][args][crc]) + 0x00.
+ */
+static uint32_t monta_comando(uint8_t op, uint16_t seq, const uint8_t *args, uint32_t len, uint8_t *saida) {
+    uint8_t carga[64];
+    carga[0] = PROTO_VERSAO; carga[1] = op; carga[2] = seq >> 8; carga[3] = seq & 0xFF;
+    memcpy(&carga[4], args, len);
+    uint16_t crc = crc16(carga, 4 + len);
+    carga[4 + len] = crc >> 8; carga[5 + len] = crc & 0xFF;
+    saida[0] = 0x00;
+    uint32_t n = cobs_codifica(carga, 6 + len, &saida[1]);
+    saida[1 + n] = 0x00;
+    return n + 2;
+}
+
+static uint32_t param(uint8_t *p, uint8_t id, uint32_t v) {
+    p[0] = id; p[1] = v >> 24; p[2] = (v >> 16) & 0xFF; p[3] = (v >> 8) & 0xFF; p[4] = v & 0xFF;
+    return 5;
+}
+
+static void injeta_usb(const uint8_t *dados, uint32_t len) {
+    for (uint32_t i = 0; i < len; ) {
+        i += sim_usb_injeta(&dados[i], len - i);
+        tarefa_io();
+    }
+}
+
+// --- Fases do Benchmark ---
+static void bench_filtro(const leitura_t *traco, int n, long ticks) {
+    printf("[1] Filtro + controle: %ld ticks de 100ms (%d leituras gravadas)\n", ticks, n);
+    double t0 = agora_s();
+    for (long i = 0; i < ticks; i++) {
+        const leitura_t *l = &traco[i % n];
+        sim_adc_define(0, l->ldr);
+        sim_adc_define(1, l->ntc);
+        sim_adc_define(2, l->umidade);
+        sim_avanca_us(TICK_US); // DMA do ADC (~12 blocos) + timer_callback
+        tarefa_controle();
+        tarefa_log();
+        tarefa_config();
+        tarefa_io();
+    }
+    double dt = agora_s() - t0;
+    printf("  %.0f ticks/s no host (%.0f ns/tick, %.1f s simulados)\n", ticks / dt, dt * 1e9 / ticks, ticks * TICK_US / 1e6);
+    pede_stats("filtro");
+}
+
+static void bench_parser(const leitura_t *traco, int n, long comandos) {
+    printf("[2] Parser: %ld comandos (2/3 binários, 1/3 ASCII)\n", comandos);
+    uint32_t cap = (uint32_t)comandos * 40, len = 0;
+    uint8_t *fluxo = malloc(cap);
+    uint32_t binarios = 0;
+    for (long i = 0; i < comandos; i++) {
+        const leitura_t *l = &traco[i % n];
+        uint8_t args[32];
+        uint32_t a = 0;
+        switch (i % 3) {
+        case 0:
+            a = param(args, PARAM_HUMID, l->umidade);
+            len += monta_comando(OP_SET_PARAM, (uint16_t)i, args, a, &fluxo[len]);
+            binarios++;
+            break;
+        case 1:
+            args[a++] = 3;
+            a += param(&args[a], PARAM_HUMID, l->umidade);
+            a += param(&args[a], PARAM_TEMP, l->ntc);
+            a += param(&args[a], PARAM_LDR, l->ldr);
+            len += monta_comando(OP_BATCH, (uint16_t)i, args, a, &fluxo[len]);
+            binarios++;
+            break;
+        default:
+            len += (uint32_t)sprintf((char *)&fluxo[len], "SET,TEMP,%u\n", l->ntc);
+            break;
+        }
+    }
+
+    uint64_t acks_antes = s_acks_ok + s_acks_erro;
+    double t0 = agora_s();
+    injeta(fluxo, len);
+    double dt = agora_s() - t0;
+    uint64_t acks = s_acks_ok + s_acks_erro - acks_antes;
+    printf("  %.2f MB/s, %.0f comandos/s no host (%.0f ns/comando)\n", len / dt / 1e6, comandos / dt, dt * 1e9 / comandos);
+    printf("  ACKs: %llu de %u comandos binários (%llu com erro)\n", (unsigned long long)acks, binarios, (unsigned long long)s_acks_erro);
+    free(fluxo);
+
+    // SET ASCII com valor extra: o extra recusado (ki acima de GANHO_MAX) e o nome desconhecido contam como rejeitados
+    uint32_t rejeitados = g_rx_comandos_rejeitados;
+    injeta((const uint8_t *)"SET,FAN_KP,300,999999\n", 22);
+    injeta((const uint8_t *)"SET,NADA,1\n", 11);
+    injeta((const uint8_t *)"SET,FAN_KP,300,20\n", 18); // Volta aos ganhos de fábrica
+    rejeitados = g_rx_comandos_rejeitados - rejeitados;
+    printf("  ASCII: %u de 3 SETs de teste rejeitados (esperado 2)\n", rejeitados);
+    if (rejeitados != 2) s_parser_falhas++;
+    pede_stats("parser");
+}
+
+static void bench_backlog(long ticks) {
+    long esperados = ticks / 10 / 10; // 1 tick de 1 s a cada 10 ticks; 1 registro a cada 10 s
+    printf("[3] Backlog: descarga do log em flash (%ld registros esperados)\n", esperados);
+    uint64_t bytes_antes = s_bytes_tx;
+    double t0 = agora_s();
+    injeta((const uint8_t *)"GET,BACKLOG\n", 12);
+    while (!s_backlog_fim) {
+        tarefa_io(); // Retoma a cada EVT_TX_VAZIA
+        sim_conclui_tx();
+    }
+    double dt = agora_s() - t0;
+    uint64_t bytes = s_bytes_tx - bytes_antes;
+    printf("  %llu registros (%llu fora de ordem), %llu bytes em %.1f ms no host\n", (unsigned long long)s_backlog_registros,
+           (unsigned long long)s_backlog_fora_de_ordem, (unsigned long long)bytes, dt * 1e3);
+    printf("  No fio: %.1f s a 115200 baud, %.1f s a 921600 baud\n", bytes * 10 / 115200.0, bytes * 10 / 921600.0);
+    // Sem dar a volta no log (16384 registros, menos o setor em uso) nada pode faltar
+    if (esperados <= 16384 - 256 && s_backlog_registros != (uint64_t)esperados) s_backlog_fora_de_ordem++;
+}
+
+static void bench_usb(long ticks) {
+    printf("[4] USB CDC: descarga do log em flash pelo enlace USB\n");
+    sim_conclui_tx(); // Nada da UART pela metade na troca
+    sim_usb_conecta(true);
+    uint64_t uart_antes = s_uart.bytes, usb_antes = s_usb.bytes, registros_antes = s_backlog_registros;
+    s_backlog_ultimo_seq = -1;
+    s_backlog_fim = false;
+    double t0 = agora_s();
+    injeta_usb((const uint8_t *)"GET,BACKLOG\n", 12);
+    while (!s_backlog_fim) tarefa_io(); // A FIFO do CDC simulada nunca enche
+    double dt = agora_s() - t0;
+    uint64_t bytes = s_usb.bytes - usb_antes, registros = s_backlog_registros - registros_antes;
+    printf("  %llu registros, %llu bytes em %.1f ms no host (%.2f MB/s)\n", (unsigned long long)registros,
+           (unsigned long long)bytes, dt * 1e3, bytes / dt / 1e6);
+    printf("  No fio: %.2f s em USB full-speed (~1 MB/s úteis) contra %.1f s a 9600 baud\n", bytes / 1e6, bytes * 10 / 9600.0);
+    // Com a USB ativa nada pode sair pela UART, e a descarga tem de ser a mesma da fase [3]
+    long esperados = ticks / 10 / 10;
+    if (s_uart.bytes != uart_antes || (esperados <= 16384 - 256 && registros != (uint64_t)esperados)) s_backlog_fora_de_ordem++;
+    sim_usb_conecta(false);
+}
+
+/**
+ * @brief Roda a telemetria de alta taxa pela UART com ruído de ±RUIDO contagens no ADC.
+ * Retorna os bytes transmitidos no período.
+ */
+#define RUIDO 6
+static uint64_t roda_alta_taxa(const leitura_t *traco, int n, long ticks) {
+    uint64_t antes = s_uart.bytes;
+    for (long i = 0; i < ticks; i++) {
+        const leitura_t *l = &traco[i % n];
+        for (int f = 0; f < 10; f++) { // 10 ms por vez: cada amostra de 100 Hz vê um ruído novo
+            sim_adc_define(0, (uint16_t)(l->ldr + rand() % (2 * RUIDO + 1) - RUIDO));
+            sim_adc_define(1, (uint16_t)(l->ntc + rand() % (2 * RUIDO + 1) - RUIDO));
+            sim_adc_define(2, (uint16_t)(l->umidade + rand() % (2 * RUIDO + 1) - RUIDO));
+            sim_avanca_us(TICK_US / 10);
+            tarefa_io();
+            sim_conclui_tx();
+        }
+        tarefa_controle();
+        tarefa_log();
+        tarefa_config();
+    }
+    return s_uart.bytes - antes;
+}
+
+static void bench_delta(const leitura_t *traco, int n, long ticks) {
+    printf("[5] Telemetria compacta: lotes de 8 bytes/amostra contra deltas em varint (100 Hz, %ld ticks)\n", ticks);
+    srand(1);
+    injeta((const uint8_t *)"SET,TELEM,100,26\n", 17);
+    uint64_t bytes_lote = roda_alta_taxa(traco, n, ticks);
+    injeta((const uint8_t *)"SET,TELEM_DELTA,1\n", 18);
+    injeta((const uint8_t *)"SET,TELEM,100,48\n", 17);
+    s_telem_proximo_us = 0; // A troca de modo descarta as amostras na fila
+    uint64_t bytes_delta = roda_alta_taxa(traco, n, ticks);
+    injeta((const uint8_t *)"SET,TELEM_DELTA,0\n", 18);
+    injeta((const uint8_t *)"SET,TELEM,0,10\n", 15);
+
+    double por_lote = s_lote_amostras ? (double)bytes_lote / s_lote_amostras : 0;
+    double por_delta = s_delta_amostras ? (double)bytes_delta / s_delta_amostras : 0;
+    printf("  Lote: %llu amostras, %.2f bytes/amostra no fio | Delta: %llu amostras, %.2f bytes/amostra (%llu quadros inválidos)\n",
+           (unsigned long long)s_lote_amostras, por_lote, (unsigned long long)s_delta_amostras, por_delta,
+           (unsigned long long)s_delta_invalidas);
+    if (por_delta > 0) printf("  Redução: %.2fx\n", por_lote / por_delta);
+    printf("  Carimbos de tempo: %llu lacunas entre quadros, %llu fora de ordem\n",
+           (unsigned long long)s_telem_lacunas, (unsigned long long)s_telem_fora_de_ordem);
+    // As duas rodadas cobrem o mesmo tempo: tem de chegar praticamente o mesmo número de amostras
+    if (s_delta_amostras + 100 < s_lote_amostras || s_telem_fora_de_ordem) s_delta_invalidas++;
+}
+
+/**
+ * @brief Roda `segundos` com o ADC parado em l; retorna os bytes transmitidos pela UART.
+ */
+static uint64_t roda_parado(const leitura_t *l, long segundos) {
+    uint64_t antes = s_uart.bytes;
+    sim_adc_define(0, l->ldr);
+    sim_adc_define(1, l->ntc);
+    sim_adc_define(2, l->umidade);
+    for (long i = 0; i < segundos * 10; i++) {
+        sim_avanca_us(TICK_US);
+        tarefa_controle();
+        tarefa_log();
+        tarefa_config();
+        tarefa_io();
+        sim_conclui_tx();
+    }
+    return s_uart.bytes - antes;
+}
+
+static void bench_adaptativo(const leitura_t *traco) {
+    printf("[6] Taxa adaptativa: sinais parados contra um degrau no LDR\n");
+    leitura_t l = traco[0];
+    roda_parado(&l, 120); // Filtros e malhas PI assentam
+    uint64_t q0 = s_telem_quadros;
+    uint64_t fixo = roda_parado(&l, 100);
+    uint64_t quadros_fixo = s_telem_quadros - q0;
+
+    injeta((const uint8_t *)"SET,ADAPT,1\n", 12);
+    roda_parado(&l, 70); // Sem gatilho: 1 s até ADAPT_CALMA_S, depois batimento
+    q0 = s_telem_quadros;
+    uint64_t parado = roda_parado(&l, 100);
+    uint64_t quadros_parado = s_telem_quadros - q0;
+    uint8_t modo_parado = s_taxa_modo;
+
+    uint64_t amostras0 = s_lote_amostras;
+    l.ldr = (uint16_t)(l.ldr > 2048 ? l.ldr - 800 : l.ldr + 800); // Nuvem passando / lâmpada acendendo
+    uint64_t degrau = roda_parado(&l, 40);
+    uint64_t amostras_rajada = s_lote_amostras - amostras0;
+    injeta((const uint8_t *)"SET,ADAPT,0\n", 12);
+
+    printf("  Fixo: %llu pacotes, %llu bytes em 100 s | Adaptativo parado: %llu pacotes (modo %u), %llu bytes (%.1fx menos)\n",
+           (unsigned long long)quadros_fixo, (unsigned long long)fixo, (unsigned long long)quadros_parado, modo_parado,
+           (unsigned long long)parado, parado ? (double)fixo / parado : 0.0);
+    printf("  Degrau no LDR: %llu amostras de alta taxa, %llu bytes em 40 s\n",
+           (unsigned long long)amostras_rajada, (unsigned long long)degrau);
+    // Parado: batimento de 10 s (modo 1); degrau: ao menos ADAPT_RAJADA_S de rajada a 50 Hz
+    if (quadros_parado < 8 || quadros_parado > 12 || modo_parado != 1 || amostras_rajada < 20 * 50) s_adapt_falhas++;
+}
+
+static void bench_anomalias(const leitura_t *traco) {
+    printf("[7] Anomalias: NTC aberto e bomba ligada sem resposta\n");
+    const int faixa_ntc = ANOMALIA_FAIXA * ANOMALIA_ORIGENS + CANAL_NTC;
+    const int bomba = ANOMALIA_SEM_RESPOSTA * ANOMALIA_ORIGENS + ATUADOR_BOMBA;
+    leitura_t l = traco[0];
+    injeta((const uint8_t *)"SET,HUMID_PCT,3000\n", 19); // 30 % (a fase 2 deixa setpoints aleatórios)
+    l.umidade = 1000; // ~39 %, acima do setpoint: bomba desligada
+    roda_parado(&l, 60);
+
+    leitura_t aberto = l;
+    aberto.ntc = 4095;
+    uint64_t inicios0 = s_anomalia_inicios[faixa_ntc];
+    long latencia = -1;
+    for (long t = 1; t <= 10 && latencia < 0; t++) {
+        roda_parado(&aberto, 1);
+        if (s_anomalia_inicios[faixa_ntc] != inicios0) latencia = t;
+    }
+    roda_parado(&l, 20);
+    bool ntc_ok = latencia > 0 && !s_anomalia_estado[faixa_ntc];
+
+    leitura_t seco = l;
+    seco.umidade = 3900; // 0 %: a malha liga a bomba e a leitura não reage
+    inicios0 = s_anomalia_inicios[bomba];
+    roda_parado(&seco, 150);
+    bool bomba_iniciou = s_anomalia_inicios[bomba] != inicios0;
+    roda_parado(&l, 20);
+    bool bomba_ok = bomba_iniciou && !s_anomalia_estado[bomba];
+
+    uint64_t inicios = 0, fins = 0;
+    for (int i = 0; i < 9; i++) { inicios += s_anomalia_inicios[i]; fins += s_anomalia_fins[i]; }
+    printf("  NTC aberto detectado em %ld s, %s | bomba sem resposta: %s\n", latencia,
+           ntc_ok ? "encerrado ao voltar" : "FALHOU", bomba_ok ? "início e fim" : "FALHOU");
+    printf("  Bordas no benchmark inteiro: %llu inícios, %llu fins, %llu quadros inconsistentes\n",
+           (unsigned long long)inicios, (unsigned long long)fins, (unsigned long long)s_anomalia_invalidas);
+    if (!ntc_ok || !bomba_ok) s_anomalia_invalidas++;
+}
+
+static void bench_config(const leitura_t *traco) {
+    printf("[8] Configuração persistente: reset simulado e partida a quente\n");
+    static const char *comandos[] = {
+        "SET,HUMID_PCT,4321\n", "SET,TEMP_C,2468\n", "SET,LDR,4000\n", "SET,META_LUZ,36000\n", "SET,FOTO,1\n",
+    };
+    leitura_t l = traco[0];
+    uint32_t gravacoes0 = g_config_gravacoes;
+    for (unsigned i = 0; i < sizeof(comandos) / sizeof(comandos[0]); i++)
+        injeta((const uint8_t *)comandos[i], (uint32_t)strlen(comandos[i]));
+    roda_parado(&l, 5);
+    uint32_t gravacoes_set = g_config_gravacoes - gravacoes0;
+    roda_parado(&l, 600); // Fotoperíodo ligado: a dose anda e é gravada a cada CONFIG_LUZ_PERIODO_S
+    uint32_t gravacoes_luz = g_config_gravacoes - gravacoes0 - gravacoes_set;
+
+    // "Reset": a RAM volta aos valores compilados e o boot restaura da flash
+    uint16_t umid = g_umidade_setpoint_cp, ldr = g_ldr_limiar_raw;
+    int16_t temp = g_temp_setpoint_cc;
+    uint32_t meta = g_meta_luz_segundos, luz = g_segundos_de_luz_hoje;
+    g_umidade_setpoint_cp = 753; g_temp_setpoint_cc = 3535; g_ldr_limiar_raw = 2000;
+    g_meta_luz_segundos = 14 * 3600; g_fotoperiodo_ativo = false; g_segundos_de_luz_hoje = 0;
+    bool restaurou = config_init();
+    bool ok = restaurou && g_umidade_setpoint_cp == umid && g_temp_setpoint_cc == temp && g_ldr_limiar_raw == ldr
+           && g_meta_luz_segundos == meta && g_fotoperiodo_ativo && g_segundos_de_luz_hoje <= luz
+           && luz - g_segundos_de_luz_hoje <= 300 && umid == 4321 && temp == 2468;
+    printf("  %s | %u gravação(ões) pelos SETs, %u pela dose em 600 s (%u s de luz de %u restaurados)\n",
+           ok ? "Setpoints, fotoperíodo e dose restaurados" : "FALHOU", gravacoes_set, gravacoes_luz,
+           g_segundos_de_luz_hoje, luz);
+    printf("  Registros gravados no benchmark inteiro: %u (um apagamento de setor a cada 16)\n", g_config_gravacoes);
+    if (!ok || gravacoes_set != 1) s_config_falhas++;
+
+    // Sem SET,TIME o RTC segue inválido: a dose restaurada tem de zerar 24 h depois da restauração
+    roda_parado(&l, 86400 - 10);
+    uint32_t antes = g_segundos_de_luz_hoje;
+    roda_parado(&l, 12);
+    bool virou = antes > 300 && g_segundos_de_luz_hoje <= 5;
+    printf("  Sem RTC: %s (%u s de luz 10 s antes de 24 h, %u s depois)\n", virou ? "dia virado pelo uptime" : "FALHOU",
+           antes, g_segundos_de_luz_hoje);
+    if (!virou) s_config_falhas++;
+}
+
+int main(int argc, char **argv) {
+    const char *caminho = (argc > 1) ? argv[1] : ESTUFA_DB_PADRAO;
+    long ticks = (argc > 2) ? atol(argv[2]) : TICKS_PADRAO;
+    int n;
+    leitura_t *traco = carrega_traco(caminho, &n);
+    if (traco == NULL || n == 0) {
+        fprintf(stderr, "Nenhuma leitura em %s\n", caminho);
+        return 1;
+    }
+
+    // Mesma sequência de inicialização do main() do firmware (núcleo único)
+    sim_uart_define_saida(saida_uart);
+    sim_usb_define_saida(saida_usb);
+    dispositivo_init();
+    io_init();
+    flash_log_init();
+    atuadores_init();
+    config_init();
+    rtc_init();
+    adc_dma_init();
+    repeating_timer_t timer;
+    add_repeating_timer_ms(-100, timer_callback, NULL, &timer);
+
+    bench_filtro(traco, n, ticks);
+    bench_parser(traco, n, ticks / 2);
+    bench_backlog(ticks);
+    bench_usb(ticks);
+    bench_delta(traco, n, ticks / 100);
+    bench_adaptativo(traco);
+    bench_anomalias(traco);
+    bench_config(traco);
+    printf("Quadros recebidos: %llu (%llu inválidos), %llu bytes TX\n",
+           (unsigned long long)s_quadros_rx, (unsigned long long)s_quadros_invalidos, (unsigned long long)s_bytes_tx);
+
+    free(traco);
+    return (s_quadros_invalidos || s_backlog_fora_de_ordem || s_delta_invalidas || s_adapt_falhas || s_anomalia_invalidas || s_config_falhas || s_parser_falhas) ? 1 : 0;
+}
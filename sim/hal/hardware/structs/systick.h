@@ -0,0 +1,2 @@
+// Simulação no host: ver sim_hal.h
+#include "../../sim_hal.h"
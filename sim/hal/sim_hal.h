@@ -0,0 +1,234 @@
+/**
+ * @file sim_hal.h
+ * @brief HAL falso do Pico SDK para compilar Estufa.c no host (build de simulação).
+ *
+ * Declara somente a parte da API que o firmware usa. Os cabeçalhos do SDK em
+ * sim/hal/pico e sim/hal/hardware apenas incluem este arquivo.
+ * O tempo é simulado: nada acontece até o harness chamar sim_avanca_us(), que
+ * dispara os timers, fecha blocos do DMA do ADC e conclui as transmissões da UART
+ * na ordem cronológica. Tudo roda numa única thread (as "ISRs" são chamadas diretas).
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+// --- Tempo e Timers ---
+typedef uint64_t absolute_time_t;
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *t);
+struct repeating_timer {
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void *user_data;
+};
+
+absolute_time_t get_absolute_time(void);
+uint32_t to_ms_since_boot(absolute_time_t t);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t cb, void *user_data, repeating_timer_t *t);
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t cb, void *user_data, repeating_timer_t *t);
+bool cancel_repeating_timer(repeating_timer_t *t);
+void sleep_ms(uint32_t ms);
+static inline void tight_loop_contents(void) {}
+void stdio_init_all(void);
+
+// --- Sincronização (núcleo único no host) ---
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t estado) { (void)estado; }
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __sev(void) {}
+static inline void __wfe(void) {}
+static inline void __wfi(void) {}
+
+// --- GPIO ---
+#define GPIO_OUT 1
+#define GPIO_IN 0
+#define GPIO_FUNC_UART 2
+#define GPIO_FUNC_PWM 4
+void gpio_init(uint pino);
+void gpio_set_dir(uint pino, bool saida);
+void gpio_put(uint pino, bool valor);
+bool gpio_get(uint pino);
+void gpio_set_function(uint pino, int funcao);
+
+// --- PWM ---
+static inline uint pwm_gpio_to_slice_num(uint pino) { return (pino >> 1) & 7u; }
+void pwm_set_clkdiv(uint slice, float div);
+void pwm_set_wrap(uint slice, uint16_t wrap);
+void pwm_set_gpio_level(uint pino, uint16_t nivel);
+void pwm_set_enabled(uint slice, bool habilitado);
+
+// --- IRQ ---
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define UART0_IRQ 20
+typedef void (*irq_handler_t)(void);
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool habilitada);
+
+// --- ADC ---
+typedef struct { volatile uint32_t fifo; } adc_hw_t;
+extern adc_hw_t *adc_hw;
+void adc_init(void);
+void adc_gpio_init(uint pino);
+void adc_select_input(uint canal);
+uint16_t adc_read(void);
+void adc_set_round_robin(uint mascara);
+void adc_fifo_setup(bool en, bool dreq_en, uint limiar, bool err_in_fifo, bool byte_shift);
+void adc_set_clkdiv(float div);
+void adc_run(bool rodando);
+void adc_fifo_drain(void);
+
+// --- UART ---
+typedef struct uart_inst uart_inst_t;
+typedef struct { volatile uint32_t dr; } uart_hw_t;
+extern uart_inst_t *const sim_uart0;
+#define uart0 sim_uart0
+uint uart_init(uart_inst_t *uart, uint baud);
+uint uart_set_baudrate(uart_inst_t *uart, uint baud);
+bool uart_is_readable(uart_inst_t *uart);
+char uart_getc(uart_inst_t *uart);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *dados, size_t len);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx, bool tx);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+uint uart_get_dreq(uart_inst_t *uart, bool tx);
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+
+// --- DMA ---
+#define DMA_SIZE_8 0
+#define DMA_SIZE_16 1
+#define DMA_SIZE_32 2
+#define DREQ_ADC 36
+typedef struct {
+    uint8_t tamanho;
+    int8_t encadeia;
+    bool incrementa_escrita;
+    bool anel_escrita;  // Anel no endereço de escrita (senão na leitura)
+    uint8_t anel_bits;  // 0 = sem anel
+} dma_channel_config;
+// Registradores de um canal: write_addr acompanha a transferência; escrever em
+// al2_write_addr_trig (só por outro canal DMA, como no hardware) redireciona e dispara
+typedef struct {
+    volatile uintptr_t read_addr, write_addr, transfer_count, al2_write_addr_trig;
+} dma_channel_hw_t;
+dma_channel_hw_t *dma_channel_hw_addr(uint canal);
+int dma_claim_unused_channel(bool obrigatorio);
+dma_channel_config dma_channel_get_default_config(uint canal);
+void channel_config_set_transfer_data_size(dma_channel_config *c, int tamanho);
+void channel_config_set_read_increment(dma_channel_config *c, bool incrementa);
+void channel_config_set_write_increment(dma_channel_config *c, bool incrementa);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_chain_to(dma_channel_config *c, uint canal);
+void channel_config_set_ring(dma_channel_config *c, bool escrita, uint bits);
+void dma_channel_configure(uint canal, const dma_channel_config *c, volatile void *escrita,
+                           const volatile void *leitura, uint contagem, bool dispara);
+void dma_channel_set_irq0_enabled(uint canal, bool habilitada);
+void dma_channel_set_irq1_enabled(uint canal, bool habilitada);
+bool dma_channel_get_irq0_status(uint canal);
+void dma_channel_acknowledge_irq0(uint canal);
+void dma_channel_acknowledge_irq1(uint canal);
+void dma_channel_set_write_addr(uint canal, volatile void *escrita, bool dispara);
+void dma_channel_set_read_addr(uint canal, const volatile void *leitura, bool dispara);
+void dma_channel_abort(uint canal);
+void dma_channel_start(uint canal);
+void dma_channel_transfer_from_buffer_now(uint canal, const volatile void *leitura, uint32_t contagem);
+
+// --- Flash (memória de 2 MB no host, mapeada em XIP_BASE) ---
+#define PICO_OK 0
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#define FLASH_PAGE_SIZE 256u
+#define FLASH_SECTOR_SIZE 4096u
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash)
+void flash_range_erase(uint32_t offset, size_t len);
+void flash_range_program(uint32_t offset, const uint8_t *dados, size_t len);
+int flash_safe_execute(void (*funcao)(void *), void *param, uint32_t timeout_ms);
+
+// --- RTC (anda junto com o relógio simulado) ---
+typedef struct {
+    int16_t year;
+    int8_t month, day, dotw, hour, min, sec;
+} datetime_t;
+void rtc_init(void);
+bool rtc_set_datetime(const datetime_t *t);
+bool rtc_get_datetime(datetime_t *t);
+
+// --- ID único da placa (fixo no simulador) ---
+#define PICO_UNIQUE_BOARD_ID_SIZE_BYTES 8
+typedef struct { uint8_t id[PICO_UNIQUE_BOARD_ID_SIZE_BYTES]; } pico_unique_board_id_t;
+void pico_get_unique_board_id(pico_unique_board_id_t *id);
+
+// --- USB (CDC falso: o "host" do harness lê na hora; vide sim_usb_*) ---
+// Descritores só precisam compilar: o simulador não enumera
+#define OPT_OS_PICO 0
+#define OPT_MODE_DEVICE 1
+#define TUSB_DESC_DEVICE 0x01
+#define TUSB_DESC_STRING 0x03
+#define TUSB_CLASS_MISC 0xEF
+#define MISC_SUBCLASS_COMMON 0x02
+#define MISC_PROTOCOL_IAD 0x01
+#define TUD_CONFIG_DESC_LEN 9
+#define TUD_CDC_DESC_LEN 66
+#define TUD_CONFIG_DESCRIPTOR(num, itfs, str, total, attr, ma) 9, 0x02, (total) & 0xFF, (total) >> 8, itfs, num, str, 0x80 | (attr), (ma) / 2
+#define TUD_CDC_DESCRIPTOR(itf, str, ep_notif, notif_tam, ep_saida, ep_entrada, ep_tam) \
+    8, 0x0B, itf, 2, 0x02, 0x02, 0x00, 0, ep_notif, notif_tam, ep_saida, ep_entrada, (ep_tam) & 0xFF
+typedef struct {
+    uint8_t bLength, bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t bDeviceClass, bDeviceSubClass, bDeviceProtocol, bMaxPacketSize0;
+    uint16_t idVendor, idProduct, bcdDevice;
+    uint8_t iManufacturer, iProduct, iSerialNumber, bNumConfigurations;
+} tusb_desc_device_t;
+typedef struct { uint32_t bit_rate; uint8_t stop_bits, parity, data_bits; } cdc_line_coding_t;
+bool tusb_init(void);
+void tud_task(void);
+bool tud_task_event_ready(void);
+bool tud_cdc_connected(void);
+uint32_t tud_cdc_available(void);
+uint32_t tud_cdc_read(void *dados, uint32_t len);
+uint32_t tud_cdc_write_available(void);
+uint32_t tud_cdc_write(const void *dados, uint32_t len);
+uint32_t tud_cdc_write_flush(void);
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts); // Implementados pelo firmware
+void tud_umount_cb(void);
+void reset_usb_boot(uint32_t mascara_gpio, uint32_t desabilita_interfaces);
+
+// --- Watchdog / Multicore / Clocks ---
+void watchdog_enable(uint32_t ms, bool pausa_debug);
+void watchdog_update(void);
+void multicore_launch_core1(void (*entrada)(void));
+void multicore_lockout_victim_init(void);
+enum clock_index { clk_sys = 5 };
+uint32_t clock_get_hz(enum clock_index clk);
+
+// SysTick: cada acesso atualiza o contador decrescente a partir do relógio do host
+// (1 "ciclo" = 1 ns, consistente com clock_get_hz(clk_sys) = 1 GHz no simulador).
+typedef struct { volatile uint32_t csr, rvr, cvr, calib; } systick_hw_t;
+systick_hw_t *sim_systick(void);
+#define systick_hw (sim_systick())
+
+// --- Controle do Simulador (usado pelo harness) ---
+/** @brief Avança o relógio simulado, processando timers, DMA e UART em ordem. */
+void sim_avanca_us(uint64_t us);
+/** @brief Conclui na hora as transferências DMA de TX pendentes (sem avançar o relógio). */
+void sim_conclui_tx(void);
+/** @brief Define o valor que o ADC simulado converte em cada canal (0-2). */
+void sim_adc_define(uint canal, uint16_t valor);
+/** @brief Coloca bytes na FIFO de RX da UART e dispara a IRQ se habilitada. Retorna bytes aceitos. */
+uint32_t sim_uart_injeta(const uint8_t *dados, uint32_t len);
+/** @brief Registra quem recebe os bytes transmitidos pela UART (DMA ou escrita bloqueante). */
+void sim_uart_define_saida(void (*saida)(const uint8_t *dados, uint32_t len));
+/** @brief Abre (dtr = true) ou fecha a porta CDC no "host"; o firmware troca de enlace. */
+void sim_usb_conecta(bool dtr);
+/** @brief Coloca bytes na FIFO de RX do CDC. Retorna bytes aceitos. */
+uint32_t sim_usb_injeta(const uint8_t *dados, uint32_t len);
+/** @brief Registra quem recebe os bytes escritos na FIFO de TX do CDC. */
+void sim_usb_define_saida(void (*saida)(const uint8_t *dados, uint32_t len));
+
+#endif // SIM_HAL_H
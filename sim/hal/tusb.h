@@ -0,0 +1,4 @@
+// Simulação no host: ver sim_hal.h (CDC falso; os tamanhos vêm do tusb_config.h real)
+#define CFG_TUSB_MCU 0
+#include "../../tusb_config.h"
+#include "sim_hal.h"
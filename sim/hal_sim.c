@@ -0,0 +1,457 @@
+/**
+ * @file hal_sim.c
+ * @brief Implementação do HAL falso (ver hal/sim_hal.h).
+ *
+ * Simulação por eventos discretos com relógio em microssegundos:
+ * - Timers repetitivos disparam no instante programado.
+ * - O DMA do ADC fecha um bloco a cada (amostras / taxa do ADC) e encadeia o próximo canal;
+ *   canais que escrevem num registrador de outro canal (controle) concluem na hora.
+ * - O DMA de TX conclui após o tempo de linha no baud atual (10 bits por byte).
+ */
+
+#include <string.h>
+#include <time.h>
+#include "sim_hal.h"
+#include "tusb.h" // Tamanhos das FIFOs do CDC (tusb_config.h do firmware)
+
+// --- Relógio e Timers ---
+#define SIM_MAX_TIMERS 4
+
+typedef struct {
+    repeating_timer_t *t;
+    uint64_t periodo_us;
+    uint64_t proximo_us;
+} sim_timer_t;
+
+static uint64_t s_agora_us = 0;
+static sim_timer_t s_timers[SIM_MAX_TIMERS];
+
+absolute_time_t get_absolute_time(void) { return s_agora_us; }
+uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+uint64_t time_us_64(void) { return s_agora_us; }
+uint32_t time_us_32(void) { return (uint32_t)s_agora_us; }
+void sleep_ms(uint32_t ms) { sim_avanca_us((uint64_t)ms * 1000); }
+void stdio_init_all(void) {}
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t cb, void *user_data, repeating_timer_t *t) {
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (s_timers[i].t != NULL) continue;
+        uint64_t periodo = (uint64_t)(delay_us < 0 ? -delay_us : delay_us);
+        t->delay_us = delay_us;
+        t->callback = cb;
+        t->user_data = user_data;
+        s_timers[i].t = t;
+        s_timers[i].periodo_us = periodo ? periodo : 1;
+        s_timers[i].proximo_us = s_agora_us + s_timers[i].periodo_us;
+        return true;
+    }
+    return false;
+}
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t cb, void *user_data, repeating_timer_t *t) {
+    return add_repeating_timer_us((int64_t)delay_ms * 1000, cb, user_data, t);
+}
+
+bool cancel_repeating_timer(repeating_timer_t *t) {
+    for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (s_timers[i].t == t) { s_timers[i].t = NULL; return true; }
+    }
+    return false;
+}
+
+// --- IRQ ---
+static irq_handler_t s_irq_handler[32];
+static bool s_irq_habilitada[32];
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) { s_irq_handler[num] = handler; }
+void irq_set_enabled(uint num, bool habilitada) { s_irq_habilitada[num] = habilitada; }
+
+static void sim_dispara_irq(uint num) {
+    if (s_irq_habilitada[num] && s_irq_handler[num]) s_irq_handler[num]();
+}
+
+// --- GPIO ---
+static bool s_gpio[30];
+
+void gpio_init(uint pino) { s_gpio[pino] = false; }
+void gpio_set_dir(uint pino, bool saida) { (void)pino; (void)saida; }
+void gpio_put(uint pino, bool valor) { s_gpio[pino] = valor; }
+bool gpio_get(uint pino) { return s_gpio[pino]; }
+void gpio_set_function(uint pino, int funcao) { (void)pino; (void)funcao; }
+
+// --- PWM (só guarda a configuração) ---
+static uint16_t s_pwm_wrap[8];
+static uint16_t s_pwm_nivel[30];
+static bool s_pwm_habilitado[8];
+
+void pwm_set_clkdiv(uint slice, float div) { (void)slice; (void)div; }
+void pwm_set_wrap(uint slice, uint16_t wrap) { s_pwm_wrap[slice] = wrap; }
+void pwm_set_gpio_level(uint pino, uint16_t nivel) { s_pwm_nivel[pino] = nivel; }
+void pwm_set_enabled(uint slice, bool habilitado) { s_pwm_habilitado[slice] = habilitado; }
+
+// --- RTC ---
+static bool s_rtc_acertado = false;
+static int64_t s_rtc_base_s = 0;    // Segundos desde 1970 no instante do acerto
+static uint64_t s_rtc_base_us = 0;  // Relógio simulado no instante do acerto
+
+void rtc_init(void) { s_rtc_acertado = false; }
+
+bool rtc_set_datetime(const datetime_t *t) {
+    struct tm tm = { .tm_year = t->year - 1900, .tm_mon = t->month - 1, .tm_mday = t->day,
+                     .tm_hour = t->hour, .tm_min = t->min, .tm_sec = t->sec };
+    s_rtc_base_s = (int64_t)timegm(&tm);
+    s_rtc_base_us = s_agora_us;
+    s_rtc_acertado = true;
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t) {
+    if (!s_rtc_acertado) return false;
+    time_t agora = (time_t)(s_rtc_base_s + (int64_t)((s_agora_us - s_rtc_base_us) / 1000000));
+    struct tm tm;
+    gmtime_r(&agora, &tm);
+    *t = (datetime_t){ (int16_t)(tm.tm_year + 1900), (int8_t)(tm.tm_mon + 1), (int8_t)tm.tm_mday,
+                       (int8_t)tm.tm_wday, (int8_t)tm.tm_hour, (int8_t)tm.tm_min, (int8_t)tm.tm_sec };
+    return true;
+}
+
+// --- ID único ---
+void pico_get_unique_board_id(pico_unique_board_id_t *id) {
+    static const uint8_t fixo[PICO_UNIQUE_BOARD_ID_SIZE_BYTES] = {0xE6, 0x61, 0x38, 0x52, 0x83, 0x1A, 0x2C, 0x27};
+    memcpy(id->id, fixo, sizeof(fixo));
+}
+
+// --- USB (CDC) ---
+// O "host" lê tudo na hora: a FIFO de TX nunca enche e a escrita vai direto para a saída.
+#define SIM_USB_FIFO CFG_TUD_CDC_RX_BUFSIZE
+static bool s_usb_dtr = false;
+static uint8_t s_usb_rx[SIM_USB_FIFO];
+static uint32_t s_usb_rx_cabeca = 0, s_usb_rx_cauda = 0;
+static void (*s_usb_saida)(const uint8_t *dados, uint32_t len) = NULL;
+
+bool tusb_init(void) { return true; }
+void tud_task(void) {}
+bool tud_task_event_ready(void) { return false; }
+bool tud_cdc_connected(void) { return s_usb_dtr; }
+uint32_t tud_cdc_available(void) { return s_usb_rx_cabeca - s_usb_rx_cauda; }
+uint32_t tud_cdc_read(void *dados, uint32_t len) {
+    uint32_t n = 0;
+    while (n < len && s_usb_rx_cauda != s_usb_rx_cabeca) ((uint8_t *)dados)[n++] = s_usb_rx[s_usb_rx_cauda++ % SIM_USB_FIFO];
+    return n;
+}
+uint32_t tud_cdc_write_available(void) { return CFG_TUD_CDC_TX_BUFSIZE; }
+uint32_t tud_cdc_write(const void *dados, uint32_t len) {
+    if (len > CFG_TUD_CDC_TX_BUFSIZE) len = CFG_TUD_CDC_TX_BUFSIZE;
+    if (s_usb_saida) s_usb_saida((const uint8_t *)dados, len);
+    return len;
+}
+uint32_t tud_cdc_write_flush(void) { return 0; }
+void reset_usb_boot(uint32_t mascara_gpio, uint32_t desabilita_interfaces) { (void)mascara_gpio; (void)desabilita_interfaces; }
+
+void sim_usb_conecta(bool dtr) {
+    s_usb_dtr = dtr;
+    tud_cdc_line_state_cb(0, dtr, false);
+}
+
+uint32_t sim_usb_injeta(const uint8_t *dados, uint32_t len) {
+    uint32_t aceitos = 0;
+    while (aceitos < len && s_usb_rx_cabeca - s_usb_rx_cauda < SIM_USB_FIFO) {
+        s_usb_rx[s_usb_rx_cabeca++ % SIM_USB_FIFO] = dados[aceitos++];
+    }
+    return aceitos;
+}
+
+void sim_usb_define_saida(void (*saida)(const uint8_t *dados, uint32_t len)) { s_usb_saida = saida; }
+
+// --- ADC ---
+static adc_hw_t s_adc_hw;
+adc_hw_t *adc_hw = &s_adc_hw;
+static uint16_t s_adc_valor[3];
+static uint s_adc_canal = 0;
+static uint s_adc_round_robin = 0;
+static float s_adc_div = 0.0f;
+static bool s_adc_rodando = false;
+
+void sim_adc_define(uint canal, uint16_t valor) { s_adc_valor[canal] = valor & 0x0FFF; }
+void adc_init(void) {}
+void adc_gpio_init(uint pino) { (void)pino; }
+void adc_select_input(uint canal) { s_adc_canal = canal; }
+uint16_t adc_read(void) { return s_adc_valor[s_adc_canal]; }
+void adc_set_round_robin(uint mascara) { s_adc_round_robin = mascara; }
+void adc_fifo_setup(bool en, bool dreq_en, uint limiar, bool err_in_fifo, bool byte_shift) {
+    (void)en; (void)dreq_en; (void)limiar; (void)err_in_fifo; (void)byte_shift;
+}
+void adc_set_clkdiv(float div) { s_adc_div = div; }
+void adc_fifo_drain(void) {}
+
+static uint16_t sim_adc_converte(void) {
+    uint16_t v = s_adc_valor[s_adc_canal];
+    if (s_adc_round_robin) {
+        do { s_adc_canal = (s_adc_canal + 1) % 3; } while (!(s_adc_round_robin & (1u << s_adc_canal)));
+    }
+    return v;
+}
+
+// --- UART ---
+#define SIM_UART_FIFO 32 // Mesma profundidade da FIFO de RX do PL011
+
+struct uart_inst { uint baud; bool irq_rx; };
+static struct uart_inst s_uart0_inst = { 115200, false };
+uart_inst_t *const sim_uart0 = &s_uart0_inst;
+static uart_hw_t s_uart_hw;
+static uint8_t s_uart_rx[SIM_UART_FIFO];
+static uint32_t s_uart_rx_cabeca = 0, s_uart_rx_cauda = 0;
+static void (*s_uart_saida)(const uint8_t *dados, uint32_t len) = NULL;
+
+uint uart_init(uart_inst_t *uart, uint baud) { uart->baud = baud; return baud; }
+uint uart_set_baudrate(uart_inst_t *uart, uint baud) { uart->baud = baud; return baud; }
+bool uart_is_readable(uart_inst_t *uart) { (void)uart; return s_uart_rx_cabeca != s_uart_rx_cauda; }
+char uart_getc(uart_inst_t *uart) {
+    (void)uart;
+    return (char)s_uart_rx[s_uart_rx_cauda++ % SIM_UART_FIFO];
+}
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *dados, size_t len) {
+    (void)uart;
+    if (s_uart_saida) s_uart_saida(dados, (uint32_t)len);
+}
+void uart_set_irq_enables(uart_inst_t *uart, bool rx, bool tx) { (void)tx; uart->irq_rx = rx; }
+void uart_tx_wait_blocking(uart_inst_t *uart) { (void)uart; sim_conclui_tx(); }
+uint uart_get_dreq(uart_inst_t *uart, bool tx) { (void)uart; return tx ? 20 : 21; }
+uart_hw_t *uart_get_hw(uart_inst_t *uart) { (void)uart; return &s_uart_hw; }
+
+void sim_uart_define_saida(void (*saida)(const uint8_t *dados, uint32_t len)) { s_uart_saida = saida; }
+
+uint32_t sim_uart_injeta(const uint8_t *dados, uint32_t len) {
+    uint32_t aceitos = 0;
+    while (aceitos < len && s_uart_rx_cabeca - s_uart_rx_cauda < SIM_UART_FIFO) {
+        s_uart_rx[s_uart_rx_cabeca++ % SIM_UART_FIFO] = dados[aceitos++];
+    }
+    if (aceitos && s_uart0_inst.irq_rx) sim_dispara_irq(UART0_IRQ);
+    return aceitos;
+}
+
+// --- DMA ---
+#define SIM_DMA_CANAIS 12
+
+typedef struct {
+    bool reservado, ocupado;
+    dma_channel_config cfg;
+    volatile void *escrita;
+    const volatile void *leitura;
+    uint contagem;
+    bool irq0_hab, irq1_hab, irq0_status, irq1_status;
+    uint64_t fim_us; // Instante em que a transferência em andamento termina
+} sim_dma_t;
+
+static sim_dma_t s_dma[SIM_DMA_CANAIS];
+static dma_channel_hw_t s_dma_hw[SIM_DMA_CANAIS];
+
+dma_channel_hw_t *dma_channel_hw_addr(uint canal) { return &s_dma_hw[canal]; }
+
+int dma_claim_unused_channel(bool obrigatorio) {
+    (void)obrigatorio;
+    for (int i = 0; i < SIM_DMA_CANAIS; i++) {
+        if (!s_dma[i].reservado) { s_dma[i].reservado = true; return i; }
+    }
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint canal) {
+    dma_channel_config c = { DMA_SIZE_32, (int8_t)canal, false, false, 0 };
+    return c;
+}
+void channel_config_set_transfer_data_size(dma_channel_config *c, int tamanho) { c->tamanho = (uint8_t)tamanho; }
+void channel_config_set_read_increment(dma_channel_config *c, bool incrementa) { (void)c; (void)incrementa; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incrementa) { c->incrementa_escrita = incrementa; }
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) { (void)c; (void)dreq; }
+void channel_config_set_chain_to(dma_channel_config *c, uint canal) { c->encadeia = (int8_t)canal; }
+void channel_config_set_ring(dma_channel_config *c, bool escrita, uint bits) {
+    c->anel_escrita = escrita;
+    c->anel_bits = (uint8_t)bits;
+}
+
+static bool sim_dma_do_adc(uint canal) { return s_dma[canal].leitura == &adc_hw->fifo; }
+
+// Canal de controle: o destino é um registrador de outro canal DMA
+static bool sim_dma_controle(uint canal) {
+    uintptr_t e = (uintptr_t)s_dma[canal].escrita;
+    return e >= (uintptr_t)s_dma_hw && e < (uintptr_t)(s_dma_hw + SIM_DMA_CANAIS);
+}
+static void sim_dma_conclui(uint canal);
+
+// Duração da transferência: DREQ do ADC (48 MHz / (div + 1)) ou tempo de linha da UART
+static uint64_t sim_dma_duracao_us(uint canal) {
+    if (sim_dma_do_adc(canal)) {
+        double taxa = 48000000.0 / (s_adc_div + 1.0);
+        return (uint64_t)(s_dma[canal].contagem * 1e6 / taxa);
+    }
+    return (uint64_t)s_dma[canal].contagem * 10u * 1000000u / s_uart0_inst.baud;
+}
+
+void dma_channel_start(uint canal) {
+    s_dma_hw[canal].write_addr = (uintptr_t)s_dma[canal].escrita;
+    if (sim_dma_controle(canal)) { // Sem DREQ: conclui antes de qualquer outro evento
+        s_dma[canal].ocupado = true;
+        sim_dma_conclui(canal);
+        return;
+    }
+    if (sim_dma_do_adc(canal) && !s_adc_rodando) {
+        s_dma[canal].ocupado = true;
+        s_dma[canal].fim_us = UINT64_MAX; // Aguarda adc_run(true)
+        return;
+    }
+    s_dma[canal].ocupado = true;
+    s_dma[canal].fim_us = s_agora_us + sim_dma_duracao_us(canal);
+}
+
+void adc_run(bool rodando) {
+    s_adc_rodando = rodando;
+    for (uint i = 0; i < SIM_DMA_CANAIS; i++) {
+        if (rodando && s_dma[i].ocupado && sim_dma_do_adc(i)) s_dma[i].fim_us = s_agora_us + sim_dma_duracao_us(i);
+    }
+}
+
+void dma_channel_configure(uint canal, const dma_channel_config *c, volatile void *escrita,
+                           const volatile void *leitura, uint contagem, bool dispara) {
+    s_dma[canal].cfg = *c;
+    s_dma[canal].escrita = escrita;
+    s_dma[canal].leitura = leitura;
+    s_dma[canal].contagem = contagem;
+    if (dispara) dma_channel_start(canal);
+}
+
+void dma_channel_set_irq0_enabled(uint canal, bool habilitada) { s_dma[canal].irq0_hab = habilitada; }
+void dma_channel_set_irq1_enabled(uint canal, bool habilitada) { s_dma[canal].irq1_hab = habilitada; }
+bool dma_channel_get_irq0_status(uint canal) { return s_dma[canal].irq0_status; }
+void dma_channel_acknowledge_irq0(uint canal) { s_dma[canal].irq0_status = false; }
+void dma_channel_acknowledge_irq1(uint canal) { s_dma[canal].irq1_status = false; }
+
+void dma_channel_set_write_addr(uint canal, volatile void *escrita, bool dispara) {
+    s_dma[canal].escrita = escrita;
+    if (dispara) dma_channel_start(canal);
+}
+
+void dma_channel_set_read_addr(uint canal, const volatile void *leitura, bool dispara) {
+    s_dma[canal].leitura = leitura;
+    if (dispara) dma_channel_start(canal);
+}
+
+void dma_channel_abort(uint canal) { s_dma[canal].ocupado = false; }
+
+void dma_channel_transfer_from_buffer_now(uint canal, const volatile void *leitura, uint32_t contagem) {
+    s_dma[canal].leitura = leitura;
+    s_dma[canal].contagem = contagem;
+    dma_channel_start(canal);
+}
+
+/**
+ * @brief Conclui a transferência do canal: copia os dados, sinaliza a IRQ e encadeia.
+ */
+static void sim_dma_conclui(uint canal) {
+    sim_dma_t *d = &s_dma[canal];
+    d->ocupado = false;
+    if (sim_dma_do_adc(canal)) {
+        volatile uint16_t *destino = (volatile uint16_t *)d->escrita;
+        for (uint i = 0; i < d->contagem; i++) destino[i] = sim_adc_converte();
+        if (d->cfg.incrementa_escrita) d->escrita = destino + d->contagem; // Como no hardware: não volta sozinho
+        s_dma_hw[canal].write_addr = (uintptr_t)d->escrita;
+    } else if (sim_dma_controle(canal)) {
+        // Cada transferência copia um ponteiro (do tamanho do host) para al2_write_addr_trig do alvo
+        uint alvo = (uint)(((uintptr_t)d->escrita - (uintptr_t)s_dma_hw) / sizeof(dma_channel_hw_t));
+        for (uint i = 0; i < d->contagem; i++) {
+            uintptr_t leitura = (uintptr_t)d->leitura;
+            uintptr_t valor = *(const volatile uintptr_t *)leitura;
+            uintptr_t proxima = leitura + sizeof(uintptr_t);
+            if (d->cfg.anel_bits && !d->cfg.anel_escrita) {
+                uintptr_t mascara = ((uintptr_t)1 << d->cfg.anel_bits) - 1;
+                proxima = (leitura & ~mascara) | (proxima & mascara);
+            }
+            d->leitura = (const volatile void *)proxima;
+            s_dma_hw[alvo].al2_write_addr_trig = valor;
+            s_dma[alvo].escrita = (volatile void *)valor;
+            dma_channel_start(alvo);
+        }
+    } else if (s_uart_saida) {
+        s_uart_saida((const uint8_t *)d->leitura, d->contagem);
+    }
+    if (d->cfg.encadeia != (int8_t)canal) dma_channel_start((uint)d->cfg.encadeia);
+    if (d->irq0_hab) { d->irq0_status = true; sim_dispara_irq(DMA_IRQ_0); }
+    if (d->irq1_hab) { d->irq1_status = true; sim_dispara_irq(DMA_IRQ_1); }
+}
+
+void sim_conclui_tx(void) {
+    bool pendente = true;
+    while (pendente) { // A ISR de TX pode encadear o próximo trecho da fila
+        pendente = false;
+        for (uint i = 0; i < SIM_DMA_CANAIS; i++) {
+            if (s_dma[i].ocupado && !sim_dma_do_adc(i)) { sim_dma_conclui(i); pendente = true; }
+        }
+    }
+}
+
+// --- Flash (semântica NOR: apagar = 0xFF, gravar só derruba bits) ---
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+// Flash nova vem apagada; roda antes do main() do harness
+__attribute__((constructor)) static void sim_flash_inicia(void) {
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+}
+
+void flash_range_erase(uint32_t offset, size_t len) {
+    memset(&sim_flash[offset], 0xFF, len);
+}
+
+void flash_range_program(uint32_t offset, const uint8_t *dados, size_t len) {
+    for (size_t i = 0; i < len; i++) sim_flash[offset + i] &= dados[i];
+}
+
+int flash_safe_execute(void (*funcao)(void *), void *param, uint32_t timeout_ms) {
+    (void)timeout_ms;
+    funcao(param);
+    return PICO_OK;
+}
+
+// --- Watchdog / Multicore / Clocks ---
+void watchdog_enable(uint32_t ms, bool pausa_debug) { (void)ms; (void)pausa_debug; }
+void watchdog_update(void) {}
+void multicore_launch_core1(void (*entrada)(void)) { (void)entrada; }
+void multicore_lockout_victim_init(void) {}
+uint32_t clock_get_hz(enum clock_index clk) { (void)clk; return 1000000000u; }
+
+static systick_hw_t s_systick;
+
+systick_hw_t *sim_systick(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    s_systick.cvr = (uint32_t)(~ns) & 0x00FFFFFF; // Decrescente, 24 bits, como no Cortex-M0+
+    return &s_systick;
+}
+
+// --- Laço de Eventos ---
+void sim_avanca_us(uint64_t us) {
+    uint64_t alvo = s_agora_us + us;
+    while (1) {
+        // Próximo evento: timer ou fim de DMA, o que vier primeiro
+        uint64_t proximo = UINT64_MAX;
+        int timer = -1, canal = -1;
+        for (int i = 0; i < SIM_MAX_TIMERS; i++) {
+            if (s_timers[i].t && s_timers[i].proximo_us < proximo) { proximo = s_timers[i].proximo_us; timer = i; }
+        }
+        for (int i = 0; i < SIM_DMA_CANAIS; i++) {
+            if (s_dma[i].ocupado && s_dma[i].fim_us < proximo) { proximo = s_dma[i].fim_us; canal = i; timer = -1; }
+        }
+        if (proximo > alvo) break;
+        s_agora_us = proximo;
+
+        if (canal >= 0) {
+            sim_dma_conclui((uint)canal);
+        } else {
+            sim_timer_t *st = &s_timers[timer];
+            repeating_timer_t *t = st->t;
+            st->proximo_us += st->periodo_us;
+            if (!t->callback(t) && st->t == t) st->t = NULL;
+        }
+    }
+    s_agora_us = alvo;
+}
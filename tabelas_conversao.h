@@ -0,0 +1,114 @@
+/**
+ * @file tabelas_conversao.h
+ * @brief Tabelas ADC -> unidade física (centésimos), geradas por tools/gera_tabelas.py.
+ *
+ * NÃO EDITAR À MÃO: altere a calibração no script e gere novamente.
+ * Um ponto a cada 8 contagens do ADC, interpolação linear entre pontos.
+ * Erro máximo da interpolação: temperatura 0.014 °C, umidade 0.070 %.
+ * NTC: Beta 3950, R 10000 ohm a 25 °C, divisor de 10000 ohm; válido de -10 a 80 °C.
+ * Umidade: x = ln(adc / 3899.7) / -3.484, saturada em 0-100 %.
+ */
+#ifndef TABELAS_CONVERSAO_H
+#define TABELAS_CONVERSAO_H
+
+#include <stdint.h>
+
+#define CONV_PASSO_BITS 3
+#define CONV_PONTOS 513
+#define TEMP_CC_INVALIDA (-32768) // Sensor desconectado, em curto ou fora da faixa
+
+// Temperatura em centésimos de °C (decrescente com o ADC)
+static const int16_t g_tab_temp_cc[CONV_PONTOS] = {
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,   7981,   7920,
+      7861,   7802,   7745,   7688,   7632,   7578,   7524,   7471,   7418,   7367,   7316,   7267,
+      7217,   7169,   7121,   7074,   7028,   6982,   6937,   6892,   6848,   6804,   6761,   6719,
+      6677,   6636,   6595,   6554,   6514,   6475,   6436,   6397,   6359,   6321,   6283,   6246,
+      6210,   6173,   6138,   6102,   6067,   6032,   5997,   5963,   5929,   5896,   5862,   5829,
+      5796,   5764,   5732,   5700,   5668,   5637,   5606,   5575,   5545,   5514,   5484,   5454,
+      5425,   5395,   5366,   5337,   5308,   5280,   5251,   5223,   5195,   5167,   5140,   5112,
+      5085,   5058,   5031,   5004,   4978,   4952,   4925,   4899,   4874,   4848,   4822,   4797,
+      4772,   4746,   4722,   4697,   4672,   4647,   4623,   4599,   4575,   4551,   4527,   4503,
+      4479,   4456,   4432,   4409,   4386,   4363,   4340,   4317,   4294,   4271,   4249,   4227,
+      4204,   4182,   4160,   4138,   4116,   4094,   4072,   4051,   4029,   4007,   3986,   3965,
+      3943,   3922,   3901,   3880,   3859,   3839,   3818,   3797,   3776,   3756,   3735,   3715,
+      3695,   3674,   3654,   3634,   3614,   3594,   3574,   3554,   3535,   3515,   3495,   3475,
+      3456,   3436,   3417,   3398,   3378,   3359,   3340,   3321,   3301,   3282,   3263,   3244,
+      3225,   3206,   3188,   3169,   3150,   3131,   3113,   3094,   3075,   3057,   3038,   3020,
+      3002,   2983,   2965,   2947,   2928,   2910,   2892,   2874,   2856,   2837,   2819,   2801,
+      2783,   2765,   2747,   2729,   2712,   2694,   2676,   2658,   2640,   2623,   2605,   2587,
+      2569,   2552,   2534,   2516,   2499,   2481,   2464,   2446,   2429,   2411,   2394,   2376,
+      2359,   2341,   2324,   2307,   2289,   2272,   2254,   2237,   2220,   2202,   2185,   2168,
+      2151,   2133,   2116,   2099,   2082,   2064,   2047,   2030,   2013,   1995,   1978,   1961,
+      1944,   1927,   1909,   1892,   1875,   1858,   1841,   1823,   1806,   1789,   1772,   1755,
+      1737,   1720,   1703,   1686,   1668,   1651,   1634,   1617,   1600,   1582,   1565,   1548,
+      1530,   1513,   1496,   1479,   1461,   1444,   1426,   1409,   1392,   1374,   1357,   1339,
+      1322,   1305,   1287,   1270,   1252,   1234,   1217,   1199,   1182,   1164,   1146,   1129,
+      1111,   1093,   1076,   1058,   1040,   1022,   1004,    986,    968,    950,    932,    914,
+       896,    878,    860,    842,    824,    805,    787,    769,    750,    732,    714,    695,
+       677,    658,    639,    621,    602,    583,    564,    545,    526,    507,    488,    469,
+       450,    431,    412,    392,    373,    353,    334,    314,    294,    275,    255,    235,
+       215,    195,    175,    155,    134,    114,     94,     73,     53,     32,     11,    -10,
+       -31,    -52,    -73,    -94,   -116,   -137,   -159,   -180,   -202,   -224,   -246,   -268,
+      -291,   -313,   -336,   -358,   -381,   -404,   -427,   -450,   -473,   -497,   -521,   -544,
+      -568,   -592,   -617,   -641,   -666,   -691,   -716,   -741,   -766,   -792,   -817,   -843,
+      -869,   -896,   -922,   -949,   -976, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+    -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768, -32768,
+};
+
+// Umidade em centésimos de % (decrescente com o ADC)
+static const int16_t g_tab_umidade_cp[CONV_PONTOS] = {
+     10000,  10000,  10000,  10000,  10000,  10000,  10000,  10000,  10000,  10000,  10000,  10000,
+     10000,  10000,  10000,   9992,   9807,   9633,   9469,   9313,   9166,   9026,   8893,   8765,
+      8643,   8526,   8413,   8305,   8200,   8100,   8002,   7908,   7817,   7729,   7643,   7560,
+      7479,   7400,   7324,   7249,   7177,   7106,   7037,   6969,   6903,   6839,   6775,   6714,
+      6653,   6594,   6536,   6479,   6424,   6369,   6315,   6263,   6211,   6160,   6110,   6061,
+      6013,   5965,   5919,   5873,   5828,   5783,   5739,   5696,   5654,   5612,   5570,   5530,
+      5490,   5450,   5411,   5372,   5334,   5297,   5260,   5223,   5187,   5151,   5116,   5081,
+      5047,   5013,   4980,   4946,   4914,   4881,   4849,   4817,   4786,   4755,   4724,   4694,
+      4664,   4634,   4605,   4575,   4547,   4518,   4490,   4462,   4434,   4407,   4379,   4352,
+      4326,   4299,   4273,   4247,   4221,   4196,   4171,   4145,   4121,   4096,   4072,   4047,
+      4023,   3999,   3976,   3952,   3929,   3906,   3883,   3861,   3838,   3816,   3794,   3772,
+      3750,   3728,   3707,   3685,   3664,   3643,   3622,   3601,   3581,   3560,   3540,   3520,
+      3500,   3480,   3460,   3441,   3421,   3402,   3383,   3364,   3345,   3326,   3307,   3289,
+      3270,   3252,   3234,   3216,   3198,   3180,   3162,   3144,   3127,   3109,   3092,   3075,
+      3058,   3041,   3024,   3007,   2990,   2973,   2957,   2940,   2924,   2908,   2892,   2876,
+      2860,   2844,   2828,   2812,   2796,   2781,   2765,   2750,   2735,   2719,   2704,   2689,
+      2674,   2659,   2645,   2630,   2615,   2600,   2586,   2571,   2557,   2543,   2529,   2514,
+      2500,   2486,   2472,   2458,   2445,   2431,   2417,   2403,   2390,   2376,   2363,   2350,
+      2336,   2323,   2310,   2297,   2284,   2271,   2258,   2245,   2232,   2219,   2206,   2194,
+      2181,   2168,   2156,   2144,   2131,   2119,   2106,   2094,   2082,   2070,   2058,   2046,
+      2034,   2022,   2010,   1998,   1986,   1975,   1963,   1951,   1940,   1928,   1917,   1905,
+      1894,   1882,   1871,   1860,   1849,   1837,   1826,   1815,   1804,   1793,   1782,   1771,
+      1760,   1749,   1739,   1728,   1717,   1706,   1696,   1685,   1675,   1664,   1654,   1643,
+      1633,   1622,   1612,   1602,   1591,   1581,   1571,   1561,   1551,   1541,   1530,   1520,
+      1510,   1501,   1491,   1481,   1471,   1461,   1451,   1442,   1432,   1422,   1413,   1403,
+      1393,   1384,   1374,   1365,   1355,   1346,   1336,   1327,   1318,   1308,   1299,   1290,
+      1281,   1272,   1262,   1253,   1244,   1235,   1226,   1217,   1208,   1199,   1190,   1181,
+      1172,   1164,   1155,   1146,   1137,   1128,   1120,   1111,   1102,   1094,   1085,   1077,
+      1068,   1060,   1051,   1043,   1034,   1026,   1017,   1009,   1000,    992,    984,    976,
+       967,    959,    951,    943,    935,    926,    918,    910,    902,    894,    886,    878,
+       870,    862,    854,    846,    838,    830,    823,    815,    807,    799,    791,    784,
+       776,    768,    760,    753,    745,    738,    730,    722,    715,    707,    700,    692,
+       685,    677,    670,    662,    655,    648,    640,    633,    626,    618,    611,    604,
+       596,    589,    582,    575,    568,    560,    553,    546,    539,    532,    525,    518,
+       511,    504,    497,    490,    483,    476,    469,    462,    455,    448,    441,    434,
+       428,    421,    414,    407,    400,    394,    387,    380,    373,    367,    360,    353,
+       347,    340,    333,    327,    320,    314,    307,    301,    294,    288,    281,    275,
+       268,    262,    255,    249,    242,    236,    230,    223,    217,    210,    204,    198,
+       192,    185,    179,    173,    166,    160,    154,    148,    142,    135,    129,    123,
+       117,    111,    105,     99,     93,     86,     80,     74,     68,     62,     56,     50,
+        44,     38,     32,     26,     20,     15,      9,      3,      0,      0,      0,      0,
+         0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,      0,
+         0,      0,      0,      0,      0,      0,      0,      0,      0,
+};
+
+#endif // TABELAS_CONVERSAO_H
@@ -0,0 +1,406 @@
+"""
+Teste de carga do host: emula N estufas falando o protocolo do firmware e mede o app.py.
+
+Carrega o app.py como módulo (banco temporário, sem o Gemini nem o arquivo em Parquet)
+e roda as mesmas threads do main(): o gravador SQLite e o hub serial. Cada estufa
+emulada tem ID, sequência e relógio próprios e envia quadros 0x01 (1 Hz) ou lotes
+0x02 na taxa pedida, com valores sintéticos ou reproduzindo minha_estufa.db.
+
+Transportes:
+    pty     um par pseudo-terminal por estufa; o hub abre o lado escravo como porta
+            serial (POSIX, requer pyserial, igual ao uso real)
+    direto  os bytes vão direto para processa_bytes(), sem porta (qualquer SO)
+
+Com --clientes K, o servidor do Dash sobe numa porta local e K clientes chamam o
+callback update_graphs pelo HTTP, como abas abertas no intervalo 'tick'.
+
+Relatório: amostras enviadas/gravadas/descartadas, quadros corrompidos (--corrompe),
+inválidos e perdidos pela sequência, latência de ingestão (envio do quadro até o
+commit no SQLite) em percentis, vazão do banco e tempo de resposta do painel.
+Sai com código 1 se faltarem amostras além das dos quadros corrompidos ou se o p99
+passar de --limite-p99-ms.
+
+Uso: python tools/carga_estufa.py [--dispositivos 4] [--hz 100] [--lote 10] [--duracao 60]
+         [--traco minha_estufa.db] [--transporte pty|direto] [--corrompe 0.001]
+         [--clientes 2] [--porta-web 8051] [--limite-p99-ms 1000]
+"""
+import argparse
+import importlib.util
+import json
+import math
+import os
+import random
+import select
+import sqlite3
+import struct
+import sys
+import tempfile
+import threading
+import time
+import urllib.request
+
+RAIZ = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Formatos do firmware (decode_telemetry / decode_batch em app.py)
+TELEMETRIA = struct.Struct('>HHHBIhH3HIQBH')
+LOTE_CABECALHO = struct.Struct('>BBI3HIQI')
+LOTE_AMOSTRA = struct.Struct('>HhHH')
+TELEM_LOTE_MAX = 26
+
+# =============================================================================
+# CARGA DO APP.PY
+# =============================================================================
+
+def carrega_app(banco):
+    """Importa o app.py como módulo com o banco apontado para `banco` e a saída silenciada."""
+    spec = importlib.util.spec_from_file_location('app', os.path.join(RAIZ, 'app.py'))
+    estufa = importlib.util.module_from_spec(spec)
+    sys.modules['app'] = estufa
+    spec.loader.exec_module(estufa)
+    estufa.DB_FILE = banco
+    estufa.COM_PORTS = []
+    estufa.SERIAL_AUTODETECTA_USB = False
+    estufa.ARQUIVO_IDADE_DIAS = 0
+    estufa.print = lambda *a, **k: None # Um print por leitura mediria o terminal, não a ingestão
+    return estufa
+
+# =============================================================================
+# MÉTRICAS (ganchos nas funções do app.py)
+# =============================================================================
+
+metricas = {
+    'amostras_enviadas': 0, 'amostras_corrompidas': 0, 'quadros_enviados': 0, 'quadros_corrompidos': 0,
+    'quadros_invalidos': 0, 'latencias_s': [], 'atraso_max_s': 0.0,
+    'painel_s': [], 'painel_bytes': 0, 'painel_erros': 0,
+}
+enviados = {}           # (ID, seq) -> perf_counter() do envio
+pendentes = []          # Envios dos quadros da leitura em processamento (thread serial)
+blocos = {}             # id(bloco da fila) -> envios das amostras do bloco
+em_lote = []            # Envios das amostras já retiradas pelo gravador (thread db_writer)
+metricas_lock = threading.Lock()
+
+def instala_ganchos(estufa):
+    """Embrulha as funções do caminho de ingestão para datar cada quadro do envio ao commit."""
+    decode_frame, handle_frame = estufa.decode_frame, estufa.handle_frame
+    ingest_rows, ingest_retira, flush_rows = estufa.ingest_rows, estufa.ingest_retira, estufa.flush_rows
+
+    def decode_frame_medido(frame):
+        r = decode_frame(frame)
+        if r is None: metricas['quadros_invalidos'] += 1
+        return r
+
+    def handle_frame_medido(conn, frame, t_rx_ms):
+        rows = handle_frame(conn, frame, t_rx_ms)
+        if rows and conn['device'] is not None:
+            with metricas_lock: t = enviados.pop((conn['device'], conn['last_seq']), None)
+            if t is not None: pendentes.append(t)
+        return rows
+
+    def ingest_rows_medido(rows):
+        with metricas_lock: blocos[id(rows)] = pendentes[:]
+        pendentes.clear()
+        descartadas = estufa.ingest_stats['descartadas']
+        ingest_rows(rows)
+        if estufa.ingest_stats['descartadas'] != descartadas: # Fila cheia: o bloco não entra
+            with metricas_lock: blocos.pop(id(rows), None)
+
+    def ingest_retira_medido(bloco):
+        with metricas_lock: em_lote.extend(blocos.pop(id(bloco), ()))
+        return ingest_retira(bloco)
+
+    def flush_rows_medido(con, batch):
+        flush_rows(con, batch)
+        if threading.current_thread().name != 'db_writer': return # Backlog gravado pela thread serial
+        agora = time.perf_counter()
+        with metricas_lock:
+            metricas['latencias_s'].extend(agora - t for t in em_lote)
+            em_lote.clear()
+
+    estufa.decode_frame = decode_frame_medido
+    estufa.handle_frame = handle_frame_medido
+    estufa.ingest_rows = ingest_rows_medido
+    estufa.ingest_retira = ingest_retira_medido
+    estufa.flush_rows = flush_rows_medido
+
+def percentis(valores, escala=1000.0):
+    """Texto com p50/p95/p99/máx (ms por padrão)."""
+    if not valores: return "sem amostras"
+    v = sorted(valores)
+    p = lambda q: v[min(len(v) - 1, int(q * len(v)))] * escala
+    return f"p50 {p(0.50):.1f} | p95 {p(0.95):.1f} | p99 {p(0.99):.1f} | máx {v[-1] * escala:.1f} ms"
+
+# =============================================================================
+# ESTUFAS EMULADAS
+# =============================================================================
+
+def carrega_traco(caminho):
+    """Leituras (LDR, temp cC, umid crua, umid c%) de minha_estufa.db, na ordem gravada."""
+    con = sqlite3.connect(f'file:{caminho}?mode=ro', uri=True)
+    rows = con.execute("SELECT ldr_raw, temperature_c, umidade_raw, umidade_percent FROM readings "
+                       "WHERE temperature_c IS NOT NULL AND umidade_percent IS NOT NULL ORDER BY timestamp").fetchall()
+    con.close()
+    return [(ldr, round(t * 100), hum, round(hp * 100)) for ldr, t, hum, hp in rows]
+
+def amostra_sintetica(k, fase):
+    """Dia simulado: senoides lentas com ruído de ADC."""
+    x = k / 600.0 + fase
+    ldr = int(2000 + 1500 * math.sin(x) + random.randint(-8, 8))
+    temp_cc = int(2500 + 400 * math.sin(x / 3) + random.randint(-5, 5))
+    hum = int(2600 + 300 * math.cos(x / 2) + random.randint(-8, 8))
+    return ldr, temp_cc, hum, max(0, min(10000, (3900 - hum) * 4))
+
+def nova_estufa(i, args, traco):
+    return {
+        'id': 0x10000000 + i, 'seq': 0, 'k': random.randrange(len(traco)) if traco else 0,
+        'fase': random.random() * 6.28, 'origem_us': random.randrange(10**9), 'luz': 0,
+        'periodo_us': int(1e6 / args.hz), 'lote': 1 if args.hz <= 1 else args.lote,
+        'proximo': 0.0, 'fd': None, 'conn': None,
+    }
+
+def proxima_amostra(e, traco):
+    if traco:
+        a = traco[e['k'] % len(traco)]
+    else:
+        a = amostra_sintetica(e['k'], e['fase'])
+    e['k'] += 1
+    return a
+
+def monta_quadro(estufa, e, traco, t0):
+    """Um quadro na vez da estufa: 0x01 a 1 Hz ou um lote 0x02 com 'lote' amostras."""
+    t_us = e['origem_us'] + int((t0 - inicio_s) * 1e6)
+    if e['lote'] == 1 and e['periodo_us'] >= 1_000_000:
+        ldr, temp_cc, hum, hum_cp = proxima_amostra(e, traco)
+        dados = TELEMETRIA.pack(ldr, 0, hum, 0, e['luz'], temp_cc, hum_cp, 0, 0, 0, e['id'], t_us, 0, 1)
+        tipo, n = estufa.PROTO_TIPO_TELEMETRIA, 1
+    else:
+        n = e['lote']
+        t0_us = t_us - (n - 1) * e['periodo_us']
+        amostras = b''.join(LOTE_AMOSTRA.pack(*proxima_amostra(e, traco)) for _ in range(n))
+        dados = LOTE_CABECALHO.pack(n, 0, e['luz'], 0, 0, 0, e['id'], t0_us, e['periodo_us']) + amostras
+        tipo = estufa.PROTO_TIPO_LOTE
+    quadro = estufa.encode_frame(tipo, e['seq'], dados)
+    return quadro, n
+
+def corrompe(quadro):
+    """Troca um byte do meio do quadro sem criar delimitador (o CRC tem de pegar)."""
+    b = bytearray(quadro)
+    i = random.randrange(1, len(b) - 1)
+    b[i] ^= 0x55 if b[i] ^ 0x55 else 0xAA
+    return bytes(b)
+
+class PortaDireta:
+    """Porta falsa do transporte direto: descarta o que o host escreve (SET, GET,BACKLOG)."""
+    in_waiting = 0
+    baudrate = 0
+    def write(self, dados): return len(dados)
+    def flush(self): pass
+    def close(self): pass
+
+def emulador(estufa, estufas, args, traco, parar):
+    """Thread única que agenda os quadros de todas as estufas pelo relógio do host."""
+    intervalo = max(1, min(estufas[0]['lote'], TELEM_LOTE_MAX)) * estufas[0]['periodo_us'] / 1e6
+    for i, e in enumerate(estufas): e['proximo'] = inicio_s + intervalo * (i + 1) / len(estufas)
+    while not parar.is_set():
+        e = min(estufas, key=lambda x: x['proximo'])
+        espera = e['proximo'] - time.perf_counter()
+        if espera > 0:
+            time.sleep(espera)
+        elif -espera > metricas['atraso_max_s']:
+            metricas['atraso_max_s'] = -espera # O emulador não acompanha a taxa pedida
+        agora = time.perf_counter()
+        quadro, n = monta_quadro(estufa, e, traco, agora)
+        with metricas_lock: enviados[(e['id'], e['seq'])] = agora
+        metricas['quadros_enviados'] += 1
+        metricas['amostras_enviadas'] += n
+        if args.corrompe and random.random() < args.corrompe:
+            quadro = corrompe(quadro)
+            with metricas_lock: enviados.pop((e['id'], e['seq']), None)
+            metricas['quadros_corrompidos'] += 1
+            metricas['amostras_corrompidas'] += n
+        e['seq'] = (e['seq'] + 1) & 0xFFFF
+        e['luz'] = int(agora - inicio_s) // 2 # Metade do tempo com luz
+        if e['fd'] is not None:
+            os.write(e['fd'], quadro)
+            descarta_comandos(e['fd'])
+        else:
+            estufa.processa_bytes(e['conn'], quadro, time.time() * 1000)
+        e['proximo'] += intervalo
+
+def descarta_comandos(fd):
+    """Lê sem bloquear o que o host mandou para a estufa emulada (não há firmware para responder)."""
+    while select.select([fd], [], [], 0)[0]:
+        try:
+            if not os.read(fd, 4096): return
+        except OSError:
+            return
+
+def prepara_pty(estufa, estufas):
+    """Um par pty por estufa; o hub serial do app.py abre os escravos como portas."""
+    import tty
+    portas = []
+    for e in estufas:
+        mestre, escravo = os.openpty()
+        tty.setraw(escravo) # Sem eco nem tradução de fim de linha antes de o pyserial abrir
+        e['fd'], e['escravo'] = mestre, escravo
+        portas.append(os.ttyname(escravo))
+    threading.Thread(target=estufa.serial_hub, args=(portas,), name='serial_hub', daemon=True).start()
+    limite = time.monotonic() + 10
+    while time.monotonic() < limite:
+        abertas = [c for c in estufa.conexoes if c['ser'] is not None]
+        if len(abertas) == len(estufas): return True
+        time.sleep(0.05)
+    return False
+
+def prepara_direto(estufa, estufas):
+    for i, e in enumerate(estufas):
+        e['conn'] = conn = estufa.nova_conexao(f'direto{i}')
+        conn['ser'] = PortaDireta()
+        estufa.conexoes.append(conn)
+    return True
+
+# =============================================================================
+# CLIENTES DO PAINEL (callback update_graphs pelo HTTP do Dash)
+# =============================================================================
+
+def callback_graficos(estufa):
+    """Chave, saídas, entradas e estados do update_graphs no callback_map do Dash."""
+    for chave, cb in estufa.app.callback_map.items():
+        if 'live-cursor.data' in chave and any(i['id'] == 'tick' for i in cb['inputs']):
+            corpo = chave[2:-2] if chave.startswith('..') else chave
+            saidas = [dict(zip(('id', 'property'), s.rsplit('.', 1))) for s in corpo.split('...')]
+            return chave, saidas, cb['inputs'], cb['state']
+    raise RuntimeError("update_graphs não encontrado no callback_map")
+
+def cliente_painel(url, callback, device, args, parar):
+    """Uma aba aberta: chama update_graphs a cada --tick-s com o próprio cursor."""
+    chave, saidas, entradas, estados = callback
+    valores = {'tick.n_intervals': 0, 'history-range.value': 'live', 'device.value': device,
+               'in-meta.value': 14, 'live-cursor.data': None}
+    n = 0
+    while not parar.is_set():
+        n += 1
+        valores['tick.n_intervals'] = n
+        corpo = json.dumps({
+            'output': chave, 'outputs': saidas,
+            'inputs': [dict(i, value=valores.get(f"{i['id']}.{i['property']}")) for i in entradas],
+            'state': [dict(s, value=valores.get(f"{s['id']}.{s['property']}")) for s in estados],
+            'changedPropIds': ['tick.n_intervals'],
+        }).encode()
+        req = urllib.request.Request(url, corpo, {'Content-Type': 'application/json'})
+        t0 = time.perf_counter()
+        try:
+            with urllib.request.urlopen(req, timeout=30) as r: resposta = r.read()
+            dt = time.perf_counter() - t0
+            cursor = json.loads(resposta).get('response', {}).get('live-cursor', {})
+            if 'data' in cursor: valores['live-cursor.data'] = cursor['data']
+            with metricas_lock:
+                metricas['painel_s'].append(dt)
+                metricas['painel_bytes'] += len(resposta)
+        except Exception:
+            with metricas_lock: metricas['painel_erros'] += 1
+        parar.wait(args.tick_s)
+
+def inicia_painel(estufa, estufas, args, parar):
+    url = f"http://127.0.0.1:{args.porta_web}/_dash-update-component"
+    threading.Thread(target=estufa.app.run, kwargs=dict(port=args.porta_web, debug=False, use_reloader=False),
+                     name='painel', daemon=True).start()
+    time.sleep(1.0) # Servidor de desenvolvimento do Flask subindo
+    callback = callback_graficos(estufa)
+    for k in range(args.clientes):
+        device = estufas[k % len(estufas)]['id']
+        threading.Thread(target=cliente_painel, args=(url, callback, device, args, parar), daemon=True).start()
+
+# =============================================================================
+# MAIN
+# =============================================================================
+
+def relatorio(estufa, args, duracao_s):
+    m, st = metricas, estufa.ingest_stats
+    perdidos = sum(c['lost'] for c in estufa.conexoes)
+    faltando = m['amostras_enviadas'] - m['amostras_corrompidas'] - st['gravadas'] - st['descartadas']
+    print(f"Estufas: {args.dispositivos} ({args.transporte}), {args.hz:g} Hz"
+          f"{f', lotes de {args.lote}' if args.hz > 1 else ''}, {duracao_s:.0f} s"
+          f"{', traço ' + args.traco if args.traco else ', sinais sintéticos'}")
+    print(f"Amostras: {m['amostras_enviadas']} enviadas, {st['gravadas']} gravadas "
+          f"({st['gravadas'] / duracao_s:.0f}/s), {st['descartadas']} descartadas na fila, {faltando} faltando")
+    print(f"Quadros: {m['quadros_enviados']} enviados, {m['quadros_corrompidos']} corrompidos, "
+          f"{m['quadros_invalidos']} inválidos no host, {perdidos} perdidos pela sequência")
+    print(f"Latência de ingestão (envio -> commit): {percentis(m['latencias_s'])}")
+    print(f"Gravador: {st['lotes']} transações, flush médio {st['flush_ms_medio']:.1f} ms, "
+          f"máx {st['flush_ms_max']:.1f} ms, pico da fila {st['fila_pico']} amostras")
+    if m['atraso_max_s'] > 0.1:
+        print(f"AVISO: o emulador atrasou até {m['atraso_max_s'] * 1000:.0f} ms (taxa acima do que esta máquina gera)")
+    if args.clientes:
+        n = len(m['painel_s'])
+        media_kb = m['painel_bytes'] / n / 1024 if n else 0
+        print(f"Painel: {args.clientes} cliente(s), {n} chamadas de update_graphs ({media_kb:.1f} KB em média), "
+              f"{m['painel_erros']} erros | {percentis(m['painel_s'])}")
+    falhou = faltando > 0
+    if args.limite_p99_ms and m['latencias_s']:
+        v = sorted(m['latencias_s'])
+        falhou |= v[min(len(v) - 1, int(0.99 * len(v)))] * 1000 > args.limite_p99_ms
+    return 1 if falhou else 0
+
+def main():
+    global inicio_s
+    p = argparse.ArgumentParser(description="Teste de carga da ingestão e do painel do app.py")
+    p.add_argument('--dispositivos', type=int, default=4)
+    p.add_argument('--hz', type=float, default=1.0, help="Amostras por segundo por estufa (1 = pacote 0x01)")
+    p.add_argument('--lote', type=int, default=10, help=f"Amostras por lote 0x02 (até {TELEM_LOTE_MAX})")
+    p.add_argument('--duracao', type=float, default=60.0, help="Segundos de carga")
+    p.add_argument('--traco', help="Reproduz as leituras deste banco (ex.: minha_estufa.db)")
+    p.add_argument('--transporte', choices=('pty', 'direto'), default='pty' if os.name != 'nt' else 'direto')
+    p.add_argument('--corrompe', type=float, default=0.0, help="Fração dos quadros com um byte trocado")
+    p.add_argument('--clientes', type=int, default=0, help="Abas do painel chamando update_graphs")
+    p.add_argument('--tick-s', type=float, default=2.0, help="Intervalo de cada cliente (dcc.Interval 'tick')")
+    p.add_argument('--porta-web', type=int, default=8051)
+    p.add_argument('--banco', help="Banco SQLite de destino (padrão: temporário, apagado no fim)")
+    p.add_argument('--limite-p99-ms', type=float, default=0.0, help="Falha se o p99 da ingestão passar disso")
+    args = p.parse_args()
+    args.lote = max(1, min(args.lote, TELEM_LOTE_MAX))
+
+    temp = None
+    if args.banco is None:
+        temp = tempfile.mkdtemp(prefix='carga_estufa_')
+        args.banco = os.path.join(temp, 'carga.db')
+    traco = carrega_traco(args.traco) if args.traco else None
+    if args.traco and not traco:
+        print(f"Nenhuma leitura válida em {args.traco}")
+        return 1
+
+    estufa = carrega_app(args.banco)
+    instala_ganchos(estufa)
+    estufa.init_db()
+    threading.Thread(target=estufa.db_writer, name='db_writer', daemon=True).start()
+
+    estufas = [nova_estufa(i, args, traco) for i in range(args.dispositivos)]
+    pronto = prepara_pty(estufa, estufas) if args.transporte == 'pty' else prepara_direto(estufa, estufas)
+    if not pronto:
+        print("As portas pty não abriram no app.py (pyserial instalado?)")
+        return 1
+
+    parar = threading.Event()
+    # No transporte direto o emulador faz o papel do hub serial: uma thread decodifica todas as portas
+    fonte = threading.Thread(target=emulador, args=(estufa, estufas, args, traco, parar), name='emulador', daemon=True)
+    inicio_s = time.perf_counter()
+    fonte.start()
+    if args.clientes: inicia_painel(estufa, estufas, args, parar)
+
+    time.sleep(args.duracao)
+    parar.set()
+    fonte.join()
+    limite = time.monotonic() + 10 # Drena a fila: o gravador fecha o último lote pelo prazo
+    while time.monotonic() < limite and (estufa.ingest_stats['fila'] or em_lote or blocos):
+        time.sleep(0.05)
+    time.sleep(estufa.INGEST_INTERVALO_MS / 1000.0 * 2)
+
+    rc = relatorio(estufa, args, args.duracao)
+    if temp:
+        for nome in os.listdir(temp): os.remove(os.path.join(temp, nome))
+        os.rmdir(temp)
+    return rc
+
+inicio_s = 0.0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,115 @@
+"""
+Gera tabelas_conversao.h: tabelas de consulta ADC -> unidade física para o firmware.
+
+O Cortex-M0+ do RP2040 não tem FPU; log/exp em software custam milhares de ciclos.
+As curvas de calibração (as mesmas de app.py) são amostradas aqui, uma vez, e o
+firmware interpola linearmente entre os pontos com aritmética inteira.
+
+Uso: python tools/gera_tabelas.py  (reescreve tabelas_conversao.h na raiz do projeto)
+"""
+import math
+import os
+
+# Calibração (manter igual a app.py)
+R_FIXO_NTC = 10000.0
+R_NOMINAL_NTC = 10000.0
+TEMP_NOMINAL_C = 25.0
+BETA_NTC = 3950.0
+HUMID_A = 3899.7
+HUMID_B = -3.484
+ADC_MAX = 4095.0
+V_IN = 3.3
+
+# Faixa válida do NTC (fora dela o firmware reporta TEMP_CC_INVALIDA)
+NTC_ADC_MAX_VALIDO = 4050
+TEMP_C_MIN = -10.0
+TEMP_C_MAX = 80.0
+
+PASSO_BITS = 3 # Um ponto a cada 8 contagens: 513 pontos por tabela
+PONTOS = (4096 >> PASSO_BITS) + 1
+INVALIDA = -32768
+
+SAIDA = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tabelas_conversao.h')
+
+def temp_c(adc):
+    """Equação Beta; None fora da faixa válida."""
+    if adc > NTC_ADC_MAX_VALIDO or adc <= 0: return None
+    v_out = adc * V_IN / ADC_MAX
+    r_ntc = v_out * R_FIXO_NTC / (V_IN - v_out)
+    t = 1.0 / (1.0 / (TEMP_NOMINAL_C + 273.15) + math.log(r_ntc / R_NOMINAL_NTC) / BETA_NTC) - 273.15
+    return None if (t < TEMP_C_MIN or t > TEMP_C_MAX) else t
+
+def umidade_pct(adc):
+    """Curva exponencial do sensor capacitivo, saturada em 0-100 %."""
+    if adc <= 0: return 100.0
+    if adc >= HUMID_A: return 0.0
+    return max(0.0, min(100.0, math.log(adc / HUMID_A) / HUMID_B * 100.0))
+
+def tabela(funcao):
+    """Valores em centésimos nos pontos k * 2^PASSO_BITS (o último ponto repete o ADC 4095)."""
+    pontos = []
+    for k in range(PONTOS):
+        v = funcao(min(k << PASSO_BITS, 4095))
+        pontos.append(INVALIDA if v is None else int(round(v * 100)))
+    return pontos
+
+def interpola(tab, adc):
+    """Mesma conta do firmware (conv_interpola em Estufa.c)."""
+    i, frac = adc >> PASSO_BITS, adc & ((1 << PASSO_BITS) - 1)
+    a, b = tab[i], tab[i + 1]
+    if a == INVALIDA or (b == INVALIDA and frac): return None
+    return a + (((b - a) * frac) >> PASSO_BITS) if frac else a
+
+def erro_maximo(tab, funcao):
+    """Maior desvio (em centésimos) da interpolação onde firmware e curva exata são válidos."""
+    pior = 0.0
+    for adc in range(4096):
+        exato, aprox = funcao(adc), interpola(tab, adc)
+        if exato is not None and aprox is not None:
+            pior = max(pior, abs(aprox - exato * 100))
+    return pior
+
+def formata(nome, tipo, valores):
+    linhas = [f"static const {tipo} {nome}[CONV_PONTOS] = {{"]
+    for i in range(0, len(valores), 12):
+        linhas.append("    " + ", ".join(f"{v:6d}" for v in valores[i:i + 12]) + ",")
+    linhas.append("};")
+    return linhas
+
+def main():
+    tab_temp = tabela(temp_c)
+    tab_umid = tabela(umidade_pct)
+    linhas = [
+        "/**",
+        " * @file tabelas_conversao.h",
+        " * @brief Tabelas ADC -> unidade física (centésimos), geradas por tools/gera_tabelas.py.",
+        " *",
+        " * NÃO EDITAR À MÃO: altere a calibração no script e gere novamente.",
+        f" * Um ponto a cada {1 << PASSO_BITS} contagens do ADC, interpolação linear entre pontos.",
+        f" * Erro máximo da interpolação: temperatura {erro_maximo(tab_temp, temp_c) / 100:.3f} °C,"
+        f" umidade {erro_maximo(tab_umid, umidade_pct) / 100:.3f} %.",
+        f" * NTC: Beta {BETA_NTC:.0f}, R {R_NOMINAL_NTC:.0f} ohm a {TEMP_NOMINAL_C:.0f} °C, divisor de {R_FIXO_NTC:.0f} ohm;"
+        f" válido de {TEMP_C_MIN:.0f} a {TEMP_C_MAX:.0f} °C.",
+        f" * Umidade: x = ln(adc / {HUMID_A}) / {HUMID_B}, saturada em 0-100 %.",
+        " */",
+        "#ifndef TABELAS_CONVERSAO_H",
+        "#define TABELAS_CONVERSAO_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        f"#define CONV_PASSO_BITS {PASSO_BITS}",
+        f"#define CONV_PONTOS {PONTOS}",
+        f"#define TEMP_CC_INVALIDA ({INVALIDA}) // Sensor desconectado, em curto ou fora da faixa",
+        "",
+        "// Temperatura em centésimos de °C (decrescente com o ADC)",
+    ]
+    linhas += formata("g_tab_temp_cc", "int16_t", tab_temp)
+    linhas += ["", "// Umidade em centésimos de % (decrescente com o ADC)"]
+    linhas += formata("g_tab_umidade_cp", "int16_t", tab_umid)
+    linhas += ["", "#endif // TABELAS_CONVERSAO_H", ""]
+    with open(SAIDA, 'w', encoding='utf-8', newline='\r\n') as f:
+        f.write("\n".join(linhas))
+    print(f"{os.path.normpath(SAIDA)}: {PONTOS} pontos por tabela")
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,34 @@
+/**
+ * @file tusb_config.h
+ * @brief Configuração da TinyUSB para o enlace CDC do firmware (TRANSPORTE_USB em Estufa.c).
+ *
+ * Substitui o stdio USB do SDK: o firmware não usa printf e a porta CDC carrega
+ * o mesmo protocolo enquadrado da UART. Os descritores ficam em Estufa.c.
+ */
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+// --- Pilha ---
+#ifndef CFG_TUSB_MCU
+#error CFG_TUSB_MCU deve ser definido pelo build (Pico SDK)
+#endif
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS OPT_OS_PICO
+#endif
+#define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
+#define CFG_TUD_ENABLED 1
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// --- Classes: só um CDC ---
+#define CFG_TUD_CDC 1
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 0
+
+// FIFOs do CDC: a de TX comporta a fila de TX do firmware inteira (TX_FILA_BYTES)
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 1024
+#define CFG_TUD_CDC_EP_BUFSIZE 64 // Pacote bulk em full-speed
+
+#endif // TUSB_CONFIG_H